@@ -0,0 +1,957 @@
+/**
+ * @file bench.cpp
+ * @brief Microbenchmarks of every pipeline stage in isolation.
+ *
+ * Each case runs one stage (generation, the producer/encoder queue, encoding or a writer
+ * backend) flat out for a fixed time at a given resolution and thread count, and reports
+ * the frames per second it sustained. A stage whose fps falls below the camera's frame rate
+ * is the bottleneck of a real run, so regressions show up without a real-time soak test.
+ * The alloc stage counts heap allocations per frame of the steady-state pipeline instead,
+ * the kernels stage compares the fixed-profile pixel loops with the generic ones, and the
+ * pipeline stage checks that Pipeline::stats() can be polled while wait() tears a run down.
+ */
+#include <../dependencies/argparse.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "modules/SafetyQueue.h"
+#include "modules/RingQueue.h"
+#include "modules/StealQueue.h"
+#include "modules/TilePool.h"
+#include "modules/FastRandom.h"
+#include "modules/FrameSink.h"
+#include "modules/UringSink.h"
+#include "modules/ContainerSink.h"
+#include "modules/FrameEncoder.h"
+#include "modules/BufferPool.h"
+#include "modules/FramePool.h"
+#include "modules/FrameKernels.h"
+#include "modules/Channel.h"
+#include "modules/Affinity.h"
+#include "./modules.h"
+
+// Generators, defined in generator.cpp
+void generateRandomImage(cv::Mat& dst);
+void generateRandomImage(cv::Mat& dst, uint64_t seed, int frame_id);
+void generateRandomImage(cv::Mat& dst, uint64_t seed, int frame_id, TilePool& tiles, int tileRows);
+
+// Every operator new of the process is counted, the alloc stage reads the counter.
+// All the replaceable forms go through the two helpers below, so plain, array, sized,
+// nothrow and aligned allocations are all seen and each delete frees what its new got;
+// the helpers stay out of line, or the compiler pairs an inlined free() with operator new.
+static std::atomic<int64_t> heapAllocations{0};
+
+[[gnu::noinline]] static void* countedAlloc(size_t size, size_t align) noexcept {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return std::malloc(size);
+    }
+    void* p = nullptr;
+    return ::posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+[[gnu::noinline]] static void countedFree(void* p) noexcept {
+    std::free(p);
+}
+
+static void* countedNew(size_t size, size_t align) {
+    if (void* p = countedAlloc(size, align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+    return countedNew(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return countedNew(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    return countedNew(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return countedNew(size, static_cast<size_t>(align));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return countedAlloc(size, static_cast<size_t>(align));
+}
+
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+static const int QUEUE_DEPTH = 100;   ///< Same depth as the default --encode-queue
+static const int WRITE_BATCH = 16;    ///< Same batch as the default --write-batch
+
+/**
+ * @struct BenchOptions
+ * @brief Cases to run, parsed from the command line.
+ */
+struct BenchOptions {
+    std::chrono::milliseconds duration{1000};
+    std::vector<cv::Size> sizes;
+    std::vector<int> threads;
+    std::string stage = "all";
+    std::string dir = "../out/bench";
+};
+
+/**
+ * @brief Prints one result row; ms/frame is the time one thread spends on a frame.
+ */
+static void report(const char* stage, const std::string& variant, const std::string& size, int threads,
+                   int64_t frames, double seconds) {
+    double fps = seconds > 0 ? frames / seconds : 0.0;
+    double msPerFrame = fps > 0 ? 1000.0 * threads / fps : 0.0;
+    std::printf("%-9s %-28s %-10s %7d %12.1f %10.3f\n", stage, variant.c_str(), size.c_str(), threads, fps, msPerFrame);
+    std::fflush(stdout);
+}
+
+static std::string sizeName(const cv::Size& size) {
+    return std::to_string(size.width) + "x" + std::to_string(size.height);
+}
+
+/**
+ * @brief Runs body(thread, iteration) on n threads for the given time.
+ *
+ * @param seconds Receives the measured wall time, up to the end of the last iteration.
+ * @return Iterations completed by all threads.
+ */
+template <typename Body>
+static int64_t runFor(int n, std::chrono::milliseconds duration, Body body, double& seconds) {
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> done{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < n; ++t) {
+        workers.emplace_back([&, t] {
+            int64_t i = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                body(t, i++);
+            }
+            done.fetch_add(i, std::memory_order_relaxed);
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& w : workers) {
+        w.join();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return done.load();
+}
+
+/**
+ * @brief generateRandomImage variants: randu and fast on n independent producers, fast split over an n-thread tile pool.
+ */
+static void benchGenerate(const BenchOptions& opt) {
+    for (const cv::Size& size : opt.sizes) {
+        for (int n : opt.threads) {
+            std::vector<cv::Mat> frames(n);
+            for (cv::Mat& m : frames) {
+                m.create(size, CV_8UC3);
+            }
+            double seconds = 0;
+            int64_t count = runFor(n, opt.duration, [&](int t, int64_t) { generateRandomImage(frames[t]); }, seconds);
+            report("generate", "randu", sizeName(size), n, count, seconds);
+            count = runFor(n, opt.duration, [&](int t, int64_t i) {
+                generateRandomImage(frames[t], 0, static_cast<int>(i));
+            }, seconds);
+            report("generate", std::string("fast ") + fastrandom::isaName(), sizeName(size), n, count, seconds);
+            if (n > 1) {
+                TilePool pool(n);
+                count = runFor(1, opt.duration, [&](int, int64_t i) {
+                    generateRandomImage(frames[0], 0, static_cast<int>(i), pool, 64);
+                }, seconds);
+                report("generate", "fast tiles", sizeName(size), n, count, seconds);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Moves empty frames from p producers to c consumers, so only the queue itself is measured.
+ */
+static void benchQueueCase(const std::string& type, int producers, int consumers, std::chrono::milliseconds duration) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    FrameQueue* q;
+    if (type == "steal") {
+        q = new StealQueue(QUEUE_DEPTH, consumers);
+    } else if (type == "ring") {
+        q = new RingQueue(QUEUE_DEPTH);
+    } else {
+        SafetyQueue* sq = new SafetyQueue();
+        sq->maxSize = QUEUE_DEPTH;
+        sq->queueMutex = &mutex;
+        sq->queueCond = &cond;
+        q = sq;
+    }
+    // Block so every frame is delivered, the rate is what consumers can drain
+    q->policy = OverflowPolicy::Block;
+    q->blockTimeout = std::chrono::milliseconds(1000);
+
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> popped{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            StealQueue::bindWorker(c);
+            img_data item;
+            int64_t n = 0;
+            while (q->waitPop(item)) {
+                ++n;
+            }
+            popped.fetch_add(n, std::memory_order_relaxed);
+        });
+    }
+    std::vector<std::thread> pushers;
+    for (int p = 0; p < producers; ++p) {
+        pushers.emplace_back([&, p] {
+            img_data frame;
+            frame.id = p;
+            while (!stop.load(std::memory_order_relaxed)) {
+                q->push(frame);
+            }
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& t : pushers) {
+        t.join();
+    }
+    q->close();
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report("queue", type + " " + std::to_string(producers) + "p/" + std::to_string(consumers) + "c", "-",
+           producers + consumers, popped.load(), seconds);
+    delete q;
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+}
+
+/**
+ * @brief Stress test of the sleep/wake handshake: one frame at a time against parked consumers.
+ *
+ * The producer pushes a frame only once the previous one was popped, after a short random
+ * pause so the consumers are somewhere between their last empty tryPop and the futex wait.
+ * Nothing else would wake a consumer that missed the push, so a frame still queued after a
+ * second is a lost wake-up; it is reported and the case goes on after the close wakes everyone.
+ *
+ * @return Number of lost wake-ups.
+ */
+static int benchWakeupCase(const std::string& type, int consumers, std::chrono::milliseconds duration) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    FrameQueue* q;
+    if (type == "steal") {
+        q = new StealQueue(QUEUE_DEPTH, consumers);
+    } else if (type == "ring") {
+        q = new RingQueue(QUEUE_DEPTH);
+    } else {
+        SafetyQueue* sq = new SafetyQueue();
+        sq->maxSize = QUEUE_DEPTH;
+        sq->queueMutex = &mutex;
+        sq->queueCond = &cond;
+        q = sq;
+    }
+
+    std::atomic<int64_t> popped{0};
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            StealQueue::bindWorker(c);
+            img_data item;
+            while (q->waitPop(item)) {
+                popped.fetch_add(1, std::memory_order_release);
+            }
+        });
+    }
+    int lost = 0;
+    int64_t pushed = 0;
+    uint32_t rng = 12345;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration && lost == 0) {
+        img_data frame;
+        frame.id = static_cast<int>(pushed);
+        q->push(frame);
+        pushed++;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (popped.load(std::memory_order_acquire) < pushed) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                std::cerr << "Queue " << type << ": frame " << pushed << " still queued after 1 s with "
+                          << consumers << " consumers, lost wake-up" << std::endl;
+                lost++;
+                break;
+            }
+            std::this_thread::yield();
+        }
+        rng = rng * 1664525u + 1013904223u;
+        std::this_thread::sleep_for(std::chrono::microseconds(rng >> 26));  // 0-63 us
+    }
+    q->close();
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report("queue", type + " wakeup 1p/" + std::to_string(consumers) + "c", "-", 1 + consumers, popped.load(), seconds);
+    delete q;
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+    return lost;
+}
+
+/**
+ * @brief Stress test of the block policy wake-up: two producers parked on a full queue.
+ *
+ * Each round fills the queue, lets two producers block on it and then pops two frames a
+ * moment apart. Both slots should go to the parked producers at once; a push that only
+ * gets in on its blockTimeout means a freed slot woke nobody, and counts as lost.
+ *
+ * @return Number of lost wake-ups.
+ */
+static int benchSpaceWakeupCase(const std::string& type, std::chrono::milliseconds duration) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    FrameQueue* q;
+    if (type == "steal") {
+        q = new StealQueue(QUEUE_DEPTH, 1);
+    } else if (type == "ring") {
+        q = new RingQueue(QUEUE_DEPTH);
+    } else {
+        SafetyQueue* sq = new SafetyQueue();
+        sq->maxSize = QUEUE_DEPTH;
+        sq->queueMutex = &mutex;
+        sq->queueCond = &cond;
+        q = sq;
+    }
+    q->policy = OverflowPolicy::Block;
+    q->blockTimeout = std::chrono::milliseconds(1000);
+
+    int lost = 0;
+    int64_t rounds = 0;
+    img_data frame;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration && lost == 0) {
+        while (q->tryPush(frame)) {
+        }
+        int64_t blocked = q->stats.blockedPushes.load();
+        auto roundStart = std::chrono::steady_clock::now();
+        std::thread first([&] { q->push(frame); });
+        std::thread second([&] { q->push(frame); });
+        while (q->stats.blockedPushes.load() < blocked + 2) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));  // Let both reach the wait
+        img_data item;
+        q->tryPop(item);
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        q->tryPop(item);
+        first.join();
+        second.join();
+        if (std::chrono::steady_clock::now() - roundStart >= q->blockTimeout / 2) {
+            std::cerr << "Queue " << type << ": a blocked producer of round " << rounds
+                      << " waited out its timeout, lost wake-up" << std::endl;
+            lost++;
+        }
+        while (q->tryPop(item)) {
+        }
+        rounds++;
+    }
+    q->close();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report("queue", type + " block wakeup 2p/1c", "-", 3, rounds * 2, seconds);
+    delete q;
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+    return lost;
+}
+
+/**
+ * @return Number of lost wake-ups of the stress cases.
+ */
+static int benchQueue(const BenchOptions& opt) {
+    int lost = 0;
+    for (const char* type : { "mutex", "ring", "steal" }) {
+        for (int producers : { 1, 2 }) {
+            for (int consumers : opt.threads) {
+                benchQueueCase(type, producers, consumers, opt.duration);
+            }
+        }
+        for (int consumers : opt.threads) {
+            lost += benchWakeupCase(type, consumers, opt.duration);
+        }
+        lost += benchSpaceWakeupCase(type, opt.duration);
+    }
+    return lost;
+}
+
+/**
+ * @struct EncodeCase
+ * @brief One encoder backend and setting.
+ */
+struct EncodeCase {
+    std::string name;
+    FrameEncoder* encoder;
+    EncodeSettings settings;
+};
+
+static EncodeSettings jpegSettings(int quality, int subsampling) {
+    EncodeSettings settings;
+    settings.quality = quality;
+    settings.subsampling = subsampling;
+    return settings;
+}
+
+static EncodeSettings pngSettings(int level) {
+    EncodeSettings settings;
+    settings.pngLevel = level;
+    return settings;
+}
+
+/**
+ * @brief Every encoder backend per format and quality, each thread encoding its own random frame.
+ */
+static void benchEncode(const BenchOptions& opt) {
+    std::vector<std::unique_ptr<FrameEncoder>> encoders;
+    auto keep = [&](FrameEncoder* encoder) {
+        encoders.emplace_back(encoder);
+        return encoder;
+    };
+    FrameEncoder* jpg = keep(new OpenCvEncoder(".jpg"));
+    FrameEncoder* png = keep(new OpenCvEncoder(".png"));
+    std::vector<EncodeCase> cases = {
+        { "opencv jpg q95 (default)", jpg, jpegSettings(95, 420) },
+        { "opencv jpg q75", jpg, jpegSettings(75, 420) },
+        { "opencv jpg q50", jpg, jpegSettings(50, 420) },
+        { "opencv png level 1 (default)", png, pngSettings(1) },
+        { "opencv png level 3", png, pngSettings(3) },
+        { "opencv bmp", keep(new OpenCvEncoder(".bmp")), EncodeSettings() },
+        { "opencv tiff", keep(new OpenCvEncoder(".tiff")), EncodeSettings() },
+        { "raw", keep(new RawEncoder()), EncodeSettings() },
+    };
+#ifdef HAVE_TURBOJPEG
+    FrameEncoder* turbo = keep(new TurboJpegEncoder());
+    cases.push_back({ "turbojpeg q95 420", turbo, jpegSettings(95, 420) });
+    cases.push_back({ "turbojpeg q95 444", turbo, jpegSettings(95, 444) });
+    cases.push_back({ "turbojpeg q75 420", turbo, jpegSettings(75, 420) });
+#endif
+#ifdef HAVE_NVJPEG
+    NvJpegEncoder* gpu = new NvJpegEncoder();
+    keep(gpu);
+    if (gpu->available()) {
+        cases.push_back({ "nvjpeg q95 420", gpu, jpegSettings(95, 420) });
+        cases.push_back({ "nvjpeg q75 420", gpu, jpegSettings(75, 420) });
+    }
+#endif
+    for (const cv::Size& size : opt.sizes) {
+        int maxThreads = 1;
+        for (int n : opt.threads) {
+            maxThreads = std::max(maxThreads, n);
+        }
+        std::vector<cv::Mat> frames(maxThreads);
+        for (int t = 0; t < maxThreads; ++t) {
+            frames[t].create(size, CV_8UC3);
+            generateRandomImage(frames[t], 0, t);
+        }
+        for (const EncodeCase& c : cases) {
+            for (int n : opt.threads) {
+                std::vector<std::vector<uchar>> buffers(n);
+                double seconds = 0;
+                int64_t count = runFor(n, opt.duration, [&](int t, int64_t) {
+                    c.encoder->encode(frames[t], buffers[t], c.settings);
+                }, seconds);
+                report("encode", c.name, sizeName(size), n, count, seconds);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Creates a private bench.XXXXXX directory under --dir, so cleaning up never touches
+ * what was already there.
+ *
+ * @return Its path, empty if it cannot be created (the reason is printed).
+ */
+static std::string makeScratchDir(const std::string& parent) {
+    std::error_code ec;
+    std::filesystem::create_directories(parent, ec);
+    if (ec) {
+        std::cerr << "Cannot create " << parent << ": " << ec.message() << std::endl;
+        return "";
+    }
+    std::string path = parent + "/bench.XXXXXX";
+    if (::mkdtemp(&path[0]) == nullptr) {
+        std::cerr << "Cannot create a scratch directory in " << parent << ": " << std::strerror(errno) << std::endl;
+        return "";
+    }
+    return path;
+}
+
+/**
+ * @brief Removes what a writer case left in the scratch directory.
+ */
+static void clearDir(const std::string& dir) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::filesystem::remove(entry.path(), ec);
+    }
+}
+
+/**
+ * @brief Every writer backend persisting batches of the same encoded JPEG under new frame ids.
+ */
+static void benchWrite(const BenchOptions& opt) {
+    const std::string dir = makeScratchDir(opt.dir);
+    if (dir.empty()) {
+        return;
+    }
+    std::vector<std::string> backends = { "file", "container" };
+#ifdef HAVE_LIBURING
+    backends.push_back("uring");
+#endif
+    for (const cv::Size& size : opt.sizes) {
+        cv::Mat frame(size, CV_8UC3);
+        generateRandomImage(frame, 0, 0);
+        std::vector<uchar> bytes;
+        cv::imencode(".jpg", frame, bytes);
+        for (const std::string& backend : backends) {
+            for (int n : opt.threads) {
+                clearDir(dir);
+                FrameSink* sink;
+                if (backend == "container") {
+                    sink = new ContainerSink(dir, "jpg", 1024ULL << 20);
+                }
+#ifdef HAVE_LIBURING
+                else if (backend == "uring") {
+                    sink = new UringSink(dir, "jpg", WRITE_BATCH, bytes.size(), false);
+                }
+#endif
+                else {
+                    sink = new FileSink(dir, "jpg");
+                }
+                std::atomic<int> nextId{0};
+                std::vector<std::vector<encoded_frame>> batches(n, std::vector<encoded_frame>(WRITE_BATCH));
+                for (auto& batch : batches) {
+                    for (encoded_frame& f : batch) {
+                        f.bytes = bytes;
+                    }
+                }
+                double seconds = 0;
+                int64_t count = runFor(n, opt.duration, [&](int t, int64_t) {
+                    bool ok[WRITE_BATCH];
+                    for (encoded_frame& f : batches[t]) {
+                        f.id = nextId.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    sink->writeBatch(batches[t].data(), WRITE_BATCH, ok);
+                }, seconds);
+                delete sink;
+                char variant[64];
+                std::snprintf(variant, sizeof(variant), "%s %.0f KB", backend.c_str(), bytes.size() / 1024.0);
+                report("write", variant, sizeName(size), n, count * WRITE_BATCH, seconds);
+            }
+        }
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+/**
+ * @brief Heap allocations per frame of the steady-state path, one case per encoder backend.
+ *
+ * A single thread runs every stage of a --content random frame in turn: frame pool, fast
+ * generator, ring queue, encode into a pooled buffer, encoded channel, a file sink batch and
+ * the buffer back to its pool. After a warm-up that creates per-thread codec state, the
+ * raw and turbojpeg paths should report 0. The opencv path keeps its imencode parameters
+ * per thread, but cv::imencode itself still allocates on every call: it creates a new codec
+ * instance from the registered one and the JPEG codec a staging buffer for memory output,
+ * neither of which the API lets a caller keep. libjpeg's own pools use malloc and are not
+ * counted.
+ */
+static void benchAlloc(const BenchOptions& opt) {
+    const std::string dir = makeScratchDir(opt.dir);
+    if (dir.empty()) {
+        return;
+    }
+    std::vector<std::unique_ptr<FrameEncoder>> encoders;
+    std::vector<EncodeCase> cases;
+    encoders.emplace_back(new RawEncoder());
+    cases.push_back({ "raw", encoders.back().get(), EncodeSettings() });
+    encoders.emplace_back(new OpenCvEncoder(".jpg"));
+    cases.push_back({ "opencv jpg", encoders.back().get(), jpegSettings(95, 420) });
+#ifdef HAVE_TURBOJPEG
+    encoders.emplace_back(new TurboJpegEncoder());
+    cases.push_back({ "turbojpeg", encoders.back().get(), jpegSettings(95, 420) });
+#endif
+    const int warmup = 2;
+    for (const cv::Size& size : opt.sizes) {
+        for (const EncodeCase& c : cases) {
+            clearDir(dir);
+            FramePool frames(4, size.width, size.height, CV_8UC3);
+            BufferPool buffers(2 * WRITE_BATCH, static_cast<size_t>(size.width) * size.height * 3 + (1 << 20));
+            RingQueue queue(QUEUE_DEPTH);
+            queue.policy = OverflowPolicy::Block;
+            Channel<encoded_frame> channel(WRITE_BATCH);
+            FileSink sink(dir, c.encoder->name());
+            std::vector<encoded_frame> batch(WRITE_BATCH);
+            bool ok[WRITE_BATCH];
+            int nextId = 0;
+            auto runBatch = [&] {
+                for (int i = 0; i < WRITE_BATCH; ++i) {
+                    img_data frame;
+                    if (!frames.acquire(frame)) {
+                        continue;
+                    }
+                    frame.id = nextId++;
+                    generateRandomImage(frame.img, 0, frame.id);
+                    queue.push(frame);
+                    img_data item;
+                    queue.tryPop(item);
+                    encoded_frame out;
+                    buffers.acquire(out.bytes);
+                    out.id = item.id;
+                    c.encoder->encode(item.img, out.bytes, c.settings);
+                    releaseFrame(item);
+                    channel.push(std::move(out));
+                }
+                int n = 0;
+                while (n < WRITE_BATCH && channel.tryPop(batch[n])) {
+                    n++;
+                }
+                sink.writeBatch(batch.data(), n, ok);
+                for (int i = 0; i < n; ++i) {
+                    buffers.release(batch[i].bytes);
+                }
+            };
+            for (int i = 0; i < warmup; ++i) {
+                runBatch();
+            }
+            const int64_t before = heapAllocations.load();
+            const int startId = nextId;
+            auto start = std::chrono::steady_clock::now();
+            auto end = start + opt.duration;
+            while (std::chrono::steady_clock::now() < end) {
+                runBatch();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const int64_t allocations = heapAllocations.load() - before;
+            const int count = nextId - startId;
+            char variant[64];
+            std::snprintf(variant, sizeof(variant), "%s %.2f allocs/frame", c.name.c_str(),
+                          count > 0 ? static_cast<double>(allocations) / count : 0.0);
+            report("alloc", variant, sizeName(size), 1, count, seconds);
+        }
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+/**
+ * @brief Polls Pipeline::stats() from a second thread while a pipeline runs, is stopped and
+ * is torn down in wait(), as a service embedding it would.
+ *
+ * The pipeline runs --content random at the first size for the case duration; its own report
+ * is muted. The counters must never go backwards and polls after wait() must still see the
+ * frames saved. fps is polls per second.
+ *
+ * @return 1 if the pipeline did not start or a sample was inconsistent.
+ */
+static int benchPipeline(const BenchOptions& opt) {
+    const std::string dir = makeScratchDir(opt.dir);
+    if (dir.empty()) {
+        return 1;
+    }
+    Requirements req;
+    req.imageWidth = opt.sizes[0].width;
+    req.imageHeight = opt.sizes[0].height;
+    req.frames = 30;
+    req.duration_minutes = 1;
+    req.num_threads = 1;
+    req.content = "random";
+    req.output_dir = dir;
+    req.sync_ms = 0;
+    req.log_level = "quiet";
+
+    std::streambuf* console = std::cout.rdbuf(nullptr);  // The pipeline prints its setup and report there
+    int failures = 0;
+    int64_t polls = 0;
+    double seconds = 0;
+    {
+        Pipeline pipeline(req);
+        if (pipeline.start()) {
+            std::atomic<bool> quit{false};
+            StatsSample last;
+            std::thread poller([&] {
+                while (!quit.load(std::memory_order_relaxed)) {
+                    StatsSample sample = pipeline.stats();
+                    if (sample.generated < last.generated || sample.saved < last.saved) {
+                        failures = 1;
+                    }
+                    last = sample;
+                    polls++;
+                }
+            });
+            auto start = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(opt.duration);
+            pipeline.stop();
+            pipeline.wait();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));  // A few polls after the teardown
+            quit.store(true, std::memory_order_relaxed);
+            poller.join();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (last.saved == 0) {
+                failures = 1;
+            }
+        } else {
+            failures = 1;
+        }
+    }
+    std::cout.rdbuf(console);
+    std::cout.clear();
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    if (failures > 0) {
+        std::cerr << "Pipeline: stats() went backwards, saw no saved frame after wait() or the run did not start" << std::endl;
+    }
+    report("pipeline", "stats() polled through wait()", sizeName(opt.sizes[0]), 2, polls, seconds);
+    return failures;
+}
+
+/**
+ * @brief Generic and fixed-profile kernels (generate, hash, halve) on one thread, with the speedup.
+ *
+ * Sizes without a fixed profile are skipped. The two generated frames and their hashes are
+ * compared, a fixed kernel that disagrees with the generic one is an error.
+ */
+static void benchKernels(const BenchOptions& opt) {
+    using framekernels::FrameKernels;
+    const FrameKernels& generic = framekernels::genericKernels();
+    for (const cv::Size& size : opt.sizes) {
+        const FrameKernels& fixed = framekernels::selectFrameKernels(size.width, size.height, CV_8UC3, true);
+        if (&fixed == &generic) {
+            continue;
+        }
+        FramePool pool(2, size.width, size.height, CV_8UC3, -1, fixed.bufferAlign);
+        img_data a, b;
+        pool.acquire(a);
+        pool.acquire(b);
+        const fastrandom::Key key = fastrandom::frameKey(0, 1);
+        generic.generate(a.img, key);
+        fixed.generate(b.img, key);
+        if (std::memcmp(a.img.data, b.img.data, a.img.total() * a.img.elemSize()) != 0 ||
+            generic.hash(a.img) != fixed.hash(b.img)) {
+            std::cerr << "Fixed kernels of " << sizeName(size) << " differ from the generic ones" << std::endl;
+        }
+        cv::Mat half;
+        struct Case {
+            const char* name;
+            std::function<void(const FrameKernels&, int64_t)> body;
+        };
+        const Case cases[] = {
+            { "generate", [&](const FrameKernels& k, int64_t i) {
+                k.generate(a.img, fastrandom::frameKey(0, static_cast<uint64_t>(i)));
+            } },
+            { "hash", [&](const FrameKernels& k, int64_t) { k.hash(a.img); } },
+            { "halve", [&](const FrameKernels& k, int64_t) { k.halve(a.img, half); } },
+        };
+        for (const Case& c : cases) {
+            double genericSeconds = 0, fixedSeconds = 0;
+            int64_t genericCount = runFor(1, opt.duration, [&](int, int64_t i) { c.body(generic, i); }, genericSeconds);
+            int64_t fixedCount = runFor(1, opt.duration, [&](int, int64_t i) { c.body(fixed, i); }, fixedSeconds);
+            report("kernels", std::string(c.name) + " generic", sizeName(size), 1, genericCount, genericSeconds);
+            double speedup = genericCount > 0 && fixedSeconds > 0
+                ? (fixedCount / fixedSeconds) / (genericCount / genericSeconds) : 0.0;
+            char variant[64];
+            std::snprintf(variant, sizeof(variant), "%s fixed %.2fx", c.name, speedup);
+            report("kernels", variant, sizeName(size), 1, fixedCount, fixedSeconds);
+        }
+        releaseFrame(a);
+        releaseFrame(b);
+    }
+}
+
+/**
+ * @brief Parses a list of sizes such as "1920x1280,3840x2160".
+ */
+static bool parseSizes(const std::string& text, std::vector<cv::Size>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        int w = 0, h = 0;
+        char extra;
+        if (std::sscanf(text.substr(pos, end - pos).c_str(), "%dx%d %c", &w, &h, &extra) != 2 || w <= 0 || h <= 0) {
+            return false;
+        }
+        out.emplace_back(w, h);
+        pos = end + 1;
+    }
+    return !out.empty();
+}
+
+int main(int argc, char *argv[]) {
+    argparse::ArgumentParser program("bench");
+
+    program.add_argument("--stage")
+        .help("Set the stage to benchmark, all, generate, queue, encode, write, alloc, kernels or pipeline")
+        .default_value(std::string("all"));
+
+    program.add_argument("--sizes")
+        .help("Set the resolutions, e.g. 1920x1280,3840x2160")
+        .default_value(std::string("640x480,1920x1280,3840x2160"));
+
+    program.add_argument("--threads")
+        .help("Set the thread counts, e.g. 1,2,4")
+        .default_value(std::string("1,2,4"));
+
+    program.add_argument("--case-ms")
+        .help("Set the duration of every case in milliseconds")
+        .default_value(1000)
+        .scan<'i', int>();
+
+    program.add_argument("--dir")
+        .help("Set the directory the write and alloc stages create their private scratch directory in")
+        .default_value(std::string("../out/bench"));
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    BenchOptions opt;
+    opt.stage = program.get<std::string>("--stage");
+    opt.dir = program.get<std::string>("--dir");
+    int caseMs = program.get<int>("--case-ms");
+    if (caseMs < 1) {
+        std::cerr << "Case duration must be at least 1 ms" << std::endl;
+        return 1;
+    }
+    opt.duration = std::chrono::milliseconds(caseMs);
+    if (!parseSizes(program.get<std::string>("--sizes"), opt.sizes)) {
+        std::cerr << "Invalid size list, expected e.g. 1920x1280,3840x2160" << std::endl;
+        return 1;
+    }
+    // Thread counts are small positive numbers, parseCpuList accepts the same syntax
+    if (!parseCpuList(program.get<std::string>("--threads"), opt.threads) ||
+        std::find(opt.threads.begin(), opt.threads.end(), 0) != opt.threads.end()) {
+        std::cerr << "Invalid thread list, expected e.g. 1,2,4" << std::endl;
+        return 1;
+    }
+    if (opt.stage != "all" && opt.stage != "generate" && opt.stage != "queue" && opt.stage != "encode" && opt.stage != "write" &&
+        opt.stage != "alloc" && opt.stage != "kernels" && opt.stage != "pipeline") {
+        std::cerr << "Invalid stage: " << opt.stage << std::endl;
+        return 1;
+    }
+
+    Logger::instance().setLevel(LogLevel::Quiet);
+    std::printf("%-9s %-28s %-10s %7s %12s %10s\n", "stage", "variant", "size", "threads", "fps", "ms/frame");
+    if (opt.stage == "all" || opt.stage == "generate") {
+        benchGenerate(opt);
+    }
+    int failures = 0;
+    if (opt.stage == "all" || opt.stage == "queue") {
+        failures += benchQueue(opt);
+    }
+    if (opt.stage == "all" || opt.stage == "encode") {
+        benchEncode(opt);
+    }
+    if (opt.stage == "all" || opt.stage == "write") {
+        benchWrite(opt);
+    }
+    if (opt.stage == "all" || opt.stage == "alloc") {
+        benchAlloc(opt);
+    }
+    if (opt.stage == "all" || opt.stage == "kernels") {
+        benchKernels(opt);
+    }
+    if (opt.stage == "all" || opt.stage == "pipeline") {
+        failures += benchPipeline(opt);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -13,43 +13,55 @@
  * @file generator.cpp
  * @brief Simulates a camera by generating and saving random images at a fixed frame rate.
  * 
- * This module creates a producer thread that generates images at a specified FPS for a
- * given duration and multiple consumer threads that save these images to disk.
+ * This module creates a producer thread per camera stream that generates images at the
+ * stream's FPS for a given duration and multiple consumer threads that save these images
+ * to disk.
  */
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
 #include <pthread.h>
 #include "modules/SafetyQueue.h"
+#include "modules/RingQueue.h"
+#include "modules/StealQueue.h"
+#include "modules/FramePool.h"
+#include "modules/FrameScheduler.h"
+#include "modules/FastRandom.h"
+#include "modules/TilePool.h"
+#include "modules/Logger.h"
+#include "modules/Channel.h"
+#include "modules/FrameSink.h"
+#include "modules/UringSink.h"
+#include "modules/ContainerSink.h"
+#include "modules/StreamMux.h"
+#include "modules/Affinity.h"
+#include "modules/LatencyHistogram.h"
+#include "modules/StatsReporter.h"
+#include "modules/FrameEncoder.h"
+#include "modules/BufferPool.h"
+#include "modules/FrameJournal.h"
+#include "modules/RawSink.h"
+#include "modules/FrameDedup.h"
+#include "modules/FrameKernels.h"
+#include "modules/CoroRuntime.h"
+#include "modules/WritePacer.h"
 #include <chrono>
 #include <thread>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 #include "./modules.h"
 
-static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
-static bool producerDone = false;
-static bool timedOut = false;
-static std::atomic<int> savedFrames{0};
-static std::atomic<float> generationTime{0};
-static std::atomic<float> saveTime{0};
-static std::atomic<float> qTime{0};
-static std::atomic<int> qCounter{0};
-SafetyQueue q;
 using namespace std;
 
-/**
- * @struct Requirements
- * @brief Configuration parameters for image generation and processing.
- */
-struct Requirements {
-    int imageWidth;
-    int imageHeight;
-    int frames;
-    int num_threads;
-    int duration_minutes;
-    std::string image_format;
-};
+struct PipelineState;
 
 /**
  * @struct Consumer_Args
@@ -58,6 +70,132 @@ struct Requirements {
 struct Consumer_Args {
     int thread_id;
     Requirements* req;
+    PipelineState* pipeline;
+    int frames = 0;      ///< Frames handled by the thread, read after join
+    double busyMs = 0;   ///< Time spent encoding or writing
+    double wallMs = 0;   ///< Lifetime of the thread
+};
+
+/**
+ * @struct Stream
+ * @brief One simulated camera: its own producer settings, queue, frame pool and counters.
+ *
+ * Its frames come from one or more producer threads sharing the same schedule.
+ */
+struct Stream {
+    PipelineState* pipeline = nullptr;
+    int index = 0;
+    int cpu = -1;             ///< Core of the producer thread, -1 if unpinned
+    StreamConfig cfg;
+    Requirements* req = nullptr;
+    uint64_t seed = 0;
+    FrameQueue* q = nullptr;
+    FramePool* pool = nullptr;
+    const framekernels::FrameKernels* kernels = nullptr;  ///< Pixel loops of the stream's frame shape
+    std::vector<FramePool*> derivePools;  ///< Buffers of each scaled --derive output, null for plain crops
+    cv::Mat permanentImage;   ///< Every frame of static content
+    std::vector<cv::Mat> staticDerived;  ///< Scaled --derive outputs of the permanent image, computed once
+    pthread_mutex_t queueMutex; ///< Lock and condition of the mutex queue, one pair per stream
+    pthread_cond_t queueCond;
+    AdaptiveQuality adaptive;
+    std::vector<FrameDedup*> dedup;  ///< Duplicate detection of --dedup per derivative (0 is the frame), empty without it
+    int producers = 1;        ///< Producer threads sharing the stream's schedule
+    std::chrono::steady_clock::time_point scheduleStart;
+    int firstId = 0;          ///< First frame id of this run, past the frames a resumed run already saved
+    // Producer side and writer side counters on separate lines
+    alignas(CACHE_LINE_SIZE) std::atomic<int> nextId{0};
+    std::atomic<int> activeProducers{0};
+    std::atomic<int> generatedFrames{0};
+    std::atomic<int64_t> generationNs{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int> savedFrames{0};
+};
+
+/**
+ * @struct Producer_Args
+ * @brief Arguments passed to each producer thread.
+ */
+struct Producer_Args {
+    Stream* stream;
+    int index;           ///< Position of the producer among the stream's producers
+};
+
+/**
+ * @struct RampStep
+ * @brief One rate of the --max ramp: every stream runs at scale times its fps from start on.
+ */
+struct RampStep {
+    double scale = 1.0;
+    std::chrono::steady_clock::time_point start;
+};
+
+static const int MAX_RAMP_STEPS = 256;
+
+/**
+ * @struct PipelineState
+ * @brief Everything one Pipeline owns: its streams and stages, its sinks and its counters.
+ *
+ * Nothing is shared between two pipelines of a process but the logger. Counters that
+ * different stages update per frame sit on cache lines of their own.
+ */
+struct PipelineState {
+    Requirements* req = nullptr;
+    pthread_mutex_t queueMutex;          ///< Guards producerDone, timedOut and stopped
+    bool producerDone = false;
+    bool timedOut = false;
+    bool stopped = false;                ///< Pipeline::stop() ended the run before its schedule
+    std::vector<Stream*> streams;
+    StreamMux* mux = nullptr;
+    TilePool* tilePool = nullptr;
+    Channel<encoded_frame>* encodedQueue = nullptr;
+    FrameSink* sink = nullptr;
+    WritePacer* pacer = nullptr;         ///< --flush-mb and --write-rate, null without either
+    RawSink* rawOutput = nullptr;        ///< --output raw, the sink itself; producers fill its slots
+    FrameJournal* journal = nullptr;     ///< Write-ahead index of the saved frames, null with --sync-ms 0
+    FrameEncoder* frameEncoder = nullptr;
+    BufferPool* encodeBuffers = nullptr; ///< Output buffers of the encoders, returned after the write
+    EncodeSettings encodeSettings;       ///< --quality, --subsampling and --png-level
+    coro::Executor* executor = nullptr;  ///< Runs every stage under --runtime coro
+    coro::AsyncEvent* framesQueued = nullptr;  ///< Wakes the encode coroutines after a push or a close
+    coro::AsyncChannel<img_data>* deriveQueue = nullptr;  ///< Frames waiting for the transform stage (coro with --derive)
+    coro::AsyncChannel<encoded_frame>* encodedChannel = nullptr;  ///< The coroutines' encodedQueue
+    LatencyRecorder latency;
+    RampStep rampSteps[MAX_RAMP_STEPS];
+
+    alignas(CACHE_LINE_SIZE) std::atomic<int> savedFrames{0};
+    std::atomic<int> savedDerivatives{0};  ///< --derive outputs saved, not part of savedFrames
+    std::atomic<int> droppedDerivatives{0};  ///< --derive outputs that found their queue full
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> encoderBusyNs{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> writerBusyNs{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int> activeEncoders{0};
+    std::atomic<int> encoderLimit{INT_MAX};   ///< Encoders with a higher thread id stay parked (--auto-threads)
+    std::atomic<int> activeGenerators{0};     ///< Generate coroutines still running
+    std::atomic<int> activeTransforms{0};     ///< Transform coroutines still running
+    std::atomic<int> rampStep{0};             ///< Current entry of rampSteps, written before it is published
+    std::atomic<bool> rampPaused{false};      ///< Producers generate nothing while the ramp drains between steps
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> abandon{false};  ///< Past the drain deadline: consumers drop what they dequeue
+    std::atomic<int> activeConsumers{0};      ///< Encoders and writers still running
+    std::atomic<int64_t> abandonedFrames{0};  ///< Frames dropped unencoded after the drain deadline
+    std::atomic<int64_t> abandonedEncoded{0}; ///< Encoded frames dropped unwritten after the drain deadline
+
+    // Set by Pipeline::start() for wait()
+    bool started = false;
+    bool coroutines = false;
+    int numStreams = 0;
+    int numProducers = 0;
+    int numEncoders = 0;
+    int numWriters = 0;
+    int numThreads = 0;
+    Consumer_Args* args = nullptr;
+    Producer_Args* pargs = nullptr;
+    std::vector<pthread_t> threads;
+    coro::TaskGroup tasks;
+    StatsReporter* stats = nullptr;
+    std::mutex statsMutex;          ///< Keeps Pipeline::stats() out of the teardown of the stages
+    bool sampling = false;          ///< The stages are up, stats() samples them
+    StatsSample finalStats;         ///< What stats() returns once the stages are released
+    int pinnedBuffers = 0;
+    std::chrono::steady_clock::time_point startedAt;
+    std::chrono::steady_clock::time_point drainStart;  ///< When the last producer finished
 };
 
 
@@ -75,194 +213,1998 @@ cv::Mat generateRandomImage(int w, int h) {
 }
 
 /**
- * @brief Producer thread function that generates images at a fixed FPS.
+ * @brief Fills an already allocated image (e.g. a pool buffer) with random pixels in place.
+ *
+ * @param dst Destination image, its size and type are kept.
+ */
+void generateRandomImage(cv::Mat& dst) {
+    cv::randu(dst, cv::Scalar::all(0), cv::Scalar::all(255));
+}
+
+/**
+ * @brief Fills an image in place with the vectorized counter-based generator.
+ *
+ * The pixels only depend on the seed and the frame id, so every frame is unique and a run
+ * can be reproduced exactly.
+ *
+ * @param dst Destination image, its size and type are kept.
+ * @param seed Run seed.
+ * @param frame_id Frame identifier.
+ */
+void generateRandomImage(cv::Mat& dst, uint64_t seed, int frame_id) {
+    framekernels::fillFrame(dst, fastrandom::frameKey(seed, static_cast<uint64_t>(frame_id)));
+}
+
+/**
+ * @struct TileJob
+ * @brief One frame being generated by the tile pool.
+ */
+struct TileJob {
+    uint8_t* data;
+    size_t bytes;
+    size_t tileBytes;
+    fastrandom::Key key;
+};
+
+static void fillTile(void* ctx, int tile) {
+    TileJob* job = static_cast<TileJob*>(ctx);
+    size_t begin = tile * job->tileBytes;
+    size_t end = std::min(begin + job->tileBytes, job->bytes);
+    fastrandom::fill(job->data + begin, end - begin, job->key, begin);
+}
+
+/**
+ * @brief Generates a frame in parallel: row tiles are filled by the persistent tile pool.
+ *
+ * Tiles are cut on 4-byte boundaries of the counter-based stream, so the result is the
+ * same as generateRandomImage(dst, seed, frame_id) whatever the tile order.
+ *
+ * @param tiles Worker pool.
+ * @param tileRows Rows per tile.
+ */
+void generateRandomImage(cv::Mat& dst, uint64_t seed, int frame_id, TilePool& tiles, int tileRows) {
+    if (!dst.isContinuous()) {
+        generateRandomImage(dst, seed, frame_id);
+        return;
+    }
+    TileJob job;
+    job.data = dst.data;
+    job.bytes = dst.total() * dst.elemSize();
+    job.tileBytes = (static_cast<size_t>(tileRows) * dst.cols * dst.elemSize() + 3) & ~static_cast<size_t>(3);
+    job.key = fastrandom::frameKey(seed, static_cast<uint64_t>(frame_id));
+    tiles.run(static_cast<int>((job.bytes + job.tileBytes - 1) / job.tileBytes), fillTile, &job);
+}
+
+/**
+ * @brief Fills a frame with the stream's random content, using the generator --generator picks.
+ *
+ * @param img Frame buffer to fill, already allocated at the stream size.
+ */
+static void generateInto(Stream* stream, cv::Mat& img, int frame_id) {
+    PipelineState* pipeline = stream->pipeline;
+    Requirements* req = stream->req;
+    if (req->generator == "randu") {
+        generateRandomImage(img);
+    } else if (pipeline->tilePool != nullptr) {
+        generateRandomImage(img, stream->seed, frame_id, *pipeline->tilePool, req->tile_rows);
+    } else {
+        stream->kernels->generate(img, fastrandom::frameKey(stream->seed, static_cast<uint64_t>(frame_id)));
+    }
+}
+
+/**
+ * @brief Builds the next frame: a pooled random image or the shared permanent image.
+ *
+ * @param stream Stream the frame belongs to.
+ * @param frame_id Identifier of the frame.
+ * @param permanentImage Image reused when content is static.
+ * @return Frame data, with an empty image if the frame pool was exhausted.
+ */
+static img_data makeFrame(Stream* stream, int frame_id, const cv::Mat& permanentImage) {
+    PipelineState* pipeline = stream->pipeline;
+    Requirements* req = stream->req;
+    FramePool* pool = stream->pool;
+    img_data data{ frame_id, cv::Mat() };
+    // Capture time; the generation time is what it takes to reach the "generated" stamp
+    data.times.capture = monotonicNs();
+    data.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    data.stream = stream->index;
+    if (pipeline->rawOutput != nullptr) {
+        // The frame is built in its slot of the mapped file, nothing is copied afterwards
+        uchar* slot = pipeline->rawOutput->file(stream->index)->frameAt(frame_id);
+        if (slot == nullptr) {
+            LOG_ERROR("[Producer {}] no raw file slot for frame {}", stream->index, frame_id + 1);
+        } else {
+            data.img = cv::Mat(stream->cfg.height, stream->cfg.width, CV_8UC3, slot);
+            if (req->content == "random") {
+                generateInto(stream, data.img, frame_id);
+            } else {
+                permanentImage.copyTo(data.img);
+            }
+        }
+    } else if (pool != nullptr) {
+        if (!pool->acquire(data)) {
+            LOG_WARN("[Producer {}] frame pool exhausted, dropping frame {}", stream->index, frame_id);
+        } else {
+            generateInto(stream, data.img, frame_id);
+        }
+    } else {
+        data.img = permanentImage;
+    }
+    data.times.generated = monotonicNs();
+    int64_t genNs = data.times.generated - data.times.capture;
+    if (!data.img.empty()) {
+        pipeline->latency.record(Stage::Generate, genNs);
+        stream->generationNs.fetch_add(genNs, std::memory_order_relaxed);
+    }
+    LOG_DEBUG("[Producer {}] frame {} generated in {} ms", stream->index, frame_id, genNs / 1e6);
+    return data;
+}
+
+/**
+ * @brief Pushes a frame to the stream's queue, wakes a consumer and records the push time.
+ *
+ * A --derive output shares its frame's queue but never evicts a queued frame, which could be
+ * the very frame it was made from: under the drop-oldest and adaptive policies it is dropped
+ * itself when the queue is full, and counted apart from the frame drops.
+ */
+static void pushFrame(Stream* stream, img_data& data) {
+    PipelineState* pipeline = stream->pipeline;
+    FrameQueue* q = stream->q;
+    const bool evicts = q->policy == OverflowPolicy::DropOldest || q->policy == OverflowPolicy::Adaptive;
+    // Push to queue (locking, if any, happens inside the queue)
+    data.times.enqueued = monotonicNs();
+    bool queued;
+    if (data.derivative > 0 && evicts) {
+        queued = q->tryPush(data);
+        if (!queued) {
+            pipeline->droppedDerivatives++;
+            LOG_DEBUG("[Producer {}] queue full, dropping derivative {} of frame {}", stream->index, data.derivative, data.id);
+            releaseFrame(data);
+        }
+    } else {
+        queued = q->push(data);
+    }
+    if (queued) {
+        if (pipeline->framesQueued != nullptr) {
+            pipeline->framesQueued->notifyOne();
+        } else {
+            pipeline->mux->notify();
+        }
+    }
+    int64_t pushNs = monotonicNs() - data.times.enqueued;
+    pipeline->latency.record(Stage::Push, pushNs);
+    LOG_DEBUG("[Producer {}] queued image {}, queue push time: {} ms, queue size = {}",
+              stream->index, data.id, pushNs / 1e6, q->size());
+}
+
+/**
+ * @brief Builds the --derive outputs of a generated frame.
+ *
+ * Plain crops are views of the frame's pooled buffer, which they retain, so they cost no
+ * copy. Scaled outputs are resized (INTER_AREA) into their own pool; with static content
+ * they were computed once per stream and are shared like the permanent image.
+ *
+ * @param out Receives the derivatives, derivative k + 1 at index k unless its pool was exhausted.
+ * @return Number of derivatives built.
+ */
+static int makeDerivatives(Stream* stream, const img_data& data, img_data* out) {
+    const std::vector<DeriveConfig>& derive = stream->req->derive;
+    int n = 0;
+    for (size_t k = 0; k < derive.size(); ++k) {
+        const DeriveConfig& cfg = derive[k];
+        img_data& d = out[n];
+        d = img_data{ data.id, cv::Mat() };
+        d.timestamp = data.timestamp;
+        d.stream = data.stream;
+        d.derivative = static_cast<int>(k) + 1;
+        d.times = data.times;
+        cv::Mat source = cfg.roiWidth > 0 ? data.img(cv::Rect(cfg.roiX, cfg.roiY, cfg.roiWidth, cfg.roiHeight))
+                                          : data.img;
+        if (cfg.width == 0) {
+            d.img = source;
+            if (data.pool != nullptr) {
+                data.pool->retain(data.slot);
+                d.pool = data.pool;
+                d.slot = data.slot;
+            }
+        } else if (data.pool == nullptr) {
+            d.img = stream->staticDerived[k];
+        } else if (!stream->derivePools[k]->acquire(d)) {
+            LOG_WARN("[Producer {}] derivative pool {} exhausted, dropping it for frame {}",
+                     stream->index, d.derivative, data.id);
+            continue;
+        } else if (cfg.roiWidth == 0 && cfg.width * 2 == data.img.cols && cfg.height * 2 == data.img.rows) {
+            stream->kernels->halve(data.img, d.img);
+        } else {
+            cv::resize(source, d.img, d.img.size(), 0, 0, cv::INTER_AREA);
+        }
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Queues a generated frame and its --derive outputs for the encoders.
+ *
+ * @param derived Scratch array of MAX_DERIVATIVES frames.
+ */
+static void publishFrame(Stream* stream, img_data& data, img_data* derived) {
+    PipelineState* pipeline = stream->pipeline;
+    // Derived before the push: once queued, the frame's buffer may already be released
+    int numDerived = 0;
+    if (!stream->req->derive.empty()) {
+        int64_t deriveStart = monotonicNs();
+        numDerived = makeDerivatives(stream, data, derived);
+        pipeline->latency.record(Stage::Derive, monotonicNs() - deriveStart);
+    }
+    pushFrame(stream, data);
+    for (int k = 0; k < numDerived; ++k) {
+        pushFrame(stream, derived[k]);
+    }
+}
+
+/**
+ * @brief Completes a frame built in its --output raw slot; it is saved once generated.
+ */
+static void commitRawFrame(Stream* stream, const img_data& data) {
+    PipelineState* pipeline = stream->pipeline;
+    pipeline->rawOutput->file(stream->index)->commit(data.id);
+    if (pipeline->journal != nullptr) {
+        pipeline->journal->append(data.id, stream->index, data.timestamp, data.img.total() * data.img.elemSize());
+    }
+    pipeline->savedFrames++;
+    stream->savedFrames++;
+    pipeline->latency.record(Stage::EndToEnd, monotonicNs() - data.times.capture);
+}
+
+/**
+ * @brief Logs a producer's jitter once its schedule is over.
+ *
+ * @return true for the stream's last producer.
+ */
+static bool finishProducer(Producer_Args* pargs, const FrameScheduler& scheduler, bool absolute) {
+    Stream* stream = pargs->stream;
+    if (absolute && stream->producers > 1) {
+        LOG_INFO("[Producer {}] Thread {} frame jitter: mean {} us, max {} us, {} late frames, {} skipped frames",
+                 stream->index, pargs->index, scheduler.getMeanJitterUs(), scheduler.getMaxJitterUs(),
+                 scheduler.getLateFrames(), scheduler.getSkippedFrames());
+    } else if (absolute) {
+        LOG_INFO("[Producer {}] Frame jitter: mean {} us, max {} us, {} late frames, {} skipped frames",
+                 stream->index, scheduler.getMeanJitterUs(), scheduler.getMaxJitterUs(),
+                 scheduler.getLateFrames(), scheduler.getSkippedFrames());
+    }
+    return stream->activeProducers.fetch_sub(1) == 1;
+}
+
+/**
+ * @brief Closes a stream's queue after its last frame; once the last stream is closed
+ * every consumer drains the queues and exits.
+ */
+static void closeStream(Stream* stream) {
+    PipelineState* pipeline = stream->pipeline;
+    pthread_mutex_lock(&pipeline->queueMutex);
+    pipeline->producerDone = true;
+    pthread_mutex_unlock(&pipeline->queueMutex);
+    pipeline->mux->close(stream->index);
+    if (pipeline->framesQueued != nullptr) {
+        pipeline->framesQueued->notifyAll();
+    }
+
+    const double fps = stream->cfg.fps;
+    double totalSeconds = std::max(stream->req->duration_minutes * 60.0 - stream->firstId / fps, 1e-9);
+    double effectiveFps = static_cast<double>(stream->nextId.load() - stream->firstId) / totalSeconds;
+    LOG_INFO("[Producer {}] Finished. Effective generation fps: {}", stream->index, effectiveFps);
+}
+
+/**
+ * @brief Producer thread function that generates the images of one stream at its FPS.
  *
  * This function runs until the specified duration elapses or a timeout flag is set.
- * It pushes generated images into a shared queue for consumers to process.
+ * It pushes generated images into the stream's queue for the shared consumers to process.
+ * With random content every frame is generated into a buffer checked out of the frame pool.
+ *
+ * The "absolute" schedule wakes up at start + n * period (see FrameScheduler), so push and
+ * logging time never accumulate; "relative" sleeps the remainder of each period after the
+ * frame is built, as the first version did.
+ * With several producers per stream, producer j of P builds every P-th frame of the same
+ * schedule, so P frames can be generated at once.
+ * Under --max the schedule restarts at every step of the ramp, at that step's rate, and the
+ * producer runs until the ramp controller ends the run; it idles while the ramp drains.
  *
  * Added debugging prints for generation time and queue size.
  *
- * @param arg Pointer to Requirements structure.
+ * @param arg Pointer to the Producer_Args structure.
  * @return nullptr upon completion.
  */
 void* producer(void* arg) {
 
-    Requirements* req = static_cast<Requirements*>(arg);
-    const double fps = req->frames;
-    const auto framePeriod = std::chrono::duration<double>(1.0 / fps);
+    Producer_Args* pargs = static_cast<Producer_Args*>(arg);
+    Stream* stream = pargs->stream;
+    PipelineState* pipeline = stream->pipeline;
+    Requirements* req = stream->req;
+    const double fps = stream->cfg.fps;
+    const auto framePeriod = std::chrono::duration<double>(stream->producers / fps);
+    const bool absolute = req->schedule == "absolute";
+    // A resumed run only emits what is left of the schedule after the frames already saved
+    const auto resumed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(stream->firstId / fps));
     auto startTime = std::chrono::high_resolution_clock::now();
-    auto endTime = startTime + std::chrono::minutes(req->duration_minutes);
+    auto endTime = startTime + std::chrono::minutes(req->duration_minutes) - resumed;
     // auto endTime = startTime + std::chrono::seconds(10); // For testing, set to 10 seconds
 
-    int frame_id = 0;
+    FrameScheduler scheduler(fps, std::chrono::microseconds(req->spin_us),
+                             req->late_policy == "skip" ? LatePolicy::Skip : LatePolicy::CatchUp,
+                             pargs->index, stream->producers);
+    auto scheduleStart = stream->scheduleStart;
+    auto scheduleEnd = scheduleStart + std::chrono::minutes(req->duration_minutes) - resumed;
+    scheduler.start(scheduleStart, scheduleEnd);
 
-    cv::Mat permanentImage = generateRandomImage(req->imageWidth, req->imageHeight);
+    int rampSeen = -1;
+    img_data derived[MAX_DERIVATIVES];
 
-    while (std::chrono::high_resolution_clock::now() < endTime) {
+    while (req->max_mode || (absolute ? scheduler.nextDeadline() < scheduleEnd
+                                      : std::chrono::high_resolution_clock::now() < endTime)) {
         auto loopStart = std::chrono::high_resolution_clock::now();
 
         // Check timeout under lock
-        pthread_mutex_lock(&queueMutex);
-        if (timedOut) {
-            pthread_mutex_unlock(&queueMutex);
+        pthread_mutex_lock(&pipeline->queueMutex);
+        if (pipeline->timedOut) {
+            pthread_mutex_unlock(&pipeline->queueMutex);
             break;
         }
-        pthread_mutex_unlock(&queueMutex);
+        pthread_mutex_unlock(&pipeline->queueMutex);
+
+        if (req->max_mode) {
+            if (pipeline->rampPaused.load(std::memory_order_acquire)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            int step = pipeline->rampStep.load(std::memory_order_acquire);
+            if (step != rampSeen) {
+                rampSeen = step;
+                scheduler = FrameScheduler(fps * pipeline->rampSteps[step].scale, std::chrono::microseconds(req->spin_us),
+                                           LatePolicy::CatchUp, pargs->index, stream->producers);
+                scheduler.start(pipeline->rampSteps[step].start);
+            }
+        }
 
-        // Time how long it takes to generate the image
-        auto genStart = std::chrono::high_resolution_clock::now();
-        cv::Mat img = permanentImage;
-        auto genEnd = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> genElapsed = genEnd - genStart;
-        generationTime = generationTime + genElapsed.count();
-        std::cout << "[Producer] frame " << frame_id;
+        if (absolute) {
+            scheduler.waitNext();
+            LOG_DEBUG("[Producer {}] woke up {} us after the frame deadline", stream->index, scheduler.getLastJitter() / 1000.0);
+        }
 
-        img_data data{ frame_id, img };
-        frame_id++;
+        img_data data = makeFrame(stream, stream->nextId.fetch_add(1), stream->permanentImage);
 
         // Measure and apply sleep if needed
-        auto frameEnd = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = frameEnd - loopStart;
-        if (elapsed < framePeriod) {
-            auto sleepTime = framePeriod - elapsed;
-            std::cout << "[Producer] sleeping for " 
-                      << std::chrono::duration<double, std::milli>(sleepTime).count()
-                      << " ms to maintain " << fps << " fps\n";
-            std::this_thread::sleep_for(sleepTime);
-        }
-
-        // Push to queue (locking moves inside SafetyQueue::push)
-        auto startQ = std::chrono::high_resolution_clock::now();
-        q.push(data);
-        auto endQ = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsedQ = endQ - startQ;
-        qTime = qTime + std::chrono::duration<double, std::milli>(elapsedQ).count();
-        qCounter++;
-        std::cout << "[Producer] queue push time: " 
-                  << std::chrono::duration<double, std::milli>(elapsedQ).count() 
-                  << " ms\n";
-
-        // Signal consumers that a new item is available
-        pthread_mutex_lock(&queueMutex);
-        size_t currentSize = q.size();
-        std::cout << "[Producer] queued image " << data.id
-                  << ", queue size = " << currentSize << "\n";
-        pthread_cond_signal(&queueCond);
-        pthread_mutex_unlock(&queueMutex);
-    }
-
-    pthread_mutex_lock(&queueMutex);
-    producerDone = true;
-    pthread_cond_broadcast(&queueCond);
-    pthread_mutex_unlock(&queueMutex);
-
-    double totalSeconds = req->duration_minutes * 60.0;
-    double effectiveFps = static_cast<double>(frame_id) / totalSeconds;
-    std::cout << "[Producer] Finished. Effective generation fps: " 
-              << effectiveFps << "\n";
+        if (!absolute) {
+            auto frameEnd = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> elapsed = frameEnd - loopStart;
+            if (elapsed < framePeriod) {
+                auto sleepTime = framePeriod - elapsed;
+                LOG_DEBUG("[Producer {}] sleeping for {} ms to maintain {} fps",
+                          stream->index, std::chrono::duration<double, std::milli>(sleepTime).count(), fps);
+                std::this_thread::sleep_for(sleepTime);
+            }
+        }
+
+        if (data.img.empty()) {
+            continue;
+        }
+
+        stream->generatedFrames++;
+        if (pipeline->rawOutput != nullptr) {
+            commitRawFrame(stream, data);
+            continue;
+        }
+        publishFrame(stream, data, derived);
+    }
+
+    if (finishProducer(pargs, scheduler, absolute)) {
+        closeStream(stream);
+    }
     return nullptr;
 }
 
 /**
- * @brief Consumer thread function that saves images from the queue to disk.
+ * @brief Encoder settings for the current adaptive quality level.
  *
- * Each consumer waits for images to become available, then writes them to jpg files.
+ * Level 1 trades JPEG quality / PNG compression effort for speed, level 2 additionally
+ * halves the frame size (applied by the caller). Settings already below a level are kept.
+ */
+static EncodeSettings adaptiveSettings(const EncodeSettings& base, int level) {
+    EncodeSettings settings = base;
+    if (level >= 1) {
+        settings.quality = std::min(settings.quality, level == 1 ? 75 : 50);
+        settings.pngLevel = std::min(settings.pngLevel, 1);
+    }
+    return settings;
+}
+
+/**
+ * @brief Persists encoded frames through the sink and records the write stage latencies.
  *
- * Added debugging prints for save time and queue state.
+ * @param frames Encoded frames.
+ * @param n Number of frames.
+ * @param ok Scratch array of at least n results.
+ * @param tag Log prefix of the calling thread.
+ * @param tid Id of the calling thread.
+ */
+static void writeFrames(PipelineState* pipeline, const encoded_frame* frames, int n, bool* ok, const char* tag, int tid) {
+    LatencyRecorder& latency = pipeline->latency;
+    int64_t writeStart = monotonicNs();
+    if (pipeline->pacer != nullptr) {
+        size_t bytes = 0;
+        for (int i = 0; i < n; ++i) {
+            bytes += frames[i].bytes.size();
+        }
+        pipeline->pacer->admit(bytes);
+    }
+    pipeline->sink->writeBatch(frames, n, ok);
+    int64_t persisted = monotonicNs();
+    if (pipeline->journal != nullptr) {
+        pipeline->journal->append(frames, n, ok);
+    }
+    double writeMs = (persisted - writeStart) / 1e6;
+
+    for (int i = 0; i < n; ++i) {
+        if (!ok[i]) {
+            LOG_ERROR("[{} {}] failed to save image {}", tag, tid, frames[i].id + 1);
+        } else {
+            if (frames[i].derivative > 0) {
+                pipeline->savedDerivatives++;
+            } else {
+                pipeline->savedFrames++;
+                pipeline->streams[frames[i].stream]->savedFrames++;
+            }
+            latency.record(Stage::WriteWait, writeStart - frames[i].times.encoded);
+            latency.record(Stage::Write, persisted - writeStart);
+            latency.record(Stage::EndToEnd, persisted - frames[i].times.capture);
+            LOG_DEBUG("[{} {}] saved image {}, {} bytes, batch of {} written in {} ms",
+                      tag, tid, frames[i].id + 1, frames[i].bytes.size(), n, writeMs);
+        }
+    }
+}
+
+/**
+ * @struct EncodeJob
+ * @brief One frame of an encoder's batch, from the dequeue to the hand-off.
+ */
+struct EncodeJob {
+    img_data item;
+    encoded_frame out;
+    Stream* stream = nullptr;
+    FrameDedup* dedup = nullptr;
+    int level = 0;        ///< Adaptive quality level the frame is encoded at
+    int remaining = 0;    ///< Frames left in the stream's queue at the dequeue
+    bool ok = false;
+    cv::Mat small;        ///< Reused by the adaptive policy's half-size frames
+};
+
+/**
+ * @struct EncodeBatch
+ * @brief Jobs of one encoder and the codec's argument arrays, sized once for maxInFlight().
+ */
+struct EncodeBatch {
+    explicit EncodeBatch(int size)
+        : size(size), jobs(size), imgs(size), outs(size), settings(size), pending(size), encoded(new bool[size]) {}
+
+    int size;
+    std::vector<EncodeJob> jobs;
+    std::vector<const cv::Mat*> imgs;
+    std::vector<std::vector<uchar>*> outs;
+    std::vector<EncodeSettings> settings;
+    std::vector<int> pending;
+    std::unique_ptr<bool[]> encoded;
+    int64_t encodeStart = 0;
+    int64_t encodedAt = 0;
+};
+
+/**
+ * @brief Encodes the first n dequeued jobs of a batch: dedup lookups, one codec call for
+ * the misses, then their dedup stores. Each job's ok tells whether out holds its bytes.
+ */
+static void encodeJobs(PipelineState* pipeline, EncodeBatch& b, int n) {
+    b.encodeStart = monotonicNs();
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        EncodeJob& job = b.jobs[i];
+        img_data& item = job.item;
+        item.times.dequeued = b.encodeStart;
+        pipeline->latency.record(Stage::QueueWait, item.times.dequeued - item.times.enqueued);
+        job.stream = pipeline->streams[item.stream];
+        FrameQueue* q = job.stream->q;
+        job.remaining = q->size();
+        job.out = encoded_frame();
+        pipeline->encodeBuffers->acquire(job.out.bytes);
+        job.out.id = item.id;
+        job.out.timestamp = item.timestamp;
+        job.out.stream = item.stream;
+        job.out.derivative = item.derivative;
+        if (q->policy == OverflowPolicy::Adaptive) {
+            const double pressure = pipeline->pacer != nullptr ? pipeline->pacer->pressure() : 0.0;
+            job.level = job.stream->adaptive.update(job.remaining, q->capacity(), pressure);
+        } else {
+            job.level = 0;
+        }
+        job.ok = false;
+        // A frame identical to the stream's last one reuses its encoded bytes
+        job.dedup = job.stream->dedup.empty() ? nullptr : job.stream->dedup[item.derivative];
+        if (job.dedup != nullptr) {
+            job.out.hash = job.dedup->hash(item.img);
+            job.out.duplicate = job.ok = job.dedup->lookup(job.out.hash, job.level, job.out.bytes);
+        }
+        if (job.out.duplicate) {
+            continue;
+        }
+        if (job.level >= 2) {
+            job.stream->kernels->halve(item.img, job.small);
+            b.imgs[m] = &job.small;
+        } else {
+            b.imgs[m] = &item.img;
+        }
+        b.outs[m] = &job.out.bytes;
+        b.settings[m] = adaptiveSettings(pipeline->encodeSettings, job.level);
+        b.pending[m++] = i;
+    }
+    if (m > 0) {
+        const int64_t codecStart = monotonicNs();
+        pipeline->frameEncoder->encodeBatch(b.imgs.data(), b.outs.data(), b.settings.data(), b.encoded.get(), m);
+        const int64_t codecNs = (monotonicNs() - codecStart) / m;
+        for (int k = 0; k < m; ++k) {
+            EncodeJob& job = b.jobs[b.pending[k]];
+            job.ok = b.encoded[k];
+            if (job.ok && job.dedup != nullptr) {
+                job.dedup->store(job.out.hash, job.level, job.out.bytes, codecNs);
+            }
+        }
+    }
+    b.encodedAt = monotonicNs();
+}
+
+/**
+ * @brief Releases an encoded job's frame and stamps it.
+ *
+ * @return true when job.out is ready for the write stage, false if the encode failed.
+ */
+static bool finishJob(EncodeBatch& b, EncodeJob& job, Consumer_Args* cargs) {
+    PipelineState* pipeline = cargs->pipeline;
+    releaseFrame(job.item);
+    job.item.times.encoded = b.encodedAt;
+    job.out.times = job.item.times;
+    const int64_t encodeNs = b.encodedAt - b.encodeStart;
+
+    cargs->frames++;
+    if (!job.ok) {
+        LOG_ERROR("[Encoder {}] failed to encode image {}", cargs->thread_id, job.out.id + 1);
+        pipeline->encodeBuffers->release(job.out.bytes);
+        return false;
+    }
+    pipeline->latency.record(Stage::Encode, encodeNs);
+    LOG_DEBUG("[Encoder {}] encoded image {}, encode time: {} ms, queue size = {}",
+              cargs->thread_id, job.out.id + 1, encodeNs / 1e6, job.remaining);
+    return true;
+}
+
+/**
+ * @brief Releases the frames of a batch dequeued after the drain deadline, unencoded.
+ */
+static void abandonFrames(PipelineState* pipeline, EncodeBatch& b, int n) {
+    for (int i = 0; i < n; ++i) {
+        releaseFrame(b.jobs[i].item);
+    }
+    pipeline->abandonedFrames.fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the buffers of encoded frames dequeued after the drain deadline, unwritten.
+ */
+static void abandonEncoded(PipelineState* pipeline, encoded_frame* frames, int n) {
+    for (int i = 0; i < n; ++i) {
+        pipeline->encodeBuffers->release(frames[i].bytes);
+    }
+    pipeline->abandonedEncoded.fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Accounts the time an encoder spent on a batch.
+ */
+static void finishBatch(const EncodeBatch& b, Consumer_Args* cargs) {
+    PipelineState* pipeline = cargs->pipeline;
+    int64_t busyNs = monotonicNs() - b.encodeStart;
+    cargs->busyMs += busyNs / 1e6;
+    pipeline->encoderBusyNs.fetch_add(busyNs, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Encoder thread function, first half of the save pipeline.
+ *
+ * Each encoder waits for images of any stream (picked fairly by the StreamMux) and compresses them in memory with
+ * the --encoder backend (opencv gives the same bytes cv::imwrite would write). The result goes to the writer stage,
+ * or straight to the sink when no writer threads are configured.
+ * Under the adaptive overflow policy frames are encoded at reduced quality or size while
+ * the queue is filling up.
+ * With a backend that keeps frames in flight (nvjpeg, --gpu-inflight) an encoder takes up to
+ * that many already queued frames and hands them to the codec in one batch.
+ *
+ * Added debugging prints for encode time and queue state.
  *
  * @param arg Pointer to Consumer_Args structure containing thread info.
  * @return nullptr upon completion.
  */
-void* consumer(void* arg) {
+void* encoder(void* arg) {
     Consumer_Args* cargs = static_cast<Consumer_Args*>(arg);
-    Requirements* req = cargs->req;
+    PipelineState* pipeline = cargs->pipeline;
     int tid = cargs->thread_id;
+    // Under the steal scheduler encoder n owns deque n - 1 of every stream
+    StealQueue::bindWorker(tid - 1);
+    auto threadStart = std::chrono::high_resolution_clock::now();
 
-    while (true) {
-        pthread_mutex_lock(&queueMutex);
-        while (q.empty() && !producerDone && !timedOut) {
-            pthread_cond_wait(&queueCond, &queueMutex);
+    // Backends that overlap frames (nvjpeg) get up to maxInFlight() of them per call
+    EncodeBatch batch(std::max(pipeline->frameEncoder->maxInFlight(), 1));
+    for (;;) {
+        // Parked by the --auto-threads controller until the pool grows again
+        for (int limit; tid > (limit = pipeline->encoderLimit.load(std::memory_order_acquire));) {
+            pipeline->encoderLimit.wait(limit, std::memory_order_acquire);
         }
-        if (q.empty() && (producerDone || timedOut)) {
-            pthread_mutex_unlock(&queueMutex);
+        // Blocks until a frame is available; returns false once every producer is done and the queues are drained.
+        // The rest of the batch is whatever is already queued
+        if (!pipeline->mux->waitPop(batch.jobs[0].item)) {
             break;
         }
-        // Safely retrieve front and pop under the same lock
-        img_data item = q.front();
-        q.pop();
-        int remaining = q.size();
-        pthread_mutex_unlock(&queueMutex);
-
-        // Time how long it takes to save the image
-        auto saveStart = std::chrono::high_resolution_clock::now();
-        string filename = "../out/random_image_" + to_string(item.id + 1) + "." + req->image_format;
-        bool ok = cv::imwrite(filename, item.img);
-        auto saveEnd = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> saveElapsed = saveEnd - saveStart;
-        saveTime = saveTime + saveElapsed.count();
-
-        if (!ok) {
-            std::cerr << "[Consumer " << tid << "] failed to save " << filename << "\n";
-        } else {
-            savedFrames++;
-            cout << "[Consumer " << tid << "] saved " << filename
-                 << ", save time: " << saveElapsed.count() << " ms"
-                 << ", queue size = " << remaining << "\n";
+        int n = 1;
+        while (n < batch.size && pipeline->mux->tryPop(batch.jobs[n].item)) {
+            n++;
+        }
+        if (pipeline->abandon.load(std::memory_order_relaxed)) {
+            abandonFrames(pipeline, batch, n);
+            continue;
         }
+
+        // Time how long it takes to encode the images
+        encodeJobs(pipeline, batch, n);
+        for (int i = 0; i < n; ++i) {
+            EncodeJob& job = batch.jobs[i];
+            if (!finishJob(batch, job, cargs)) {
+                continue;
+            }
+            if (pipeline->encodedQueue != nullptr) {
+                pipeline->encodedQueue->push(std::move(job.out));
+            } else {
+                bool ok;
+                writeFrames(pipeline, &job.out, 1, &ok, "Encoder", tid);
+                pipeline->encodeBuffers->release(job.out.bytes);
+            }
+        }
+        finishBatch(batch, cargs);
+    }
+    cargs->wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - threadStart).count();
+
+    // The last encoder out lets the writers drain and exit
+    if (pipeline->activeEncoders.fetch_sub(1) == 1 && pipeline->encodedQueue != nullptr) {
+        pipeline->encodedQueue->close();
     }
+    pipeline->activeConsumers.fetch_sub(1, std::memory_order_release);
     return nullptr;
 }
 
 /**
- * @brief Entry point for the camera simulation.
+ * @brief Writes a batch taken from the encoded-frame channel and returns its buffers.
+ */
+static void writeBatch(encoded_frame* batch, int n, bool* ok, Consumer_Args* cargs) {
+    PipelineState* pipeline = cargs->pipeline;
+    auto writeStart = std::chrono::high_resolution_clock::now();
+    writeFrames(pipeline, batch, n, ok, "Writer", cargs->thread_id);
+    for (int i = 0; i < n; ++i) {
+        pipeline->encodeBuffers->release(batch[i].bytes);
+    }
+    cargs->frames += n;
+    auto busy = std::chrono::high_resolution_clock::now() - writeStart;
+    cargs->busyMs += std::chrono::duration<double, std::milli>(busy).count();
+    pipeline->writerBusyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Writer thread function, second half of the save pipeline.
  *
- * Initializes shared state, creates producer and consumer threads,
- * and waits for their completion.
+ * Writers only do I/O: they take encoded frames from the encoder stage and hand them
+ * to the sink, so disk stalls never hold an encoder core.
  *
- * @param frames Frames per second to generate.
- * @param minutes Duration in minutes for image generation.
- * @param num_threads Number of consumer threads.
- * @return 0 on success.
+ * @param arg Pointer to Consumer_Args structure containing thread info.
+ * @return nullptr upon completion.
  */
-int main_generator(int width, int height, std::string image_format, int frames, int minutes, int num_threads) {
-    Requirements* req = new Requirements{width, height, frames, num_threads, minutes, image_format};
+void* writer(void* arg) {
+    Consumer_Args* cargs = static_cast<Consumer_Args*>(arg);
+    PipelineState* pipeline = cargs->pipeline;
+    Requirements* req = cargs->req;
+    const int batchSize = std::max(req->write_batch, 1);
+
+    std::vector<encoded_frame> batch(batchSize);
+    std::unique_ptr<bool[]> ok(new bool[batchSize]);
+    auto threadStart = std::chrono::high_resolution_clock::now();
+    // Wait for one frame, then take whatever else is already queued, up to a batch
+    while (pipeline->encodedQueue->pop(batch[0])) {
+        int n = 1;
+        while (n < batchSize && pipeline->encodedQueue->tryPop(batch[n])) {
+            n++;
+        }
+        if (pipeline->abandon.load(std::memory_order_relaxed)) {
+            abandonEncoded(pipeline, batch.data(), n);
+            continue;
+        }
+        writeBatch(batch.data(), n, ok.get(), cargs);
+    }
+    cargs->wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - threadStart).count();
+    pipeline->activeConsumers.fetch_sub(1, std::memory_order_release);
+    return nullptr;
+}
+
+/**
+ * @brief Generate stage of --runtime coro: the producer loop of one stream as a coroutine.
+ *
+ * Waiting for the next deadline suspends the coroutine on the executor's timer heap instead
+ * of sleeping a thread, so a few executor threads serve every stream. The schedule, late
+ * policy and jitter accounting are the producer's (FrameScheduler); a --spin-us window is
+ * still spun on the executor thread. With --derive the frame goes to the transform stage,
+ * whose channel suspends the coroutine when it is full, otherwise straight to its queue.
+ */
+static coro::Task generateStage(Producer_Args* pargs) {
+    Stream* stream = pargs->stream;
+    PipelineState* pipeline = stream->pipeline;
+    Requirements* req = stream->req;
+    const double fps = stream->cfg.fps;
+    const auto framePeriod = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(stream->producers / fps));
+    const bool absolute = req->schedule == "absolute";
+    const auto spin = std::chrono::microseconds(req->spin_us);
+    const auto resumed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(stream->firstId / fps));
+    const auto endTime = std::chrono::steady_clock::now() + std::chrono::minutes(req->duration_minutes) - resumed;
+
+    FrameScheduler scheduler(fps, spin, req->late_policy == "skip" ? LatePolicy::Skip : LatePolicy::CatchUp,
+                             pargs->index, stream->producers);
+    const auto scheduleEnd = stream->scheduleStart + std::chrono::minutes(req->duration_minutes) - resumed;
+    scheduler.start(stream->scheduleStart, scheduleEnd);
+    img_data derived[MAX_DERIVATIVES];
+
+    while (absolute ? scheduler.nextDeadline() < scheduleEnd : std::chrono::steady_clock::now() < endTime) {
+        pthread_mutex_lock(&pipeline->queueMutex);
+        const bool stop = pipeline->timedOut;
+        pthread_mutex_unlock(&pipeline->queueMutex);
+        if (stop) {
+            break;
+        }
+
+        const auto loopStart = std::chrono::steady_clock::now();
+        if (absolute) {
+            co_await pipeline->executor->resumeAt(scheduler.nextDeadline() - spin);
+            scheduler.waitNext();
+            LOG_DEBUG("[Producer {}] woke up {} us after the frame deadline", stream->index,
+                      scheduler.getLastJitter() / 1000.0);
+        }
+
+        img_data data = makeFrame(stream, stream->nextId.fetch_add(1), stream->permanentImage);
+
+        if (!absolute) {
+            co_await pipeline->executor->resumeAt(loopStart + framePeriod);
+        }
+        if (data.img.empty()) {
+            continue;
+        }
+
+        stream->generatedFrames++;
+        if (pipeline->rawOutput != nullptr) {
+            commitRawFrame(stream, data);
+        } else if (pipeline->deriveQueue == nullptr) {
+            publishFrame(stream, data, derived);
+        } else if (!co_await pipeline->deriveQueue->push(data)) {
+            releaseFrame(data);
+        }
+    }
+
+    const bool last = finishProducer(pargs, scheduler, absolute);
+    if (pipeline->deriveQueue == nullptr) {
+        if (last) {
+            closeStream(stream);
+        }
+    } else if (pipeline->activeGenerators.fetch_sub(1) == 1) {
+        pipeline->deriveQueue->close();  // The transform stage closes the streams once it has drained
+    }
+}
+
+/**
+ * @brief Transform stage of --runtime coro: builds the --derive outputs of generated frames
+ * and queues everything for the encoders, so resizing never delays a frame deadline.
+ */
+static coro::Task transformStage(PipelineState* pipeline) {
+    img_data data;
+    img_data derived[MAX_DERIVATIVES];
+    while (co_await pipeline->deriveQueue->pop(data)) {
+        if (pipeline->abandon.load(std::memory_order_relaxed)) {
+            releaseFrame(data);
+            pipeline->abandonedFrames.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        publishFrame(pipeline->streams[data.stream], data, derived);
+    }
+    if (pipeline->activeTransforms.fetch_sub(1) == 1) {
+        for (Stream* stream : pipeline->streams) {
+            closeStream(stream);
+        }
+    }
+}
+
+/**
+ * @brief Encode stage of --runtime coro, the encoder thread's loop as a coroutine.
+ *
+ * The frame queues are polled through the StreamMux; an encoder finding them empty
+ * suspends on framesQueued until the next push or close. The hand-off to the write stage
+ * suspends while its channel is full. A batch is never interrupted, so the codec call
+ * occupies its executor thread like an encoder thread.
+ */
+static coro::Task encodeStage(Consumer_Args* cargs) {
+    PipelineState* pipeline = cargs->pipeline;
+    const int tid = cargs->thread_id;
+    const auto start = std::chrono::high_resolution_clock::now();
+    EncodeBatch batch(std::max(pipeline->frameEncoder->maxInFlight(), 1));
+    for (;;) {
+        const uint64_t seen = pipeline->framesQueued->epoch();
+        if (!pipeline->mux->tryPop(batch.jobs[0].item)) {
+            if (!pipeline->mux->closed()) {
+                co_await pipeline->framesQueued->wait(seen);
+                continue;
+            }
+            if (!pipeline->mux->tryPop(batch.jobs[0].item)) {
+                break;
+            }
+        }
+        int n = 1;
+        while (n < batch.size && pipeline->mux->tryPop(batch.jobs[n].item)) {
+            n++;
+        }
+        if (pipeline->abandon.load(std::memory_order_relaxed)) {
+            abandonFrames(pipeline, batch, n);
+            continue;
+        }
+
+        encodeJobs(pipeline, batch, n);
+        for (int i = 0; i < n; ++i) {
+            EncodeJob& job = batch.jobs[i];
+            if (!finishJob(batch, job, cargs)) {
+                continue;
+            }
+            if (pipeline->encodedChannel == nullptr) {
+                bool ok;
+                writeFrames(pipeline, &job.out, 1, &ok, "Encoder", tid);
+                pipeline->encodeBuffers->release(job.out.bytes);
+            } else if (!co_await pipeline->encodedChannel->push(job.out)) {
+                pipeline->encodeBuffers->release(job.out.bytes);
+            }
+        }
+        finishBatch(batch, cargs);
+        // Deadlines that expired during the batch go first
+        co_await pipeline->executor->yield();
+    }
+    cargs->wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    if (pipeline->activeEncoders.fetch_sub(1) == 1 && pipeline->encodedChannel != nullptr) {
+        pipeline->encodedChannel->close();
+    }
+    pipeline->activeConsumers.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+ * @brief Write stage of --runtime coro, the writer thread's loop as a coroutine.
+ */
+static coro::Task writeStage(Consumer_Args* cargs) {
+    PipelineState* pipeline = cargs->pipeline;
+    const int batchSize = std::max(cargs->req->write_batch, 1);
+    std::vector<encoded_frame> batch(batchSize);
+    std::unique_ptr<bool[]> ok(new bool[batchSize]);
+    const auto start = std::chrono::high_resolution_clock::now();
+    while (co_await pipeline->encodedChannel->pop(batch[0])) {
+        int n = 1;
+        while (n < batchSize && pipeline->encodedChannel->tryPop(batch[n])) {
+            n++;
+        }
+        if (pipeline->abandon.load(std::memory_order_relaxed)) {
+            abandonEncoded(pipeline, batch.data(), n);
+            continue;
+        }
+        writeBatch(batch.data(), n, ok.get(), cargs);
+    }
+    cargs->wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    pipeline->activeConsumers.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+ * @brief Prints count, mean, p50, p99, p99.9 and max of every pipeline stage, in milliseconds.
+ *
+ * The per-thread histograms are merged here; frames that were dropped or failed only appear
+ * in the stages they went through.
+ */
+static void printLatencyReport(PipelineState* pipeline, std::ostream& out) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "[Main] Latency (ms) %-12s %9s %9s %9s %9s %9s %9s\n",
+                  "stage", "count", "mean", "p50", "p99", "p99.9", "max");
+    out << line;
+    for (int i = 0; i < static_cast<int>(Stage::Count); ++i) {
+        Stage stage = static_cast<Stage>(i);
+        LatencySnapshot snap = pipeline->latency.snapshot(stage);
+        std::snprintf(line, sizeof(line), "[Main] Latency (ms) %-12s %9llu %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+                      stageName(stage), static_cast<unsigned long long>(snap.total), snap.meanNs() / 1e6,
+                      snap.percentile(0.50) / 1e6, snap.percentile(0.99) / 1e6,
+                      snap.percentile(0.999) / 1e6, snap.max / 1e6);
+        out << line;
+    }
+}
+
+/**
+ * @brief Counters of the whole pipeline for the stats thread, only relaxed atomic loads.
+ */
+static StatsSample sampleStats(const PipelineState* pipeline) {
+    StatsSample sample;
+    sample.saved = pipeline->savedFrames.load(std::memory_order_relaxed);
+    for (Stream* stream : pipeline->streams) {
+        sample.generated += stream->generatedFrames.load(std::memory_order_relaxed);
+        sample.dropped += stream->q->getDropCount();
+        sample.queued += static_cast<int64_t>(stream->q->size());
+        for (FrameDedup* dedup : stream->dedup) {
+            sample.duplicates += dedup->getHits();
+            sample.dedupSavedNs += dedup->getSavedNs();
+        }
+    }
+    if (pipeline->encodedQueue != nullptr) {
+        sample.writeQueued = static_cast<int64_t>(pipeline->encodedQueue->size());
+    } else if (pipeline->encodedChannel != nullptr) {
+        sample.writeQueued = static_cast<int64_t>(pipeline->encodedChannel->size());
+    }
+    return sample;
+}
+
+/**
+ * @brief Page-locks (or unlocks) every frame pool buffer for the encoder's uploads.
+ *
+ * @return Buffers the encoder accepted, 0 for backends that do not upload frames.
+ */
+static int pinFramePools(PipelineState* pipeline, bool pin) {
+    int pinned = 0;
+    for (Stream* stream : pipeline->streams) {
+        std::vector<FramePool*> pools = stream->derivePools;
+        pools.push_back(stream->pool);
+        for (FramePool* pool : pools) {
+            for (size_t slot = 0; pool != nullptr && slot < pool->capacity(); ++slot) {
+                if (!pin) {
+                    pipeline->frameEncoder->unregisterHostBuffer(pool->buffer(static_cast<int>(slot)));
+                } else if (pipeline->frameEncoder->registerHostBuffer(pool->buffer(static_cast<int>(slot)), pool->slotBytes())) {
+                    pinned++;
+                } else if (slot == 0) {
+                    break;  // Not an uploading backend, or out of lockable memory
+                }
+            }
+        }
+    }
+    return pinned;
+}
+
+/**
+ * @brief Warm-up controller of --auto-threads, run by the main thread.
+ *
+ * Starts with every encoder active and once per second resizes the active pool to what the
+ * last second needed at 80% utilization. Any drop, or queues more than half full, adds an
+ * encoder instead. Encoders above the limit stay parked, so the pool can grow back without
+ * creating threads. The size reached at the end of the warm-up is kept for the rest of the run.
+ *
+ * @param maxEncoders Encoder threads created.
+ * @param warmupSeconds Length of the warm-up.
+ * @return Number of active encoders after the warm-up.
+ */
+static int autoTuneEncoders(PipelineState* pipeline, int maxEncoders, int warmupSeconds) {
+    int limit = maxEncoders;
+    int64_t lastBusy = pipeline->encoderBusyNs.load();
+    int lastDrops = 0;
+    auto last = std::chrono::steady_clock::now();
+    for (int second = 0; second < warmupSeconds; ++second) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        pthread_mutex_lock(&pipeline->queueMutex);
+        bool done = pipeline->producerDone;
+        pthread_mutex_unlock(&pipeline->queueMutex);
+        if (done) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double windowNs = std::chrono::duration<double, std::nano>(now - last).count();
+        int64_t busy = pipeline->encoderBusyNs.load();
+        int drops = 0;
+        size_t queued = 0;
+        size_t capacity = 0;
+        for (Stream* stream : pipeline->streams) {
+            drops += stream->q->getDropCount();
+            queued += stream->q->size();
+            capacity += stream->q->capacity();
+        }
+        double busyThreads = (busy - lastBusy) / windowNs;
+        int target = std::max(static_cast<int>(std::ceil(busyThreads / 0.8)), 1);
+        if (drops > lastDrops || queued * 2 > capacity) {
+            target = std::max(target, limit + 1);
+        }
+        limit = std::min(target, maxEncoders);
+        pipeline->encoderLimit.store(limit, std::memory_order_release);
+        pipeline->encoderLimit.notify_all();
+        LOG_INFO("[Main] Auto threads: {} encoders ({} busy, {} queued, {} new drops)",
+                 limit, busyThreads, static_cast<int>(queued), drops - lastDrops);
+
+        last = now;
+        lastBusy = busy;
+        lastDrops = drops;
+    }
+    return limit;
+}
+
+/**
+ * @brief Frames generated so far on every stream.
+ */
+static int64_t generatedFrames(PipelineState* pipeline) {
+    int64_t generated = 0;
+    for (Stream* stream : pipeline->streams) {
+        generated += stream->generatedFrames.load(std::memory_order_relaxed);
+    }
+    return generated;
+}
+
+/**
+ * @brief Frames lost so far on every stream: queue drops and frames skipped on an empty frame pool.
+ */
+static int64_t lostFrames(PipelineState* pipeline) {
+    int64_t lost = 0;
+    for (Stream* stream : pipeline->streams) {
+        lost += stream->q->getDropCount();
+        if (stream->pool != nullptr) {
+            lost += stream->pool->getExhaustedCount();
+        }
+    }
+    return lost;
+}
+
+/**
+ * @brief Pauses the producers until the frames in flight are through the pipeline: every
+ * queue is empty and no frame was saved for a tenth of a second.
+ *
+ * @param timeout Gives up after this many seconds, e.g. when a stage is stuck.
+ */
+static void drainRamp(PipelineState* pipeline, int timeout) {
+    pipeline->rampPaused.store(true, std::memory_order_release);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+    int saved = pipeline->savedFrames.load();
+    while (std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        size_t queued = pipeline->encodedQueue != nullptr ? pipeline->encodedQueue->size() : 0;
+        for (Stream* stream : pipeline->streams) {
+            queued += stream->q->size();
+        }
+        const int now = pipeline->savedFrames.load();
+        if (queued == 0 && now == saved) {
+            return;
+        }
+        saved = now;
+    }
+    LOG_WARN("[Main] Max ramp: frames still in flight after {} s, measuring anyway", timeout);
+}
+
+/**
+ * @brief Ramp controller of --max, run by the main thread.
+ *
+ * Every step holds a rate for holdSeconds, scaling all streams alike, and passes when the
+ * writers saved at least 97% of it with no frame lost. The rate grows by 25% per passed step;
+ * after the first failure it bisects between the best passed and the lowest failed rate
+ * until they are within 2%. A failed step is blamed on the stage in front of the fullest
+ * queue: writers when the encoded-frame channel stayed more than half full, encoders when
+ * only the frame queues did, generation when neither filled up. The controller then ends
+ * the run by setting timedOut. Before every later step the producers pause until what the
+ * previous one left in the queues is saved or lost (drainRamp()), so a saturated step's
+ * backlog does not count toward the next rate.
+ *
+ * @param holdSeconds Length of every step.
+ * @param maxSeconds Run time available to the ramp.
+ * @param numEncoders Encoder threads.
+ * @param numWriters Writer threads.
+ */
+static void rampMaxThroughput(PipelineState* pipeline, int holdSeconds, int maxSeconds, int numEncoders, int numWriters) {
+    double baseFps = 0;
+    for (Stream* stream : pipeline->streams) {
+        baseFps += stream->cfg.fps;
+    }
+    double passed = 0, failed = 0;           // Scales, 0 while not found yet
+    double bestFps = 0, failedFps = 0;
+    std::string bottleneck;
+    double failedQueueFill = 0, failedWriteFill = 0, failedEncodersBusy = 0, failedWritersBusy = 0;
+    auto rampStart = std::chrono::steady_clock::now();
+
+    for (int step = 0; step < MAX_RAMP_STEPS; ++step) {
+        if (step > 0) {
+            double scale = failed == 0 ? pipeline->rampSteps[step - 1].scale * 1.25
+                                       : (passed == 0 ? failed / 2 : (passed + failed) / 2);
+            drainRamp(pipeline, std::max(holdSeconds, 5));
+            pipeline->rampSteps[step].scale = scale;
+            pipeline->rampSteps[step].start = std::chrono::steady_clock::now();
+            pipeline->rampStep.store(step, std::memory_order_release);
+            pipeline->rampPaused.store(false, std::memory_order_release);
+        }
+        const double target = baseFps * pipeline->rampSteps[step].scale;
+        const int64_t saved0 = pipeline->savedFrames.load(), generated0 = generatedFrames(pipeline);
+        const int64_t lost0 = lostFrames(pipeline), encodeBusy0 = pipeline->encoderBusyNs.load(), writeBusy0 = pipeline->writerBusyNs.load();
+        auto windowStart = std::chrono::steady_clock::now();
+
+        // Sample how full the queues in front of the encoders and the writers are
+        double queueFill = 0, writeFill = 0;
+        int samples = 0;
+        bool done = false;
+        for (int tick = 0; tick < holdSeconds * 10 && !done; ++tick) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            size_t queued = 0, capacity = 0;
+            for (Stream* stream : pipeline->streams) {
+                queued += stream->q->size();
+                capacity += stream->q->capacity();
+            }
+            queueFill += capacity ? static_cast<double>(queued) / capacity : 0.0;
+            if (pipeline->encodedQueue != nullptr) {
+                writeFill += static_cast<double>(pipeline->encodedQueue->size()) / pipeline->encodedQueue->capacity();
+            }
+            samples++;
+            pthread_mutex_lock(&pipeline->queueMutex);
+            done = pipeline->producerDone;
+            pthread_mutex_unlock(&pipeline->queueMutex);
+        }
+        if (done) {
+            break;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - windowStart).count();
+        int64_t generated = generatedFrames(pipeline) - generated0;
+        double savedFps = (pipeline->savedFrames.load() - saved0) / seconds;
+        int64_t lost = lostFrames(pipeline) - lost0;
+        queueFill /= samples;
+        writeFill /= samples;
+        double encodersBusy = (pipeline->encoderBusyNs.load() - encodeBusy0) / (seconds * 1e9 * numEncoders);
+        double writersBusy = numWriters > 0 ? (pipeline->writerBusyNs.load() - writeBusy0) / (seconds * 1e9 * numWriters) : 0.0;
+
+        bool ok = lost == 0 && savedFps >= 0.97 * target;
+        LOG_INFO("[Main] Max ramp: target {} fps, generated {} fps, saved {} fps, {} lost -> {}",
+                 target, generated / seconds, savedFps, static_cast<int>(lost), ok ? "sustained" : "saturated");
+        LOG_INFO("[Main] Max ramp: frame queues {}% full, write queue {}% full", 100 * queueFill, 100 * writeFill);
+        if (ok) {
+            passed = pipeline->rampSteps[step].scale;
+            bestFps = savedFps;
+        } else {
+            failed = pipeline->rampSteps[step].scale;
+            failedFps = target;
+            failedQueueFill = queueFill;
+            failedWriteFill = writeFill;
+            failedEncodersBusy = encodersBusy;
+            failedWritersBusy = writersBusy;
+            if (numWriters > 0 && writeFill > 0.5) {
+                bottleneck = "write";
+            } else if (queueFill > 0.5) {
+                bottleneck = numWriters > 0 ? "encode" : "encode and write";
+            } else {
+                bottleneck = "generate";
+            }
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - rampStart).count();
+        if ((failed > 0 && passed > 0 && failed / passed < 1.02) || (failed > 0 && failed < 1.0 / 64) ||
+            elapsed + holdSeconds > maxSeconds) {
+            break;
+        }
+    }
+
+    if (passed > 0) {
+        std::cout << "[Main] Max throughput: " << bestFps << " fps sustained for " << holdSeconds
+                  << " s with zero drops (" << passed << "x the configured fps)\n";
+    } else {
+        std::cout << "[Main] Max throughput: no rate sustained for " << holdSeconds << " s with zero drops\n";
+    }
+    if (failed > 0) {
+        std::cout << "[Main] Bottleneck at " << failedFps << " fps: " << bottleneck
+                  << " (frame queues " << 100 * failedQueueFill << "% full, write queue " << 100 * failedWriteFill
+                  << "% full, encoders " << 100 * failedEncodersBusy << "% busy, writers "
+                  << 100 * failedWritersBusy << "% busy)\n";
+    } else {
+        std::cout << "[Main] Max throughput: the run ended before the pipeline saturated, raise -m\n";
+    }
+
+    pthread_mutex_lock(&pipeline->queueMutex);
+    pipeline->timedOut = true;
+    pthread_mutex_unlock(&pipeline->queueMutex);
+}
+
+/**
+ * @brief Bounds the drain of the queues, run by the main thread before joining the stages.
+ *
+ * Waits for every producer to finish (its schedule or a stop()), then gives the encoders
+ * and writers --drain-s seconds to empty the queues. Past the deadline abandon is set: the
+ * batch being encoded or written is completed, so no file is cut short, and every frame
+ * dequeued after it is released unsaved and counted.
+ */
+static void boundDrain(PipelineState* pipeline) {
+    for (;;) {
+        int producing = 0;
+        for (Stream* stream : pipeline->streams) {
+            producing += stream->activeProducers.load(std::memory_order_acquire);
+        }
+        if (producing == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    pipeline->drainStart = std::chrono::steady_clock::now();
+    // Encoders parked by --auto-threads help with the drain
+    pipeline->encoderLimit.store(INT_MAX, std::memory_order_release);
+    pipeline->encoderLimit.notify_all();
+    const auto deadline = pipeline->drainStart + std::chrono::seconds(pipeline->req->drain_s);
+    while (pipeline->activeConsumers.load(std::memory_order_acquire) > 0 &&
+           !pipeline->abandon.load(std::memory_order_relaxed)) {
+        if (pipeline->req->drain_s > 0 && std::chrono::steady_clock::now() >= deadline) {
+            LOG_WARN("[Main] Drain deadline of {} s reached, abandoning the queued frames", pipeline->req->drain_s);
+            pipeline->abandon.store(true, std::memory_order_relaxed);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+/**
+ * @brief Frees the streams, queues, sinks and codecs of a pipeline whose threads are all joined.
+ */
+static void releaseStages(PipelineState* pipeline) {
+    // A stats() call from another thread waits here and then reads the last sample
+    std::lock_guard<std::mutex> lock(pipeline->statsMutex);
+    if (pipeline->sampling) {
+        pipeline->finalStats = sampleStats(pipeline);
+        pipeline->sampling = false;
+    }
+    if (pipeline->pinnedBuffers > 0) {
+        pinFramePools(pipeline, false);
+    }
+    for (Stream* stream : pipeline->streams) {
+        delete stream->q;
+        delete stream->pool;
+        for (FramePool* pool : stream->derivePools) {
+            delete pool;
+        }
+        for (FrameDedup* dedup : stream->dedup) {
+            delete dedup;
+        }
+        pthread_mutex_destroy(&stream->queueMutex);
+        pthread_cond_destroy(&stream->queueCond);
+        delete stream;
+    }
+    pipeline->streams.clear();
+    delete pipeline->mux;
+    pipeline->mux = nullptr;
+    delete pipeline->encodedQueue;
+    pipeline->encodedQueue = nullptr;
+    delete pipeline->encodedChannel;
+    pipeline->encodedChannel = nullptr;
+    delete pipeline->deriveQueue;
+    pipeline->deriveQueue = nullptr;
+    delete pipeline->framesQueued;
+    pipeline->framesQueued = nullptr;
+    delete pipeline->encodeBuffers;
+    pipeline->encodeBuffers = nullptr;
+    delete pipeline->journal;
+    pipeline->journal = nullptr;
+    delete pipeline->sink;
+    pipeline->sink = nullptr;
+    delete pipeline->pacer;  // After the sink, whose destructor may still flush through it
+    pipeline->pacer = nullptr;
+    pipeline->rawOutput = nullptr;
+    delete pipeline->frameEncoder;
+    pipeline->frameEncoder = nullptr;
+    delete pipeline->tilePool;
+    pipeline->tilePool = nullptr;
+    delete[] pipeline->args;
+    delete[] pipeline->pargs;
+    pipeline->args = nullptr;
+    pipeline->pargs = nullptr;
+    pipeline->threads.clear();
+}
+
+/**
+ * @brief Unwinds a start() whose thread threads[created] could not be created.
+ *
+ * The threads already running are stopped as at the drain deadline: producers stop at their
+ * next frame, consumers drop what they dequeue. Producers and encoders that never ran are
+ * accounted as finished, so every stream and the encoded-frame channel still get closed and
+ * every thread started can be joined.
+ */
+static void abortStart(PipelineState* pipeline, int created) {
+    pthread_mutex_lock(&pipeline->queueMutex);
+    pipeline->timedOut = true;
+    pthread_mutex_unlock(&pipeline->queueMutex);
+    pipeline->abandon.store(true, std::memory_order_relaxed);
+
+    for (int i = created; i < pipeline->numProducers; ++i) {
+        Stream* stream = pipeline->pargs[i].stream;
+        if (stream->activeProducers.fetch_sub(1) == 1) {
+            closeStream(stream);
+        }
+    }
+    int missingEncoders = 0;
+    for (int i = std::max(created, pipeline->numProducers); i < pipeline->numThreads; ++i) {
+        if (pipeline->args[i].thread_id <= pipeline->numEncoders) {
+            missingEncoders++;
+        }
+    }
+    if (missingEncoders > 0 && pipeline->activeEncoders.fetch_sub(missingEncoders) == missingEncoders &&
+        pipeline->encodedQueue != nullptr) {
+        pipeline->encodedQueue->close();
+    }
+
+    for (int i = 0; i < created; ++i) {
+        pthread_join(pipeline->threads[i], nullptr);
+    }
+    pipeline->sink->flush();
+    if (pipeline->journal != nullptr) {
+        pipeline->journal->stop();
+    }
+    Logger::instance().stop();
+    releaseStages(pipeline);
+}
+
+Pipeline::Pipeline(const Requirements& config) : state(new PipelineState()) {
+    state->req = new Requirements(config);
+    pthread_mutex_init(&state->queueMutex, nullptr);
+}
+
+Pipeline::~Pipeline() {
+    if (state->started) {
+        stop();
+        wait();
+    }
+    pthread_mutex_destroy(&state->queueMutex);
+    delete state->req;
+    delete state;
+}
+
+void Pipeline::stop() {
+    pthread_mutex_lock(&state->queueMutex);
+    if (state->stopped) {
+        state->abandon.store(true, std::memory_order_relaxed);
+    }
+    state->timedOut = true;
+    state->stopped = true;
+    pthread_mutex_unlock(&state->queueMutex);
+}
+
+StatsSample Pipeline::stats() const {
+    std::lock_guard<std::mutex> lock(state->statsMutex);
+    return state->sampling ? sampleStats(state) : state->finalStats;
+}
+
+/**
+ * @brief Builds the pipeline and starts it.
+ *
+ * Initializes the instance's state, creates one producer thread per stream plus the shared
+ * encoder and writer threads (or their coroutines under --runtime coro) and the stats reporter.
+ */
+bool Pipeline::start() {
+    PipelineState* pipeline = state;
+    Requirements* req = pipeline->req;
+    const int minutes = req->duration_minutes;
+    const int num_encoders = req->encoders > 0 ? req->encoders : std::max(req->num_threads, 1);
+    const int num_writers = std::max(req->writers, 0);
+
+    // Without a stream list, -w/-h/-f describe the only camera
+    std::vector<StreamConfig> configs = req->streams;
+    if (configs.empty()) {
+        StreamConfig single;
+        single.width = req->imageWidth;
+        single.height = req->imageHeight;
+        single.fps = req->frames;
+        configs.push_back(single);
+    }
+    const int num_streams = static_cast<int>(configs.size());
+
+    // --resume continues the numbering and the schedule of every stream after its last durable frame
+    const std::string journalPath = req->output_dir + "/frames.journal";
+    JournalState resume;
+    if (req->resume) {
+        if (!FrameJournal::recover(journalPath, resume)) {
+            std::cerr << "[Main] Cannot resume: no frame journal at " << journalPath << "\n";
+            return false;
+        }
+        if (resume.ext != req->image_format) {
+            std::cerr << "[Main] Cannot resume: the journaled run saved ." << resume.ext << " frames, not ."
+                      << req->image_format << "\n";
+            return false;
+        }
+        if (resume.seed != req->seed) {
+            std::cout << "[Main] Resume: the journaled run used seed " << resume.seed << ", frames will differ\n";
+        }
+        if (resume.discardedBytes > 0) {
+            std::cout << "[Main] Resume: dropped " << resume.discardedBytes << " bytes of torn journal tail\n";
+        }
+    }
+    const int producers_per_stream = std::max(req->producers, 1);
+    const int num_producers = num_streams * producers_per_stream;
+    const int num_threads = num_producers + num_encoders + num_writers;
+    const bool coroutines = req->runtime == "coro";
+    // Under the coroutine runtime --derive gets its own stage, fed through a channel of one frame per producer
+    const bool transform = coroutines && !req->derive.empty() && req->output != "raw";
     Consumer_Args* args = new Consumer_Args[num_threads];
+    Producer_Args* pargs = new Producer_Args[num_producers];
+    pipeline->args = args;  // Owned by the pipeline from here, releaseStages() frees them
+    pipeline->pargs = pargs;
+    pipeline->encoderLimit = INT_MAX;
 
-    // Define queue's properties
-    q.maxSize = 100;
-    q.queueMutex = queueMutex;
-    
-    // Create threads
-    pthread_t threads[num_threads];
-    pthread_create(&threads[0], nullptr, producer, req);
+    LogLevel logLevel = LogLevel::Info;
+    parseLogLevel(req->log_level, logLevel);
+    Logger::instance().setLevel(logLevel);
+    Logger::instance().start();
 
-    for (int i = 1; i < num_threads; ++i) {
-        args[i].thread_id = i;
+    // Define every stream's queue and frame pool
+    const int maxSize = req->encode_queue;
+    int width = 0;
+    int height = 0;
+    pipeline->mux = new StreamMux();
+    for (int i = 0; i < num_streams; ++i) {
+        Stream* stream = new Stream();
+        stream->pipeline = pipeline;
+        stream->index = i;
+        stream->cfg = configs[i];
+        stream->req = req;
+        stream->producers = producers_per_stream;
+        if (!req->producer_cpus.empty()) {
+            stream->cpu = req->producer_cpus[(i * producers_per_stream) % req->producer_cpus.size()];
+        }
+        stream->seed = i == 0 ? req->seed : fastrandom::splitmix64(req->seed + i);
+        stream->kernels = &framekernels::selectFrameKernels(stream->cfg.width, stream->cfg.height, CV_8UC3,
+                                                            req->kernels == "auto");
+        if (i < static_cast<int>(resume.nextId.size())) {
+            stream->firstId = resume.nextId[i];
+            stream->nextId = stream->firstId;
+            std::cout << "[Main] Stream " << i << " resumes at frame " << stream->firstId + 1 << ", "
+                      << resume.frames[i] << " frames journaled, " << stream->firstId - resume.frames[i]
+                      << " lost before the last durable one\n";
+        }
+        pthread_mutex_init(&stream->queueMutex, nullptr);
+        pthread_cond_init(&stream->queueCond, nullptr);
+        if (req->scheduler == "steal") {
+            stream->q = new StealQueue(maxSize, num_encoders);
+        } else if (req->queue_type == "ring") {
+            stream->q = new RingQueue(maxSize);
+        } else {
+            SafetyQueue* sq = new SafetyQueue();
+            sq->maxSize = maxSize;
+            sq->queueMutex = &stream->queueMutex; // Share the mutex, copying it would lock a different one
+            sq->queueCond = &stream->queueCond;
+            stream->q = sq;
+        }
+        parseOverflowPolicy(req->overflow, stream->q->policy);
+        if (req->dedup) {
+            for (size_t k = 0; k <= req->derive.size(); ++k) {
+                stream->dedup.push_back(new FrameDedup(stream->kernels->hash));
+            }
+        }
+        stream->q->blockTimeout = std::chrono::milliseconds(req->block_timeout_ms);
+
+        // Enough buffers for a full queue, one frame per encoder and one per producer.
+        // The producers write every pixel, so the buffers live on the NUMA node of the first one
+        if (req->content == "random" && req->output != "raw") {
+            int poolSize = static_cast<int>(stream->q->capacity()) + num_encoders + producers_per_stream
+                         + (transform ? num_producers : 0);
+            int node = numaNodeOfCpu(stream->cpu);
+            stream->pool = new FramePool(poolSize, stream->cfg.width, stream->cfg.height, CV_8UC3, node,
+                                         stream->kernels->bufferAlign);
+            std::cout << "[Main] Stream " << i << " frame pool: " << poolSize << " buffers, "
+                      << stream->pool->bytes() / (1024 * 1024) << " MB";
+            if (node >= 0) {
+                std::cout << " on NUMA node " << node;
+            }
+            std::cout << "\n";
+            // Scaled derivatives of queued frames hold a buffer each, as many as the frames themselves
+            for (const DeriveConfig& cfg : req->derive) {
+                stream->derivePools.push_back(cfg.width > 0 ? new FramePool(poolSize, cfg.width, cfg.height, CV_8UC3, node)
+                                                            : nullptr);
+            }
+        }
+        // Static content reuses one image, and the same derivatives of it, for every frame
+        stream->permanentImage = generateRandomImage(stream->cfg.width, stream->cfg.height);
+        for (const DeriveConfig& cfg : req->derive) {
+            cv::Mat scaled;
+            if (cfg.width > 0) {
+                cv::Mat source = cfg.roiWidth > 0 ? stream->permanentImage(cv::Rect(cfg.roiX, cfg.roiY, cfg.roiWidth, cfg.roiHeight))
+                                                  : stream->permanentImage;
+                cv::resize(source, scaled, cv::Size(cfg.width, cfg.height), 0, 0, cv::INTER_AREA);
+            }
+            stream->staticDerived.push_back(scaled);
+        }
+        pipeline->mux->add(stream->q, static_cast<int64_t>(stream->cfg.width) * stream->cfg.height);
+        pipeline->streams.push_back(stream);
+        width = std::max(width, stream->cfg.width);
+        height = std::max(height, stream->cfg.height);
+        std::cout << "[Main] Stream " << i << ": " << stream->cfg.width << "x" << stream->cfg.height
+                  << " at " << stream->cfg.fps << " fps, " << stream->kernels->name << " kernels\n";
+    }
+
+    if (req->content == "random" && req->generator == "fast") {
+        std::cout << "[Main] Random generator: " << fastrandom::isaName() << ", seed " << req->seed << "\n";
+        if (req->gen_threads > 0) {
+            pipeline->tilePool = new TilePool(req->gen_threads);
+            std::cout << "[Main] Tiled generation: " << req->gen_threads << " threads, "
+                      << req->tile_rows << " rows per tile\n";
+        }
+    }
+
+    if (req->output == "raw") {
+        // Complete mappings are left to the journal's sync, which msyncs them before unmapping
+        pipeline->rawOutput = new RawSink(req->output_dir);
+        pipeline->sink = pipeline->rawOutput;
+        for (Stream* stream : pipeline->streams) {
+            int64_t slots = static_cast<int64_t>(minutes) * 60 * stream->cfg.fps + producers_per_stream;
+            if (!pipeline->rawOutput->addStream(stream->index, stream->cfg.width, stream->cfg.height, stream->cfg.fps, slots,
+                                      static_cast<uint64_t>(req->segment_mb) << 20, req->sync_ms > 0, req->resume)) {
+                // Its producers would have nowhere to generate into
+                std::cerr << "[Main] Raw output: cannot create the file of stream " << stream->index << ": "
+                          << std::strerror(errno) << "\n";
+                Logger::instance().stop();
+                releaseStages(pipeline);
+                return false;
+            }
+        }
+        std::cout << "[Main] Raw output: producers generate straight into the mapped files, "
+                  << "encoders and writers stay idle\n";
+    } else if (req->output == "container") {
+        // Complete segments are left to the journal's sync, which fdatasyncs them before closing
+        pipeline->sink = new ContainerSink(req->output_dir, req->image_format, static_cast<uint64_t>(req->segment_mb) << 20,
+                                           req->resume, req->sync_ms > 0);
+    }
+#ifdef HAVE_LIBURING
+    else if (req->writer_backend == "uring") {
+        // Worst case is an uncompressed frame of the largest stream plus container headers
+        size_t slotBytes = static_cast<size_t>(width) * height * 3 + (1 << 20);
+        pipeline->sink = new UringSink(req->output_dir, req->image_format, std::max(req->write_batch, 1), slotBytes, req->direct_io);
+    }
+#endif
+    if (pipeline->sink == nullptr) {
+        pipeline->sink = new FileSink(req->output_dir, req->image_format);
+    }
+    if (pipeline->rawOutput == nullptr && (req->flush_mb > 0 || req->write_mbps != 0)) {
+        const double rate = req->write_mbps < 0 ? WritePacer::AUTO_RATE : req->write_mbps * (1 << 20);
+        pipeline->pacer = new WritePacer(static_cast<size_t>(req->flush_mb) << 20, rate,
+                                         num_writers > 0 ? num_writers : num_encoders);
+        pipeline->sink->setPacer(pipeline->pacer);
+        std::cout << "[Main] Write pacing: ";
+        if (req->flush_mb > 0) {
+            std::cout << req->flush_mb << " MB writeback windows";
+        } else {
+            std::cout << "kernel writeback";
+        }
+        if (req->write_mbps < 0) {
+            std::cout << ", token bucket at 90% of the measured bandwidth";
+        } else if (req->write_mbps > 0) {
+            std::cout << ", token bucket at " << req->write_mbps << " MB/s";
+        }
+        std::cout << "\n";
+    }
+    if (req->sync_ms > 0) {
+        pipeline->journal = new FrameJournal(journalPath, pipeline->sink, std::chrono::milliseconds(req->sync_ms));
+        if (pipeline->journal->open(req->image_format, req->seed, req->resume ? &resume : nullptr)) {
+            pipeline->journal->start();
+            std::cout << "[Main] Frame journal: " << journalPath << ", synced every " << req->sync_ms << " ms\n";
+        } else {
+            std::cout << "[Main] Frame journal: cannot open " << journalPath << ": " << std::strerror(errno)
+                      << ", frames are not journaled\n";
+            delete pipeline->journal;
+            pipeline->journal = nullptr;
+        }
+    }
+
+    pipeline->encodeSettings.quality = req->quality;
+    pipeline->encodeSettings.subsampling = req->subsampling;
+    pipeline->encodeSettings.pngLevel = req->png_level;
+    if (req->encoder == "raw") {
+        pipeline->frameEncoder = new RawEncoder();
+    }
+#ifdef HAVE_TURBOJPEG
+    else if (req->encoder == "turbojpeg") {
+        TurboJpegEncoder* turbo = new TurboJpegEncoder();
+        if (turbo->available()) {
+            pipeline->frameEncoder = turbo;
+        } else {
+            std::cout << "[Main] TurboJPEG could not be initialized, using opencv\n";
+            delete turbo;
+        }
+    }
+#endif
+#ifdef HAVE_NVJPEG
+    else if (req->encoder == "nvjpeg") {
+        NvJpegEncoder* gpu = new NvJpegEncoder(req->gpu_inflight);
+        if (gpu->available()) {
+            pipeline->frameEncoder = gpu;
+        } else {
+            std::cout << "[Main] nvJPEG could not be initialized (no CUDA device?), using opencv\n";
+            delete gpu;
+        }
+    }
+#endif
+    if (pipeline->frameEncoder == nullptr) {
+        pipeline->frameEncoder = new OpenCvEncoder("." + req->image_format);
+    }
+    std::cout << "[Main] Encoder: " << pipeline->frameEncoder->name() << ", quality " << pipeline->encodeSettings.quality
+              << ", subsampling " << pipeline->encodeSettings.subsampling << ", png level " << pipeline->encodeSettings.pngLevel << "\n";
+    if (pipeline->frameEncoder->maxInFlight() > 1) {
+        std::cout << "[Main] Encoder: " << pipeline->frameEncoder->maxInFlight() << " frames in flight per encoder thread\n";
+    }
+    // Uploads from page-locked frame buffers are asynchronous DMA that overlaps the GPU's encodes
+    const int pinnedBuffers = pinFramePools(pipeline, true);
+    pipeline->pinnedBuffers = pinnedBuffers;
+    if (pinnedBuffers > 0) {
+        std::cout << "[Main] Encoder: " << pinnedBuffers << " frame buffers page-locked for uploads\n";
+    }
+    if (coroutines) {
+        // Executor threads take the consumer cores, round-robin like the encoder and writer threads
+        const int executorThreads = req->coro_threads > 0 ? req->coro_threads : num_encoders + 1;
+        const std::vector<int> cpus = req->consumer_cpus;
+        pipeline->executor = new coro::Executor(executorThreads, [cpus](int i) {
+            if (!cpus.empty()) {
+                pinCurrentThread(cpus[i % cpus.size()]);
+            }
+        });
+        pipeline->framesQueued = new coro::AsyncEvent(*pipeline->executor);
+        if (num_writers > 0) {
+            pipeline->encodedChannel = new coro::AsyncChannel<encoded_frame>(*pipeline->executor, req->write_queue);
+        }
+        if (transform) {
+            pipeline->deriveQueue = new coro::AsyncChannel<img_data>(*pipeline->executor, num_producers);
+        }
+    } else if (num_writers > 0) {
+        pipeline->encodedQueue = new Channel<encoded_frame>(req->write_queue);
+    }
+    // One buffer per encoder, a full channel and a full batch per writer; a raw frame of the
+    // largest stream plus headroom for container headers is the worst case of every codec
+    int writeQueued = pipeline->encodedQueue != nullptr ? static_cast<int>(pipeline->encodedQueue->capacity())
+                    : (pipeline->encodedChannel != nullptr ? static_cast<int>(pipeline->encodedChannel->capacity()) : 0);
+    int inFlight = num_encoders * std::max(pipeline->frameEncoder->maxInFlight(), 1) + writeQueued
+                 + num_writers * std::max(req->write_batch, 1);
+    size_t bufferBytes = static_cast<size_t>(width) * height * 3 + (1 << 20);
+    pipeline->encodeBuffers = new BufferPool(inFlight, bufferBytes);
+    std::cout << "[Main] Encode buffer pool: " << inFlight << " buffers of " << bufferBytes / (1024 * 1024) << " MB\n";
+    pipeline->activeEncoders = num_encoders;
+    pipeline->activeConsumers = num_encoders + num_writers;
+    if (coroutines) {
+        std::cout << "[Main] Coroutine runtime: " << pipeline->executor->threads() << " executor threads running "
+                  << num_producers << " generate, " << (transform ? num_streams : 0) << " transform, "
+                  << num_encoders << " encode and " << num_writers << " write coroutines\n";
+    } else {
+        std::cout << "[Main] " << num_producers << " producer threads, " << num_encoders << " encoder threads, "
+                  << num_writers << " writer threads, " << req->scheduler << " scheduler\n";
+    }
+
+    // The first step of the --max ramp runs at the configured fps
+    pipeline->rampSteps[0].scale = 1.0;
+    pipeline->rampSteps[0].start = std::chrono::steady_clock::now();
+    pipeline->rampStep = 0;
+    pipeline->startedAt = pipeline->rampSteps[0].start;
+
+    for (int i = 0; i < num_producers; ++i) {
+        Stream* stream = pipeline->streams[i / producers_per_stream];
+        pargs[i].stream = stream;
+        pargs[i].index = i % producers_per_stream;
+        if (pargs[i].index == 0) {
+            stream->activeProducers = producers_per_stream;
+            stream->scheduleStart = std::chrono::steady_clock::now();
+        }
+    }
+    for (int i = num_producers; i < num_threads; ++i) {
+        args[i].thread_id = i - num_producers + 1;
         args[i].req = req;
-        pthread_create(&threads[i], nullptr, consumer, (void*)&args[i]);
+        args[i].pipeline = pipeline;
+    }
+
+    // Create threads, pinned and with the realtime policy before they start running
+    pipeline->threads.resize(num_threads);
+    pthread_t* threads = pipeline->threads.data();
+    coro::TaskGroup& tasks = pipeline->tasks;
+    if (coroutines) {
+        // Every stage is a set of coroutines; their count is the stage's concurrency limit
+        pipeline->activeGenerators = num_producers;
+        pipeline->activeTransforms = transform ? num_streams : 0;
+        for (int i = 0; i < num_producers; ++i) {
+            generateStage(&pargs[i]).spawn(*pipeline->executor, tasks);
+        }
+        for (int i = 0; transform && i < num_streams; ++i) {
+            transformStage(pipeline).spawn(*pipeline->executor, tasks);
+        }
+        for (int i = num_producers; i < num_threads; ++i) {
+            (args[i].thread_id <= num_encoders ? encodeStage(&args[i]) : writeStage(&args[i])).spawn(*pipeline->executor, tasks);
+        }
+    }
+    pipeline->numProducers = num_producers;
+    pipeline->numEncoders = num_encoders;
+    pipeline->numThreads = num_threads;
+    int created = 0;  // threads[0, created) are running
+    for (int i = 0; i < num_producers && !coroutines; ++i) {
+        int cpu = req->producer_cpus.empty() ? -1 : req->producer_cpus[i % req->producer_cpus.size()];
+        bool realtime = false;
+        int rc = createThread(&threads[i], producer, &pargs[i], cpu, req->producer_priority, &realtime);
+        if (rc != 0) {
+            std::cout << "[Main] Cannot create producer " << i;
+            if (cpu >= 0) {
+                std::cout << " on cpu " << cpu;
+            }
+            std::cout << ": " << std::strerror(rc) << "\n";
+            abortStart(pipeline, created);
+            return false;
+        }
+        created++;
+        if (cpu >= 0 || req->producer_priority > 0) {
+            std::cout << "[Main] Producer " << i;
+            if (cpu >= 0) {
+                std::cout << " pinned to cpu " << cpu;
+            }
+            if (realtime) {
+                std::cout << ", SCHED_FIFO priority " << req->producer_priority;
+            } else if (req->producer_priority > 0) {
+                std::cout << ", SCHED_FIFO refused (needs CAP_SYS_NICE or RLIMIT_RTPRIO), normal policy";
+            }
+            std::cout << "\n";
+        }
+    }
+
+    for (int i = num_producers; i < num_threads && !coroutines; ++i) {
+        int cpu = -1;
+        if (!req->consumer_cpus.empty()) {
+            cpu = req->consumer_cpus[(args[i].thread_id - 1) % req->consumer_cpus.size()];
+        }
+        bool realtime = false;
+        const bool isEncoder = args[i].thread_id <= num_encoders;
+        int rc = createThread(&threads[i], isEncoder ? encoder : writer, (void*)&args[i], cpu, 0, &realtime);
+        if (rc != 0) {
+            std::cout << "[Main] Cannot create " << (isEncoder ? "encoder " : "writer ") << args[i].thread_id;
+            if (cpu >= 0) {
+                std::cout << " on cpu " << cpu;
+            }
+            std::cout << ": " << std::strerror(rc) << "\n";
+            abortStart(pipeline, created);
+            return false;
+        }
+        created++;
+    }
+    if (!req->consumer_cpus.empty()) {
+        std::cout << "[Main] " << (coroutines ? "Executor threads" : "Encoders and writers") << " pinned round-robin to "
+                  << req->consumer_cpus.size() << " cpus\n";
     }
 
-    // Wait for threads to finish
-    for (int i = 0; i < num_threads; ++i) {
+    if (req->stats || req->stats_port > 0) {
+        pipeline->stats = new StatsReporter([pipeline] { return sampleStats(pipeline); }, pipeline->latency,
+                                            req->stats, req->stats_port, req->stats_host);
+        if (!pipeline->stats->start()) {
+            std::cout << "[Main] Stats endpoint: cannot listen on " << req->stats_host << ":" << req->stats_port << ": "
+                      << std::strerror(errno) << "\n";
+        } else if (req->stats_port > 0) {
+            std::cout << "[Main] Stats endpoint: http://" << req->stats_host << ":" << req->stats_port << "/metrics\n";
+        }
+    }
+
+    pipeline->started = true;
+    pipeline->coroutines = coroutines;
+    pipeline->numStreams = num_streams;
+    pipeline->numWriters = num_writers;
+    std::lock_guard<std::mutex> lock(pipeline->statsMutex);
+    pipeline->sampling = true;
+    return true;
+}
+
+/**
+ * @brief Runs the controllers, waits for the end of the run, reports it and frees the instance.
+ */
+int Pipeline::wait() {
+    PipelineState* pipeline = state;
+    if (!pipeline->started) {
+        return 1;
+    }
+    Requirements* req = pipeline->req;
+    const int minutes = req->duration_minutes;
+    const bool coroutines = pipeline->coroutines;
+    const int num_streams = pipeline->numStreams;
+    const int num_producers = pipeline->numProducers;
+    const int num_encoders = pipeline->numEncoders;
+    const int num_writers = pipeline->numWriters;
+    const int num_threads = pipeline->numThreads;
+    Consumer_Args* args = pipeline->args;
+    pthread_t* threads = pipeline->threads.data();
+
+    if (req->max_mode) {
+        rampMaxThroughput(pipeline, req->max_hold_s, minutes * 60, num_encoders, num_writers);
+    }
+
+    if (req->auto_threads) {
+        int settled = autoTuneEncoders(pipeline, num_encoders, req->warmup_s);
+        std::cout << "[Main] Auto threads: settled on " << settled << " of " << num_encoders << " encoders\n";
+    }
+    boundDrain(pipeline);
+
+    // Wait for threads to finish; parked encoders are released once the producers are done
+    if (coroutines) {
+        pipeline->tasks.wait();
+        std::cout << "[Main] Coroutine runtime: " << pipeline->executor->getResumes() << " resumes on "
+                  << pipeline->executor->threads() << " executor threads\n";
+        delete pipeline->executor;
+        pipeline->executor = nullptr;
+    }
+    for (int i = 0; i < num_threads && !coroutines; ++i) {
         pthread_join(threads[i], nullptr);
     }
+    const double drainMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - pipeline->drainStart).count();
+    delete pipeline->stats;
+    pipeline->stats = nullptr;
+    pipeline->sink->flush();
+    if (pipeline->journal != nullptr) {
+        pipeline->journal->stop();
+    }
+    Logger::instance().stop();
+    pipeline->sink->report(std::cout);
+    if (pipeline->pacer != nullptr) {
+        const WritePacer& pacer = *pipeline->pacer;
+        std::cout << "[Main] Write pacing: " << pacer.getWindows() << " writeback windows, measured bandwidth ";
+        if (pacer.getBandwidth() > 0) {
+            std::cout << pacer.getBandwidth() / (1 << 20) << " MB/s";
+        } else {
+            std::cout << "n/a (the disk kept up)";
+        }
+        std::cout << ", writers throttled " << pacer.getThrottledNs() / 1e6 << " ms";
+        if (pacer.getBucketNs() > 0) {
+            std::cout << " (" << pacer.getBucketNs() / 1e6 << " ms by the token bucket)";
+        }
+        std::cout << "\n";
+    }
+    if (pipeline->journal != nullptr) {
+        std::cout << "[Main] Frame journal: " << pipeline->journal->getDurableFrames() << " durable frames, "
+                  << pipeline->journal->getSyncs() << " syncs, longest " << pipeline->journal->getMaxSyncMs() << " ms";
+        if (pipeline->journal->getFailedSyncs() > 0) {
+            std::cout << ", " << pipeline->journal->getFailedSyncs() << " failed";
+        }
+        std::cout << "\n";
+    }
+    // A stopped run is measured up to its stop, not over the configured duration
+    double runSeconds = minutes * 60.0;
+    if (pipeline->stopped) {
+        runSeconds = std::max(std::chrono::duration<double>(pipeline->drainStart - pipeline->startedAt).count(), 1e-3);
+        std::cout << "[Main] Stopped after " << runSeconds << " s of the " << minutes << " minutes scheduled\n";
+    }
+    std::cout << "[Main] Drain: " << drainMs << " ms after the last producer";
+    if (pipeline->abandon.load()) {
+        std::cout << ", abandoned " << pipeline->abandonedFrames.load() << " queued and "
+                  << pipeline->abandonedEncoded.load() << " encoded frames (--drain-s " << req->drain_s << ")";
+    }
+    std::cout << "\n";
 
-    std::cout << "Total frames to generate and save (teoric): " << minutes * 60 * frames << " frames \n";
-    int totalFrames = savedFrames.load();
+    int64_t teoricFrames = 0;
+    int droppedFrames = 0;
+    int64_t droppedOldest = 0, droppedNewest = 0, blockedPushes = 0, blockTimeouts = 0, blockedNs = 0;
+    int degradedQuality = 0, degradedSize = 0, poolExhausted = 0;
+    for (Stream* stream : pipeline->streams) {
+        teoricFrames += std::max<int64_t>(static_cast<int64_t>(minutes) * 60 * stream->cfg.fps - stream->firstId, 0);
+        droppedFrames += stream->q->getDropCount();
+        droppedOldest += stream->q->stats.droppedOldest.load();
+        droppedNewest += stream->q->stats.droppedNewest.load();
+        blockedPushes += stream->q->stats.blockedPushes.load();
+        blockTimeouts += stream->q->stats.blockTimeouts.load();
+        blockedNs += stream->q->stats.blockedNs.load();
+        degradedQuality += stream->adaptive.getDegradedFrames(1);
+        degradedSize += stream->adaptive.getDegradedFrames(2);
+        if (stream->pool != nullptr) {
+            poolExhausted += stream->pool->getExhaustedCount();
+        }
+        for (FramePool* pool : stream->derivePools) {
+            if (pool != nullptr) {
+                poolExhausted += pool->getExhaustedCount();
+            }
+        }
+    }
+
+    std::cout << "Total frames to generate and save (teoric): " << teoricFrames << " frames \n";
+    int totalFrames = pipeline->savedFrames.load();
     std::cout << "[Main] Average consumer fps " 
-              << (totalFrames / (req->duration_minutes * 60)) << "\n";
+              << (totalFrames / runSeconds) << "\n";
 
     // print q stats
     cout << "[Main] Queue stats: "
         << "Total frames saved: " << totalFrames << " frames \n"
-        << "Average generation time: " << generationTime.load()/totalFrames << " miliseconds \n"
-        << "Average save time: " << saveTime.load()/totalFrames << " miliseconds \n"
-        << "Total queue time: " << qTime.load() << " miliseconds \n"
-        << "Queue average: " << qTime.load()/qCounter.load() << " ms \n"
-        << "Dropped frames: " << q.getDropCount() << "\n";
-
-    delete[] args;
-    delete req;
-    std::cout << "\n[Main] Program finished after " << minutes << " minutes.\n";
+        << "Dropped frames: " << droppedFrames << "\n";
+    printLatencyReport(pipeline, std::cout);
+    cout << "[Main] Overflow policy " << req->overflow << ": "
+        << "dropped oldest: " << droppedOldest
+        << ", dropped newest: " << droppedNewest
+        << ", blocked pushes: " << blockedPushes
+        << " (" << blockedNs / 1e6 << " ms)"
+        << ", block timeouts: " << blockTimeouts << "\n";
+    if (pipeline->streams[0]->q->policy == OverflowPolicy::Adaptive) {
+        cout << "[Main] Adaptive quality: " << degradedQuality << " frames at reduced quality, "
+             << degradedSize << " frames at reduced size\n";
+    }
+    if (req->dedup) {
+        int64_t hits = 0, misses = 0, hashNs = 0, savedNs = 0;
+        for (Stream* stream : pipeline->streams) {
+            for (FrameDedup* dedup : stream->dedup) {
+                hits += dedup->getHits();
+                misses += dedup->getMisses();
+                hashNs += dedup->getHashNs();
+                savedNs += dedup->getSavedNs();
+            }
+        }
+        cout << "[Main] Dedup: " << hits << " of " << hits + misses << " frames were duplicates ("
+             << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << " %), hashing took "
+             << hashNs / 1e6 << " ms, about " << savedNs / 1e6 << " ms of encoding saved\n";
+    }
+    if (!req->derive.empty()) {
+        cout << "[Main] Derivatives: " << req->derive.size() << " per frame, " << pipeline->savedDerivatives.load()
+             << " saved, " << pipeline->droppedDerivatives.load() << " dropped on a full queue (not in the dropped frames)\n";
+    }
+    if (req->content == "random" && pipeline->rawOutput == nullptr) {
+        cout << "[Main] Frame pool exhausted: " << poolExhausted << " times\n";
+    }
+    if (pipeline->encodeBuffers->getExhaustedCount() > 0) {
+        cout << "[Main] Encode buffer pool exhausted: " << pipeline->encodeBuffers->getExhaustedCount() << " times\n";
+    }
+    if (num_streams > 1) {
+        for (Stream* stream : pipeline->streams) {
+            int generated = stream->generatedFrames.load();
+            int saved = stream->savedFrames.load();
+            cout << "[Main] Stream " << stream->index << " (" << stream->cfg.width << "x" << stream->cfg.height
+                 << "@" << stream->cfg.fps << "): generated " << generated
+                 << ", saved " << saved
+                 << ", dropped " << stream->q->getDropCount()
+                 << ", saved fps " << static_cast<double>(saved) / runSeconds
+                 << ", average generation time " << (generated ? stream->generationNs.load() / 1e6 / generated : 0.0)
+                 << " ms\n";
+        }
+    }
+
+    for (int i = num_producers; i < num_threads; ++i) {
+        const Consumer_Args& a = args[i];
+        const bool isEncoder = a.thread_id <= num_encoders;
+        cout << "[Main] " << (isEncoder ? "Encoder " : "Writer ") << a.thread_id << ": " << a.frames << " frames";
+        if (isEncoder && req->scheduler == "steal") {
+            int64_t local = 0, steals = 0;
+            for (Stream* stream : pipeline->streams) {
+                StealQueue* sq = static_cast<StealQueue*>(stream->q);
+                local += sq->getLocalPops(a.thread_id - 1);
+                steals += sq->getSteals(a.thread_id - 1);
+            }
+            cout << " (" << local << " local, " << steals << " stolen)";
+        }
+        cout << ", utilization " << (a.wallMs > 0 ? 100.0 * a.busyMs / a.wallMs : 0.0) << " %\n";
+    }
+
+    releaseStages(pipeline);
+    pipeline->started = false;
+    if (pipeline->stopped) {
+        std::cout << "\n[Main] Program stopped after " << runSeconds << " s.\n";
+    } else {
+        std::cout << "\n[Main] Program finished after " << minutes << " minutes.\n";
+    }
     return 0;
 }
+
+/**
+ * @brief Entry point for the camera simulation: one pipeline, run to completion.
+ *
+ * @param config Run configuration parsed from the command line.
+ * @return 0 on success.
+ */
+int main_generator(const Requirements& config) {
+    Pipeline pipeline(config);
+    if (!pipeline.start()) {
+        return 1;
+    }
+    return pipeline.wait();
+}
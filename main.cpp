@@ -1,6 +1,79 @@
 #include <../dependencies/argparse.hpp>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <thread>
 #include "./modules.h"
+#include "modules/Backpressure.h"
+#include "modules/Logger.h"
+#include "modules/ContainerSink.h"
+#include "modules/StreamMux.h"
+#include "modules/Affinity.h"
+
+/**
+ * @brief Parses a camera stream given as WxH@FPS, e.g. 3840x2160@30.
+ *
+ * @return false if the text is not a valid stream.
+ */
+static bool parseStreamSpec(const std::string& spec, StreamConfig& out) {
+    char extra;
+    if (std::sscanf(spec.c_str(), "%dx%d@%d %c", &out.width, &out.height, &out.fps, &extra) != 3) {
+        return false;
+    }
+    return out.width > 0 && out.height > 0 && out.fps > 0;
+}
+
+/**
+ * @brief Parses a derivative given as WxH (downscale), X,Y,WxH (crop) or X,Y,WxH@WxH (crop, then downscale).
+ *
+ * @return false if the text is not a valid derivative.
+ */
+static bool parseDeriveSpec(const std::string& spec, DeriveConfig& out) {
+    char extra;
+    if (std::sscanf(spec.c_str(), "%d,%d,%dx%d@%dx%d %c", &out.roiX, &out.roiY, &out.roiWidth, &out.roiHeight,
+                    &out.width, &out.height, &extra) == 6) {
+        return out.roiX >= 0 && out.roiY >= 0 && out.roiWidth > 0 && out.roiHeight > 0 && out.width > 0 && out.height > 0;
+    }
+    out = DeriveConfig();
+    if (std::sscanf(spec.c_str(), "%d,%d,%dx%d %c", &out.roiX, &out.roiY, &out.roiWidth, &out.roiHeight, &extra) == 4) {
+        return out.roiX >= 0 && out.roiY >= 0 && out.roiWidth > 0 && out.roiHeight > 0;
+    }
+    out = DeriveConfig();
+    if (std::sscanf(spec.c_str(), "%dx%d %c", &out.width, &out.height, &extra) == 2) {
+        return out.width > 0 && out.height > 0;
+    }
+    return false;
+}
+
+/**
+ * @brief Reads one WxH@FPS stream per line; empty lines and lines starting with # are skipped.
+ *
+ * @return false if the file cannot be read or a line is not a valid stream.
+ */
+static bool readStreamsFile(const std::string& path, std::vector<StreamConfig>& out) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot read streams file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        StreamConfig stream;
+        if (!parseStreamSpec(line.substr(first), stream)) {
+            std::cerr << "Invalid stream in " << path << ": " << line << std::endl;
+            return false;
+        }
+        out.push_back(stream);
+    }
+    return true;
+}
 
 int main(int argc, char *argv[]) {
     argparse::ArgumentParser program("threads_images");
@@ -16,7 +89,7 @@ int main(int argc, char *argv[]) {
         .scan<'i', int>();
 
     program.add_argument("-t")
-        .help("Set threads´ number")
+        .help("Set consumer (encoder) threads´ number")
         .default_value(8)
         .scan<'i', int>();
 
@@ -24,6 +97,30 @@ int main(int argc, char *argv[]) {
         .help("Set image format")
         .default_value(std::string("jpg"));
 
+    program.add_argument("--encoder")
+        .help("Set encoder backend: opencv, turbojpeg or nvjpeg (when built with them) or raw (uncompressed)")
+        .default_value(std::string("opencv"));
+
+    program.add_argument("--quality")
+        .help("Set JPEG quality (1-100); turbojpeg uses the fast integer DCT")
+        .default_value(95)
+        .scan<'i', int>();
+
+    program.add_argument("--subsampling")
+        .help("Set JPEG chroma subsampling: 444, 422 or 420")
+        .default_value(420)
+        .scan<'i', int>();
+
+    program.add_argument("--png-level")
+        .help("Set PNG compression level (0-9)")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--gpu-inflight")
+        .help("Set frames every nvjpeg encoder thread keeps in flight on the GPU (1-64)")
+        .default_value(4)
+        .scan<'i', int>();
+
     program.add_argument("-w")
         .help("Set image Width")
         .default_value(1920)
@@ -34,6 +131,218 @@ int main(int argc, char *argv[]) {
         .default_value(1280)
         .scan<'i', int>();
 
+    program.add_argument("--queue")
+        .help("Set queue implementation: mutex or ring (lock-free)")
+        .default_value(std::string("mutex"));
+
+    program.add_argument("--scheduler")
+        .help("Set how encoders get frames: shared (one queue per stream) or steal (per-encoder deques with work stealing)")
+        .default_value(std::string("shared"));
+
+    program.add_argument("--content")
+        .help("Set frame content: static (one reused image) or random (new image per frame from the frame pool)")
+        .default_value(std::string("static"));
+
+    program.add_argument("--schedule")
+        .help("Set producer schedule: absolute (drift-free deadlines) or relative (sleep the rest of each period)")
+        .default_value(std::string("absolute"));
+
+    program.add_argument("--spin-us")
+        .help("Set busy-wait microseconds before each frame deadline (absolute schedule)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--late")
+        .help("Set policy for missed deadlines: catchup or skip")
+        .default_value(std::string("catchup"));
+
+    program.add_argument("--overflow")
+        .help("Set full-queue policy: drop-oldest, drop-newest, block or adaptive")
+        .default_value(std::string("drop-oldest"));
+
+    program.add_argument("--block-timeout-ms")
+        .help("Set how long a push waits for space under the block policy")
+        .default_value(100)
+        .scan<'i', int>();
+
+    program.add_argument("--log-level")
+        .help("Set log level: quiet, error, warn, info or debug (per-frame messages)")
+        .default_value(std::string("info"));
+
+    program.add_argument("--encoders")
+        .help("Set encoder threads (0 uses -t)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--producers")
+        .help("Set producer threads per stream")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--runtime")
+        .help("Set how the stages run: threads (one thread per producer, encoder and writer) or coro (coroutines on an executor pool)")
+        .default_value(std::string("threads"));
+
+    program.add_argument("--coro-threads")
+        .help("Set executor threads of the coro runtime (0 uses the encoders plus one)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--auto-threads")
+        .help("Size the active encoder pool during a warm-up, up to the encoders created")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--warmup-s")
+        .help("Set length of the --auto-threads warm-up in seconds")
+        .default_value(10)
+        .scan<'i', int>();
+
+    program.add_argument("--max")
+        .help("Ramp the frame rate under block backpressure and report the highest fps sustained without drops")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--max-hold-s")
+        .help("Set seconds every --max rate is held")
+        .default_value(5)
+        .scan<'i', int>();
+
+    program.add_argument("--stats")
+        .help("Print live stats as one JSON line per second")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--stats-port")
+        .help("Set port of the Prometheus stats endpoint, served on 127.0.0.1 (0 disables it)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--stats-listen")
+        .help("Set host:port of the Prometheus stats endpoint, e.g. 0.0.0.0:9100 to serve every interface (overrides --stats-port)")
+        .default_value(std::string(""));
+
+    program.add_argument("--dedup")
+        .help("Hash every frame and reuse the encoded bytes of a frame identical to the previous one")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--resume")
+        .help("Continue an interrupted run after the last frame in its journal")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--sync-ms")
+        .help("Set interval in ms of the frame journal sync (0 disables the journal)")
+        .default_value(1000)
+        .scan<'i', int>();
+
+    program.add_argument("--drain-s")
+        .help("Set seconds the queues may take to drain once the producers stop (0 waits for every frame)")
+        .default_value(30)
+        .scan<'i', int>();
+
+    program.add_argument("--writers")
+        .help("Set writer threads (0 writes from the encoder threads)")
+        .default_value(1)
+        .scan<'i', int>();
+
+    program.add_argument("--encode-queue")
+        .help("Set depth of the frame queue in front of the encoders")
+        .default_value(100)
+        .scan<'i', int>();
+
+    program.add_argument("--write-queue")
+        .help("Set depth of the encoded frame queue in front of the writers")
+        .default_value(32)
+        .scan<'i', int>();
+
+    program.add_argument("--writer")
+        .help("Set writer backend: file or uring (io_uring, when built with liburing)")
+        .default_value(std::string("file"));
+
+    program.add_argument("--write-batch")
+        .help("Set how many frames a writer submits at once")
+        .default_value(16)
+        .scan<'i', int>();
+
+    program.add_argument("--direct")
+        .help("Write frames with O_DIRECT (uring writer)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--output")
+        .help("Set output mode: files (one file per frame), container (segment files plus index) or raw (mapped raw frame files)")
+        .default_value(std::string("files"));
+
+    program.add_argument("--flush-mb")
+        .help("Set writeback window in MB: writers start the writeback of every frame and wait for the previous window (0 leaves it to the kernel)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--write-rate")
+        .help("Set token bucket rate of the writers: off, auto (90% of the measured disk bandwidth, needs --flush-mb) or MB/s")
+        .default_value(std::string("off"));
+
+    program.add_argument("--segment-mb")
+        .help("Set container segment file size, or raw file mapping size, in MB")
+        .default_value(1024)
+        .scan<'i', int>();
+
+    program.add_argument("--extract")
+        .help("Extract the frames of a container run in the given directory and exit")
+        .default_value(std::string(""));
+
+    program.add_argument("--generator")
+        .help("Set random content generator: fast (SIMD, reproducible per frame) or randu (cv::randu)")
+        .default_value(std::string("fast"));
+
+    program.add_argument("--kernels")
+        .help("Set pixel loops: auto (compile-time kernels for the 1920x1280 and 3840x2160 profiles) or generic")
+        .default_value(std::string("auto"));
+
+    program.add_argument("--seed")
+        .help("Set seed of the fast generator")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--gen-threads")
+        .help("Set worker threads that generate frame tiles in parallel (fast generator)")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--tile-rows")
+        .help("Set rows per generation tile")
+        .default_value(64)
+        .scan<'i', int>();
+
+    program.add_argument("--producer-cpus")
+        .help("Set cores of the producer threads, e.g. 2 or 2,3 (stream i uses entry i)")
+        .default_value(std::string(""));
+
+    program.add_argument("--producer-priority")
+        .help("Set SCHED_FIFO priority (1-99) of the producers, 0 keeps the normal policy")
+        .default_value(0)
+        .scan<'i', int>();
+
+    program.add_argument("--consumer-cpus")
+        .help("Set cores of the encoder and writer threads, e.g. 4-15")
+        .default_value(std::string(""));
+
+    program.add_argument("--stream")
+        .help("Add a camera stream WxH@FPS (repeatable), e.g. --stream 3840x2160@30 --stream 1920x1080@60")
+        .default_value(std::vector<std::string>())
+        .append();
+
+    program.add_argument("--streams")
+        .help("Set file with one WxH@FPS camera stream per line")
+        .default_value(std::string(""));
+
+    program.add_argument("--derive")
+        .help("Add a derivative encoded with every frame (repeatable): WxH downscale, X,Y,WxH crop or X,Y,WxH@WxH both")
+        .default_value(std::vector<std::string>())
+        .append();
+
     try {
         program.parse_args(argc, argv);
     }
@@ -43,12 +352,73 @@ int main(int argc, char *argv[]) {
         return 1;
         }
 
+    auto extract_dir = program.get<std::string>("--extract");
+    if (!extract_dir.empty()) {
+        int extracted = extractContainer(extract_dir);
+        if (extracted < 0) {
+            std::cerr << "Cannot read container index in " << extract_dir << std::endl;
+            return 1;
+        }
+        std::cout << "Extracted " << extracted << " frames" << std::endl;
+        return 0;
+    }
+
     auto frames = program.get<int>("-f");
     auto minutes = program.get<int>("-m");
     auto threads = program.get<int>("-t");
     auto image_format = program.get<std::string>("-i");
+    auto encoder = program.get<std::string>("--encoder");
+    auto quality = program.get<int>("--quality");
+    auto subsampling = program.get<int>("--subsampling");
+    auto png_level = program.get<int>("--png-level");
+    auto gpu_inflight = program.get<int>("--gpu-inflight");
     auto width = program.get<int>("-w");
     auto height = program.get<int>("-h");
+    auto queue_type = program.get<std::string>("--queue");
+    auto scheduler = program.get<std::string>("--scheduler");
+    auto content = program.get<std::string>("--content");
+    auto generator = program.get<std::string>("--generator");
+    auto kernels = program.get<std::string>("--kernels");
+    auto seed = program.get<int>("--seed");
+    auto gen_threads = program.get<int>("--gen-threads");
+    auto tile_rows = program.get<int>("--tile-rows");
+    auto schedule = program.get<std::string>("--schedule");
+    auto spin_us = program.get<int>("--spin-us");
+    auto late_policy = program.get<std::string>("--late");
+    auto overflow = program.get<std::string>("--overflow");
+    auto block_timeout_ms = program.get<int>("--block-timeout-ms");
+    auto log_level = program.get<std::string>("--log-level");
+    auto encoders = program.get<int>("--encoders");
+    auto writers = program.get<int>("--writers");
+    auto producers = program.get<int>("--producers");
+    auto runtime = program.get<std::string>("--runtime");
+    auto coro_threads = program.get<int>("--coro-threads");
+    auto auto_threads = program.get<bool>("--auto-threads");
+    auto warmup_s = program.get<int>("--warmup-s");
+    auto max_mode = program.get<bool>("--max");
+    auto max_hold_s = program.get<int>("--max-hold-s");
+    auto stats = program.get<bool>("--stats");
+    auto stats_port = program.get<int>("--stats-port");
+    auto stats_listen = program.get<std::string>("--stats-listen");
+    auto dedup = program.get<bool>("--dedup");
+    auto resume = program.get<bool>("--resume");
+    auto sync_ms = program.get<int>("--sync-ms");
+    auto drain_s = program.get<int>("--drain-s");
+    auto encode_queue = program.get<int>("--encode-queue");
+    auto write_queue = program.get<int>("--write-queue");
+    auto writer_backend = program.get<std::string>("--writer");
+    auto write_batch = program.get<int>("--write-batch");
+    auto direct_io = program.get<bool>("--direct");
+    auto output = program.get<std::string>("--output");
+    auto segment_mb = program.get<int>("--segment-mb");
+    auto flush_mb = program.get<int>("--flush-mb");
+    auto write_rate = program.get<std::string>("--write-rate");
+    auto producer_cpus_text = program.get<std::string>("--producer-cpus");
+    auto producer_priority = program.get<int>("--producer-priority");
+    auto consumer_cpus_text = program.get<std::string>("--consumer-cpus");
+    auto stream_specs = program.get<std::vector<std::string>>("--stream");
+    auto streams_file = program.get<std::string>("--streams");
+    auto derive_specs = program.get<std::vector<std::string>>("--derive");
 
     std::cout << frames << std::endl;
 
@@ -62,6 +432,392 @@ int main(int argc, char *argv[]) {
 
     std::cout << height << std::endl;
 
-    main_generator(width, height, image_format, frames, minutes, threads);
-    return 0;
+    std::cout << queue_type << std::endl;
+
+    if (queue_type != "mutex" && queue_type != "ring") {
+        std::cerr << "Unknown queue type: " << queue_type << std::endl;
+        return 1;
+    }
+
+    if (scheduler != "shared" && scheduler != "steal") {
+        std::cerr << "Unknown scheduler: " << scheduler << std::endl;
+        return 1;
+    }
+
+    std::cout << content << std::endl;
+
+    if (content != "static" && content != "random") {
+        std::cerr << "Unknown content type: " << content << std::endl;
+        return 1;
+    }
+
+    if (generator != "fast" && generator != "randu") {
+        std::cerr << "Unknown generator: " << generator << std::endl;
+        return 1;
+    }
+    if (kernels != "auto" && kernels != "generic") {
+        std::cerr << "Unknown kernels: " << kernels << std::endl;
+        return 1;
+    }
+
+    if (gen_threads < 0 || tile_rows < 1) {
+        std::cerr << "Invalid tiled generation settings" << std::endl;
+        return 1;
+    }
+
+    std::cout << schedule << std::endl;
+
+    if (schedule != "absolute" && schedule != "relative") {
+        std::cerr << "Unknown schedule: " << schedule << std::endl;
+        return 1;
+    }
+    if (late_policy != "catchup" && late_policy != "skip") {
+        std::cerr << "Unknown late policy: " << late_policy << std::endl;
+        return 1;
+    }
+
+    std::cout << overflow << std::endl;
+
+    OverflowPolicy policy;
+    if (!parseOverflowPolicy(overflow, policy)) {
+        std::cerr << "Unknown overflow policy: " << overflow << std::endl;
+        return 1;
+    }
+
+    LogLevel level;
+    if (!parseLogLevel(log_level, level)) {
+        std::cerr << "Unknown log level: " << log_level << std::endl;
+        return 1;
+    }
+
+    if (threads < 1 || encoders < 0 || writers < 0 || producers < 1) {
+        std::cerr << "Thread counts must be at least 1 (-t, --producers) or 0 (--encoders, --writers)" << std::endl;
+        return 1;
+    }
+    if (warmup_s < 1) {
+        std::cerr << "Warm-up must be at least 1 second" << std::endl;
+        return 1;
+    }
+
+    if (max_hold_s < 1) {
+        std::cerr << "Max hold must be at least 1 second" << std::endl;
+        return 1;
+    }
+    if (max_mode && auto_threads) {
+        std::cerr << "--max and --auto-threads cannot be combined, --max measures a fixed pool" << std::endl;
+        return 1;
+    }
+    if (runtime != "threads" && runtime != "coro") {
+        std::cerr << "Unknown runtime: " << runtime << std::endl;
+        return 1;
+    }
+    if (coro_threads < 0) {
+        std::cerr << "Executor threads cannot be negative" << std::endl;
+        return 1;
+    }
+    if (runtime == "coro" && (max_mode || auto_threads)) {
+        std::cerr << "--runtime coro cannot be combined with --max or --auto-threads, they size thread pools" << std::endl;
+        return 1;
+    }
+    if (runtime == "coro" && (scheduler == "steal" || overflow == "block")) {
+        // Both block or bind an executor thread that other coroutines need
+        std::cerr << "--runtime coro needs --scheduler shared and an overflow policy that never blocks" << std::endl;
+        return 1;
+    }
+    if (sync_ms < 0) {
+        std::cerr << "Sync interval cannot be negative" << std::endl;
+        return 1;
+    }
+    if (drain_s < 0) {
+        std::cerr << "Drain time cannot be negative" << std::endl;
+        return 1;
+    }
+    if (resume && sync_ms == 0) {
+        std::cerr << "--resume needs the frame journal, --sync-ms cannot be 0" << std::endl;
+        return 1;
+    }
+    if (resume && max_mode) {
+        std::cerr << "--resume and --max cannot be combined, --max is not a scheduled run" << std::endl;
+        return 1;
+    }
+    if (max_mode) {
+        // The ramp needs the absolute schedule and a producer that waits for the pipeline instead of dropping
+        schedule = "absolute";
+        overflow = "block";
+    }
+
+    std::string stats_host = "127.0.0.1";
+    if (!stats_listen.empty()) {
+        const size_t colon = stats_listen.rfind(':');
+        in_addr probe;
+        char extra;
+        if (colon == std::string::npos || std::sscanf(stats_listen.c_str() + colon + 1, "%d %c", &stats_port, &extra) != 1 ||
+            inet_pton(AF_INET, stats_listen.substr(0, colon).c_str(), &probe) != 1) {
+            std::cerr << "--stats-listen must be an IPv4 address and a port, e.g. 127.0.0.1:9100" << std::endl;
+            return 1;
+        }
+        stats_host = stats_listen.substr(0, colon);
+    }
+    if (stats_port < 0 || stats_port > 65535) {
+        std::cerr << "Stats port must be between 0 and 65535" << std::endl;
+        return 1;
+    }
+
+    if (encode_queue < 1 || write_queue < 1) {
+        std::cerr << "Queue depths must be at least 1" << std::endl;
+        return 1;
+    }
+
+    if (encoder != "opencv" && encoder != "turbojpeg" && encoder != "nvjpeg" && encoder != "raw") {
+        std::cerr << "Unknown encoder: " << encoder << std::endl;
+        return 1;
+    }
+#ifndef HAVE_TURBOJPEG
+    if (encoder == "turbojpeg") {
+        std::cerr << "This build has no TurboJPEG support (libjpeg-turbo not found)" << std::endl;
+        return 1;
+    }
+#endif
+#ifndef HAVE_NVJPEG
+    if (encoder == "nvjpeg") {
+        std::cerr << "This build has no nvJPEG support (CUDA toolkit not found)" << std::endl;
+        return 1;
+    }
+#endif
+    if ((encoder == "turbojpeg" || encoder == "nvjpeg") && image_format != "jpg" && image_format != "jpeg") {
+        std::cerr << "The " << encoder << " encoder only writes JPEG, use -i jpg" << std::endl;
+        return 1;
+    }
+    if (encoder == "raw") {
+        image_format = "raw";
+    }
+    if (quality < 1 || quality > 100 || png_level < 0 || png_level > 9) {
+        std::cerr << "Quality must be between 1 and 100 and PNG level between 0 and 9" << std::endl;
+        return 1;
+    }
+    if (subsampling != 444 && subsampling != 422 && subsampling != 420) {
+        std::cerr << "Subsampling must be 444, 422 or 420" << std::endl;
+        return 1;
+    }
+    if (gpu_inflight < 1 || gpu_inflight > 64) {
+        std::cerr << "GPU frames in flight must be between 1 and 64" << std::endl;
+        return 1;
+    }
+
+    if (writer_backend != "file" && writer_backend != "uring") {
+        std::cerr << "Unknown writer backend: " << writer_backend << std::endl;
+        return 1;
+    }
+#ifndef HAVE_LIBURING
+    if (writer_backend == "uring") {
+        std::cerr << "This build has no io_uring support (liburing not found)" << std::endl;
+        return 1;
+    }
+#endif
+
+    if (output != "files" && output != "container" && output != "raw") {
+        std::cerr << "Unknown output mode: " << output << std::endl;
+        return 1;
+    }
+    if (output == "raw" && max_mode) {
+        std::cerr << "--max measures the encode pipeline, which --output raw bypasses" << std::endl;
+        return 1;
+    }
+    if (output == "raw") {
+        image_format = "raw";
+    }
+    if (segment_mb < 1) {
+        std::cerr << "Segment size must be at least 1 MB" << std::endl;
+        return 1;
+    }
+    if (flush_mb < 0) {
+        std::cerr << "Writeback window cannot be negative" << std::endl;
+        return 1;
+    }
+    double write_mbps = 0;
+    if (write_rate == "auto") {
+        write_mbps = -1;
+    } else if (write_rate != "off") {
+        char extra;
+        if (std::sscanf(write_rate.c_str(), "%lf %c", &write_mbps, &extra) != 1 || write_mbps <= 0) {
+            std::cerr << "Invalid write rate: " << write_rate << " (expected off, auto or MB/s)" << std::endl;
+            return 1;
+        }
+    }
+    if (write_mbps < 0 && flush_mb == 0) {
+        std::cerr << "--write-rate auto measures the bandwidth on the writeback windows, set --flush-mb" << std::endl;
+        return 1;
+    }
+    if (runtime == "coro" && write_mbps != 0) {
+        // The token bucket sleeps the writer, which would hold an executor thread
+        std::cerr << "--write-rate cannot be combined with --runtime coro" << std::endl;
+        return 1;
+    }
+
+    std::vector<int> producer_cpus;
+    if (!producer_cpus_text.empty() && !parseCpuList(producer_cpus_text, producer_cpus)) {
+        std::cerr << "Invalid producer cpu list: " << producer_cpus_text << std::endl;
+        return 1;
+    }
+    std::vector<int> consumer_cpus;
+    if (!consumer_cpus_text.empty() && !parseCpuList(consumer_cpus_text, consumer_cpus)) {
+        std::cerr << "Invalid consumer cpu list: " << consumer_cpus_text << std::endl;
+        return 1;
+    }
+    // Pinning a thread to a core outside the process's cpuset fails when it is created
+    int unavailable = firstUnavailableCpu(producer_cpus);
+    if (unavailable < 0) {
+        unavailable = firstUnavailableCpu(consumer_cpus);
+    }
+    if (unavailable >= 0) {
+        std::cerr << "Cpu " << unavailable << " is offline or outside the cpus this process may use" << std::endl;
+        return 1;
+    }
+    if (producer_priority < 0 || producer_priority > 99) {
+        std::cerr << "Producer priority must be between 0 and 99" << std::endl;
+        return 1;
+    }
+    if (runtime == "coro" && (!producer_cpus.empty() || producer_priority > 0)) {
+        std::cerr << "Under --runtime coro producers run on the executor threads, pin them with --consumer-cpus" << std::endl;
+        return 1;
+    }
+
+    std::vector<StreamConfig> streams;
+    if (!streams_file.empty() && !readStreamsFile(streams_file, streams)) {
+        return 1;
+    }
+    for (const auto& spec : stream_specs) {
+        StreamConfig stream;
+        if (!parseStreamSpec(spec, stream)) {
+            std::cerr << "Invalid stream (expected WxH@FPS): " << spec << std::endl;
+            return 1;
+        }
+        streams.push_back(stream);
+    }
+    if (streams.size() > static_cast<size_t>(StreamMux::MAX_STREAMS)) {
+        std::cerr << "At most " << StreamMux::MAX_STREAMS << " streams are supported" << std::endl;
+        return 1;
+    }
+
+    std::vector<DeriveConfig> derive;
+    for (const auto& spec : derive_specs) {
+        DeriveConfig d;
+        if (!parseDeriveSpec(spec, d)) {
+            std::cerr << "Invalid derivative (expected WxH, X,Y,WxH or X,Y,WxH@WxH): " << spec << std::endl;
+            return 1;
+        }
+        // Every crop has to fit the smallest camera it is cut from
+        const std::vector<StreamConfig> sources = streams.empty()
+            ? std::vector<StreamConfig>{ StreamConfig{ width, height, frames } } : streams;
+        for (const StreamConfig& s : sources) {
+            if (d.roiWidth > 0 && (d.roiX + d.roiWidth > s.width || d.roiY + d.roiHeight > s.height)) {
+                std::cerr << "Derivative " << spec << " does not fit a " << s.width << "x" << s.height
+                          << " stream" << std::endl;
+                return 1;
+            }
+        }
+        derive.push_back(d);
+    }
+    if (derive.size() > static_cast<size_t>(MAX_DERIVATIVES)) {
+        std::cerr << "At most " << MAX_DERIVATIVES << " derivatives are supported" << std::endl;
+        return 1;
+    }
+    if (!derive.empty() && output == "raw") {
+        std::cerr << "--derive needs the encode pipeline, which --output raw bypasses" << std::endl;
+        return 1;
+    }
+
+    Requirements req;
+    req.imageWidth = width;
+    req.imageHeight = height;
+    req.frames = frames;
+    req.num_threads = threads;
+    req.duration_minutes = minutes;
+    req.image_format = image_format;
+    req.queue_type = queue_type;
+    req.scheduler = scheduler;
+    req.content = content;
+    req.generator = generator;
+    req.kernels = kernels;
+    req.seed = static_cast<uint64_t>(seed);
+    req.gen_threads = gen_threads;
+    req.tile_rows = tile_rows;
+    req.schedule = schedule;
+    req.spin_us = spin_us;
+    req.late_policy = late_policy;
+    req.overflow = overflow;
+    req.block_timeout_ms = block_timeout_ms;
+    req.log_level = log_level;
+    req.encoders = encoders;
+    req.writers = writers;
+    req.producers = producers;
+    req.runtime = runtime;
+    req.coro_threads = coro_threads;
+    req.auto_threads = auto_threads;
+    req.warmup_s = warmup_s;
+    req.encoder = encoder;
+    req.quality = quality;
+    req.subsampling = subsampling;
+    req.png_level = png_level;
+    req.gpu_inflight = gpu_inflight;
+    req.max_mode = max_mode;
+    req.max_hold_s = max_hold_s;
+    req.stats = stats;
+    req.stats_port = stats_port;
+    req.stats_host = stats_host;
+    req.dedup = dedup;
+    req.resume = resume;
+    req.sync_ms = sync_ms;
+    req.drain_s = drain_s;
+    req.encode_queue = encode_queue;
+    req.write_queue = write_queue;
+    req.writer_backend = writer_backend;
+    req.write_batch = write_batch;
+    req.direct_io = direct_io;
+    req.output = output;
+    req.segment_mb = segment_mb;
+    req.flush_mb = flush_mb;
+    req.write_mbps = write_mbps;
+    req.producer_cpus = producer_cpus;
+    req.producer_priority = producer_priority;
+    req.consumer_cpus = consumer_cpus;
+    req.streams = streams;
+    req.derive = derive;
+
+    // SIGINT and SIGTERM are blocked in every thread and taken by sigwait on one of them, so
+    // no stage is interrupted mid-write: the first one stops the run, the second abandons the drain
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    Pipeline pipeline(req);
+    if (!pipeline.start()) {
+        return 1;
+    }
+    std::thread signals([&] {
+        for (int stops = 0;;) {
+            int sig = 0;
+            sigwait(&stopSignals, &sig);
+            if (sig == SIGUSR1) {
+                return;
+            }
+            if (stops++ == 0) {
+                std::cerr << "[Main] " << (sig == SIGINT ? "SIGINT" : "SIGTERM") << ": stopping, draining the queues";
+                if (drain_s > 0) {
+                    std::cerr << " for at most " << drain_s << " s";
+                }
+                std::cerr << " (signal again to abandon them)" << std::endl;
+            } else {
+                std::cerr << "[Main] Abandoning the queued frames" << std::endl;
+            }
+            pipeline.stop();
+        }
+    });
+    int status = pipeline.wait();
+    pthread_kill(signals.native_handle(), SIGUSR1);
+    signals.join();
+    return status;
 }
@@ -1,6 +1,156 @@
 #ifndef MODULES_H
 #define MODULES_H
 
-int main_generator(int width, int height, std::string image_format, int frames, int minutes, int num_threads);
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "modules/StatsReporter.h"
+
+/**
+ * @struct StreamConfig
+ * @brief One simulated camera: resolution and frame rate.
+ */
+struct StreamConfig {
+    int width = 1920;
+    int height = 1280;
+    int fps = 50;
+};
+
+/**
+ * @struct DeriveConfig
+ * @brief One extra output made from every generated frame: a crop, a downscale or both.
+ */
+struct DeriveConfig {
+    int roiX = 0;         ///< Crop origin in the generated frame
+    int roiY = 0;
+    int roiWidth = 0;     ///< Crop size, 0 keeps the whole frame
+    int roiHeight = 0;
+    int width = 0;        ///< Output size, 0 keeps the crop size (a zero-copy view)
+    int height = 0;
+};
+
+/**
+ * @struct Requirements
+ * @brief Configuration parameters for image generation and processing.
+ */
+struct Requirements {
+    int imageWidth = 1920;
+    int imageHeight = 1280;
+    int frames = 50;
+    int num_threads = 8;                  ///< Consumer (encoder) threads, producers and writers come on top
+    int duration_minutes = 5;
+    std::string image_format = "jpg";
+    std::string queue_type = "mutex";
+    std::string scheduler = "shared";     ///< "shared" (one queue head per stream) or "steal" (per-encoder deques)
+    std::string content = "static";
+    std::string generator = "fast";       ///< Random content generator: "fast" (SIMD, seedable) or "randu"
+    std::string kernels = "auto";         ///< Pixel loops: "auto" (fixed-profile kernels when the stream matches one) or "generic"
+    uint64_t seed = 0;                    ///< Seed of the fast generator, frame n is a function of (seed, n)
+    int gen_threads = 0;                  ///< Tile workers for the fast generator, 0 generates in the producer
+    int tile_rows = 64;                   ///< Rows per generation tile
+    std::string schedule = "absolute";   ///< "absolute" (start + n * period) or "relative" (sleep the remainder)
+    int spin_us = 0;                      ///< Busy-wait window before each deadline, absolute schedule only
+    std::string late_policy = "catchup";  ///< "catchup" or "skip" missed deadlines
+    std::string overflow = "drop-oldest"; ///< Full-queue policy: drop-oldest, drop-newest, block or adaptive
+    int block_timeout_ms = 100;           ///< Longest a push waits under the block policy
+    std::string log_level = "info";       ///< quiet, error, warn, info or debug (per-frame lines)
+    int encoders = 0;                     ///< Encoder threads, 0 means num_threads
+    int producers = 1;                    ///< Producer threads per stream, sharing its schedule
+    std::string runtime = "threads";      ///< "threads" (one thread per stage worker) or "coro" (coroutines on an executor pool)
+    int coro_threads = 0;                 ///< Executor threads of the coro runtime, 0 means one per encoder plus one
+    bool auto_threads = false;            ///< Size the active encoder pool during the warm-up
+    int warmup_s = 10;                    ///< Length of the --auto-threads warm-up
+    int writers = 1;                      ///< Writer threads, 0 writes from the encoder threads
+    int encode_queue = 100;               ///< Depth of the frame queue in front of the encoders
+    int write_queue = 32;                 ///< Depth of the encoded-frame channel in front of the writers
+    std::string writer_backend = "file";  ///< "file" (write(2)) or "uring" (io_uring, needs liburing)
+    int write_batch = 16;                 ///< Frames a writer submits at once
+    bool direct_io = false;               ///< Open output files with O_DIRECT (uring backend)
+    std::string output_dir = "../out";    ///< Directory of the frames and the journal, one per pipeline of a process
+    std::string output = "files";         ///< "files" (one per frame), "container" (segment files + index) or "raw" (mapped raw files)
+    int segment_mb = 1024;                ///< Size cap of each container segment file
+    int flush_mb = 0;                     ///< Writeback window of the file and container writers, 0 leaves it to the kernel
+    double write_mbps = 0;                ///< Token bucket rate of the writers in MB/s, 0 unlimited, -1 follows the measured bandwidth
+    std::vector<int> producer_cpus;       ///< Cores of the producers, stream i uses entry i % size; empty leaves them unpinned
+    int producer_priority = 0;            ///< SCHED_FIFO priority of the producers, 0 keeps the normal policy
+    std::vector<int> consumer_cpus;       ///< Cores of the encoders then writers, round-robin; empty leaves them unpinned
+    std::string encoder = "opencv";       ///< opencv, turbojpeg, nvjpeg (when built with them) or raw
+    int quality = 95;                     ///< JPEG quality
+    int subsampling = 420;                ///< JPEG chroma subsampling: 444, 422 or 420
+    int png_level = 1;                    ///< PNG compression level
+    int gpu_inflight = 4;                 ///< Frames each nvjpeg encoder thread keeps in flight on the GPU
+    bool max_mode = false;                ///< Ramp the rate under block backpressure to find the saturation fps
+    int max_hold_s = 5;                   ///< Seconds every --max rate is held
+    bool stats = false;                   ///< Print a JSON stats line every second
+    int stats_port = 0;                   ///< Port of the Prometheus stats endpoint, 0 disables it
+    std::string stats_host = "127.0.0.1"; ///< Address the stats endpoint binds, 0.0.0.0 for every interface
+    bool dedup = false;                   ///< Hash frames and reuse the encoding of a repeated frame
+    bool resume = false;                  ///< Continue after the last durable frame of the journal in out
+    int sync_ms = 1000;                   ///< Interval of the frame journal's sync, 0 disables the journal
+    int drain_s = 30;                     ///< Seconds the queues may take to drain once the producers stop, 0 is unbounded
+    std::vector<StreamConfig> streams;    ///< Camera streams, empty runs one imageWidth x imageHeight stream at frames fps
+    std::vector<DeriveConfig> derive;     ///< Derivatives encoded next to every frame, e.g. thumbnails
+};
+
+struct PipelineState;
+
+/**
+ * @brief One camera simulation: its streams, queues, pools, encoders, writers and counters.
+ *
+ * Every instance owns all of its state, so a process can run several pipelines at once
+ * (each with its own output_dir) or drive one from a service. start() builds the stages
+ * and starts them; wait() runs the --max / --auto-threads controllers on the calling
+ * thread if configured, waits for the run to end, prints the report and releases
+ * everything. stop() ends the run early: producers stop at their next frame and the
+ * queued frames are still saved, for at most drain_s seconds; past that, or on a second
+ * stop(), what is still queued is abandoned. Frames being written are always finished.
+ *
+ * @param config Run configuration, copied.
+ */
+class Pipeline {
+    public:
+        explicit Pipeline(const Requirements& config);
+        ~Pipeline();
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        /**
+         * @brief Sets the pipeline up and starts its threads.
+         *
+         * @return false if the run cannot start (e.g. nothing to resume), the reason is printed.
+         */
+        bool start();
+
+        /**
+         * @brief Asks the producers to stop at their next frame; safe from any thread.
+         *
+         * Called again while the queues drain, it abandons the frames still queued.
+         */
+        void stop();
+
+        /**
+         * @brief Waits for the end of the run, prints its report and tears it down.
+         *
+         * @return 0 on success.
+         */
+        int wait();
+
+        /**
+         * @brief Counters of the running pipeline, cheap enough to poll; safe from any thread.
+         *
+         * Before start() returns they are all 0. Once wait() releases the stages it returns
+         * the last sample taken before, so polling may go on during and after wait().
+         */
+        StatsSample stats() const;
+
+    private:
+        PipelineState* state;
+};
+
+/**
+ * @brief Runs one pipeline to completion, the command line's entry point.
+ */
+int main_generator(const Requirements& config);
 
 #endif
@@ -0,0 +1,140 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <cerrno>
+#include <cstdlib>
+#include <sched.h>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+/**
+ * @brief Parses a CPU list such as "2", "0-3" or "1,4-7".
+ *
+ * @return false if the text is not a valid list.
+ */
+inline bool parseCpuList(const std::string& text, std::vector<int>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(pos, end - pos);
+        char* rest = nullptr;
+        long first = std::strtol(item.c_str(), &rest, 10);
+        long last = first;
+        if (rest == item.c_str()) {
+            return false;
+        }
+        if (*rest == '-') {
+            const char* second = rest + 1;
+            last = std::strtol(second, &rest, 10);
+            if (rest == second) {
+                return false;
+            }
+        }
+        if (*rest != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            out.push_back(static_cast<int>(cpu));
+        }
+        pos = end + 1;
+    }
+    return !out.empty();
+}
+
+/**
+ * @brief First core of a list the process may not run on: offline, or outside its cpuset.
+ *
+ * @return -1 if every core is usable (or the allowed set cannot be read).
+ */
+inline int firstUnavailableCpu(const std::vector<int>& cpus) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+    for (int cpu : cpus) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Creates a thread that starts already pinned and, optionally, under SCHED_FIFO.
+ *
+ * The attributes are applied before the thread runs, so it never executes on another core.
+ * If the realtime policy is refused (no CAP_SYS_NICE / RLIMIT_RTPRIO) the thread is
+ * created with the normal policy instead.
+ *
+ * @param thread Receives the thread handle.
+ * @param fn Thread function.
+ * @param arg Thread argument.
+ * @param cpu Core to pin the thread to, -1 leaves it unpinned.
+ * @param fifoPriority SCHED_FIFO priority (1-99), 0 keeps the normal policy.
+ * @param realtime Set to whether the realtime policy was applied.
+ * @return pthread_create's result.
+ */
+inline int createThread(pthread_t* thread, void* (*fn)(void*), void* arg, int cpu, int fifoPriority, bool* realtime) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int rc;
+    if (fifoPriority > 0) {
+        sched_param param;
+        param.sched_priority = fifoPriority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        rc = pthread_create(thread, &attr, fn, arg);
+        if (rc != EPERM) {
+            *realtime = rc == 0;
+            pthread_attr_destroy(&attr);
+            return rc;
+        }
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+    }
+    *realtime = false;
+    rc = pthread_create(thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+/**
+ * @brief Pins the calling thread to one core, for threads created by a library (std::thread).
+ *
+ * @return pthread_setaffinity_np's result.
+ */
+inline int pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * @brief NUMA node of a core, -1 when unknown or built without libnuma.
+ */
+inline int numaNodeOfCpu(int cpu) {
+#ifdef HAVE_LIBNUMA
+    if (cpu >= 0 && numa_available() >= 0) {
+        return numa_node_of_cpu(cpu);
+    }
+#endif
+    return -1;
+}
+
+#endif
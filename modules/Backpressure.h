@@ -0,0 +1,103 @@
+#ifndef BACKPRESSURE_H
+#define BACKPRESSURE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief What a FrameQueue does when the producer pushes into a full queue.
+ */
+enum class OverflowPolicy {
+    DropOldest, ///< Evict the oldest queued frame and enqueue the new one.
+    DropNewest, ///< Keep the queue as is and discard the new frame.
+    Block,      ///< Wait up to the block timeout for a free slot, then discard the new frame.
+    Adaptive    ///< Drop-oldest on a full queue, consumers lower quality while the queue is filling up.
+};
+
+/**
+ * @brief Parses an --overflow value.
+ *
+ * @return false if the name is unknown.
+ */
+inline bool parseOverflowPolicy(const std::string& name, OverflowPolicy& out) {
+    if (name == "drop-oldest") {
+        out = OverflowPolicy::DropOldest;
+    } else if (name == "drop-newest") {
+        out = OverflowPolicy::DropNewest;
+    } else if (name == "block") {
+        out = OverflowPolicy::Block;
+    } else if (name == "adaptive") {
+        out = OverflowPolicy::Adaptive;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @struct OverflowStats
+ * @brief Per-policy counters of what happened to frames pushed into a full queue.
+ */
+struct OverflowStats {
+    std::atomic<int> droppedOldest{0};   ///< Queued frames evicted to make room (drop-oldest, adaptive).
+    std::atomic<int> droppedNewest{0};   ///< New frames discarded (drop-newest).
+    std::atomic<int> blockedPushes{0};   ///< Pushes that had to wait for a slot (block).
+    std::atomic<int> blockTimeouts{0};   ///< Blocked pushes that gave up and discarded the frame (block).
+    std::atomic<int64_t> blockedNs{0};   ///< Total time the producer spent blocked (block).
+
+    int total() const {
+        return droppedOldest.load(std::memory_order_relaxed)
+             + droppedNewest.load(std::memory_order_relaxed)
+             + blockTimeouts.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Quality controller for the adaptive overflow policy.
+ *
+ * Consumers report the queue fill ratio before saving a frame; the level goes up one step
+ * when the queue is above the high watermark and back down once it drained below the low
+ * watermark, so quality does not flap around a single threshold. The write pressure of
+ * the WritePacer counts as a fill ratio too, so a disk falling behind lowers the quality
+ * before the queues fill up.
+ *
+ * Level 0 saves frames untouched, level 1 lowers JPEG quality / PNG compression effort and
+ * level 2 also halves the frame size.
+ */
+class AdaptiveQuality {
+    public:
+        static const int MAX_LEVEL = 2;
+
+        AdaptiveQuality(double high = 0.75, double low = 0.25) : high(high), low(low) {}
+
+        int update(size_t queued, size_t capacity, double pressure = 0.0) {
+            double fill = std::max(capacity ? static_cast<double>(queued) / capacity : 0.0, pressure);
+            int current = level.load(std::memory_order_relaxed);
+            if (fill >= high && current < MAX_LEVEL) {
+                level.compare_exchange_strong(current, current + 1, std::memory_order_relaxed);
+            } else if (fill <= low && current > 0) {
+                level.compare_exchange_strong(current, current - 1, std::memory_order_relaxed);
+            }
+            int now = level.load(std::memory_order_relaxed);
+            if (now > 0) {
+                degraded[now].fetch_add(1, std::memory_order_relaxed);
+            }
+            return now;
+        }
+
+        int getDegradedFrames(int lvl) const {
+            return degraded[lvl].load(std::memory_order_relaxed);
+        }
+
+    private:
+        double high;
+        double low;
+        std::atomic<int> level{0};
+        std::atomic<int> degraded[MAX_LEVEL + 1] = {};
+};
+
+#endif
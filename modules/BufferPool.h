@@ -0,0 +1,74 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "RingBuffer.h"
+
+/**
+ * @brief Recycled output buffers of the encoder stage.
+ *
+ * Every buffer is reserved up front at the worst-case encoded size, so encoding into it
+ * never reallocates. Buffers travel by move (encoder -> channel -> writer, no copy and
+ * no allocation) and the writer hands them back after the write. The free list is a
+ * lock-free RingBuffer of the vectors themselves. Reserved pages that are never written
+ * are not resident, so the worst-case sizing does not cost RSS.
+ *
+ * @param count Number of buffers, at least what can be in flight between encoders and writers.
+ * @param bufferBytes Reserved size of every buffer.
+ */
+class BufferPool {
+    public:
+        BufferPool(int count, size_t bufferBytes) : freeBuffers(count), bufferBytes(bufferBytes) {
+            for (int i = 0; i < count; ++i) {
+                std::vector<uchar> buf;
+                buf.reserve(bufferBytes);
+                freeBuffers.tryPush(std::move(buf));
+            }
+        }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        /**
+         * @brief Replaces out with an empty buffer of the pool.
+         *
+         * If the pool is dry a new buffer is reserved and counted, it joins the pool when
+         * released and there is room.
+         */
+        void acquire(std::vector<uchar>& out) {
+            if (!freeBuffers.tryPop(out)) {
+                exhausted.fetch_add(1, std::memory_order_relaxed);
+                out = std::vector<uchar>();
+                out.reserve(bufferBytes);
+            }
+            out.clear();
+        }
+
+        /**
+         * @brief Gives a buffer back, leaving buf empty.
+         */
+        void release(std::vector<uchar>& buf) {
+            if (buf.capacity() == 0) {
+                return;
+            }
+            buf.clear();
+            if (!freeBuffers.tryPush(std::move(buf))) {
+                std::vector<uchar>().swap(buf); // Pool full, this one was an extra
+            }
+        }
+
+        int getExhaustedCount() const {
+            return exhausted.load(std::memory_order_relaxed);
+        }
+
+    private:
+        RingBuffer<std::vector<uchar>> freeBuffers;
+        size_t bufferBytes;
+        std::atomic<int> exhausted{0};
+};
+
+#endif
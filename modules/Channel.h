@@ -0,0 +1,116 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "RingBuffer.h"
+
+/**
+ * @brief Bounded blocking MPMC channel between two pipeline stages.
+ *
+ * Unlike FrameQueue it never drops: a full channel blocks the upstream stage, so the
+ * overflow policy of the frame queue is what eventually absorbs a slow downstream stage.
+ * Both directions sleep on std::atomic::wait (futex) and only wake when someone waits.
+ *
+ * @param capacity Channel depth, rounded up to the next power of two.
+ */
+template <typename T>
+class Channel {
+    public:
+        explicit Channel(size_t capacity) : ring(capacity) {}
+
+        /**
+         * @brief Enqueues an item, waiting while the channel is full.
+         *
+         * @return false if the channel was closed before the item could be queued.
+         */
+        bool push(T&& value) {
+            for (;;) {
+                if (ring.tryPush(std::move(value))) {
+                    signal(itemEpoch, itemWaiters);
+                    return true;
+                }
+                if (closed.load(std::memory_order_acquire)) {
+                    return false;
+                }
+                wait(spaceEpoch, spaceWaiters, [&] { return ring.size() < ring.capacity(); });
+            }
+        }
+
+        /**
+         * @brief Dequeues an item, waiting while the channel is empty.
+         *
+         * @return false once the channel is closed and drained.
+         */
+        bool pop(T& out) {
+            for (;;) {
+                if (ring.tryPop(out)) {
+                    signal(spaceEpoch, spaceWaiters);
+                    return true;
+                }
+                if (closed.load(std::memory_order_acquire)) {
+                    return ring.tryPop(out);
+                }
+                wait(itemEpoch, itemWaiters, [&] { return ring.size() > 0; });
+            }
+        }
+
+        /**
+         * @brief Dequeues an item only if one is ready, used to fill up a batch.
+         */
+        bool tryPop(T& out) {
+            if (ring.tryPop(out)) {
+                signal(spaceEpoch, spaceWaiters);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Ends the stream: pending items can still be popped, waiters are released.
+         */
+        void close() {
+            closed.store(true, std::memory_order_release);
+            itemEpoch.fetch_add(1, std::memory_order_seq_cst);
+            itemEpoch.notify_all();
+            spaceEpoch.fetch_add(1, std::memory_order_seq_cst);
+            spaceEpoch.notify_all();
+        }
+
+        size_t size() const {
+            return ring.size();
+        }
+
+        size_t capacity() const {
+            return ring.capacity();
+        }
+
+    private:
+        static void signal(std::atomic<uint32_t>& epoch, std::atomic<int>& waiters) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (waiters.load(std::memory_order_seq_cst) > 0) {
+                epoch.notify_one();
+            }
+        }
+
+        template <typename Ready>
+        void wait(std::atomic<uint32_t>& epoch, std::atomic<int>& waiters, Ready ready) {
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t seen = epoch.load(std::memory_order_seq_cst);
+            if (!ready() && !closed.load(std::memory_order_acquire)) {
+                epoch.wait(seen, std::memory_order_seq_cst);
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        RingBuffer<T> ring;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> itemEpoch{0};
+        std::atomic<int> itemWaiters{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> spaceEpoch{0};
+        std::atomic<int> spaceWaiters{0};
+        std::atomic<bool> closed{false};
+};
+
+#endif
@@ -0,0 +1,417 @@
+#ifndef CONTAINER_SINK_H
+#define CONTAINER_SINK_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FrameData.h"
+#include "FrameSink.h"
+
+/**
+ * @struct ContainerIndexHeader
+ * @brief First bytes of frames.idx: magic, format and segment size.
+ */
+struct ContainerIndexHeader {
+    char magic[8];          ///< "FPSIDX1"
+    char ext[8];            ///< Image format extension, without the dot
+    uint64_t segmentBytes;  ///< Size cap of every segment file
+    uint64_t reserved;
+};
+
+/**
+ * @struct ContainerIndexRecord
+ * @brief One frame stored in a segment file, 32 bytes.
+ *
+ * id and stream used to be a single 64-bit id; on little-endian hosts single-stream
+ * indexes read the same either way.
+ */
+struct ContainerIndexRecord {
+    int32_t id;         ///< Frame id
+    uint32_t stream;    ///< Camera stream of the frame, and its derivative in the high 16 bits (packStream())
+    int64_t timestamp;  ///< Capture time, ns since the Unix epoch
+    uint64_t offset;    ///< Byte offset inside the segment file
+    uint32_t length;    ///< Encoded length, the bytes imwrite would have written
+    uint32_t segment;   ///< Segment number, segment_<n>.bin
+};
+
+/**
+ * @brief Appends encoded frames to rolling segment files instead of one file per frame.
+ *
+ * Writers reserve space under a short lock and then pwrite outside of it, so they still
+ * write in parallel. A frame never spans two segments: a new segment is started when the
+ * next frame would go past the size cap. Every frame that reached its segment gets a
+ * ContainerIndexRecord in frames.idx (buffered, written in blocks), so extractContainer()
+ * can restore the exact per-frame files. A duplicate frame (--dedup) of the last frame stored
+ * for its stream is not written again: its record points at the bytes already in a segment.
+ *
+ * Only the current segment and the ones writers are still filling stay open. A segment that
+ * was rolled past is closed as soon as its last write is in, or with deferClose by the next
+ * sync(), after its fdatasync.
+ *
+ * @param dir Output directory, receives segment_<n>.bin and frames.idx.
+ * @param ext Image format extension, recorded in the index header.
+ * @param segmentBytes Size cap of each segment file.
+ * @param append Continue the index and the segment numbering of a previous run (--resume)
+ *        instead of starting over; the new frames go to fresh segments.
+ * @param deferClose Leave complete segments to sync() instead of closing them at once.
+ */
+class ContainerSink : public FrameSink {
+    public:
+        static const size_t INDEX_FLUSH_RECORDS = 2048;
+
+        ContainerSink(const std::string& dir, const std::string& ext, uint64_t segmentBytes, bool append = false,
+                      bool deferClose = false)
+            : dir(dir), segmentBytes(segmentBytes), deferClose(deferClose) {
+            std::string indexPath = dir + "/frames.idx";
+            indexFd = ::open(indexPath.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC) | O_CLOEXEC, 0644);
+            pending.reserve(INDEX_FLUSH_RECORDS);
+            if (append && indexFd >= 0 && reopenIndex()) {
+                return;
+            }
+            ContainerIndexHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "FPSIDX1", 8);
+            std::strncpy(header.ext, ext.c_str(), sizeof(header.ext) - 1);
+            header.segmentBytes = segmentBytes;
+            if (indexFd >= 0) {
+                FileSink::writeAll(indexFd, &header, sizeof(header));
+            }
+        }
+
+        ~ContainerSink() {
+            flush();
+            for (const Segment& seg : segments) {
+                ::close(seg.fd);
+            }
+            if (indexFd >= 0) {
+                ::close(indexFd);
+            }
+        }
+
+        bool write(const encoded_frame& frame) override {
+            if (indexFd < 0) {
+                return false;
+            }
+            ContainerIndexRecord rec;
+            rec.id = frame.id;
+            rec.stream = packStream(frame.stream, frame.derivative);
+            rec.timestamp = frame.timestamp;
+            rec.length = static_cast<uint32_t>(frame.bytes.size());
+            int fd;
+            int idle = -1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const int key = frame.stream * (MAX_DERIVATIVES + 1) + frame.derivative;
+                if (frame.duplicate && key < static_cast<int>(references.size())) {
+                    const Reference& ref = references[key];
+                    if (ref.valid && ref.hash == frame.hash && ref.length == rec.length) {
+                        rec.segment = ref.segment;
+                        rec.offset = ref.offset;
+                        pending.push_back(rec);
+                        if (pending.size() >= INDEX_FLUSH_RECORDS) {
+                            writeIndex();
+                        }
+                        referenceRecords++;
+                        return true;
+                    }
+                }
+                if (segments.empty() || (offset > 0 && offset + rec.length > segmentBytes)) {
+                    if (!openSegment()) {
+                        return false;
+                    }
+                    if (segments.size() > 1) {
+                        idle = takeIdle(segments.size() - 2);
+                    }
+                }
+                Segment& seg = segments.back();
+                seg.writers++;
+                fd = seg.fd;
+                rec.segment = seg.number;
+                rec.offset = offset;
+                offset += rec.length;
+            }
+            retire(idle);
+
+            const bool ok = pwriteAll(fd, frame.bytes.data(), frame.bytes.size(), rec.offset);
+            if (ok && pacer != nullptr) {
+                pacer->written(fd, static_cast<off_t>(rec.offset), frame.bytes.size(), false);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (size_t i = 0; i < segments.size(); i++) {
+                    if (segments[i].number == rec.segment) {
+                        segments[i].writers--;
+                        idle = takeIdle(i);
+                        break;
+                    }
+                }
+            }
+            retire(idle);
+            if (!ok) {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(rec);
+            if (pending.size() >= INDEX_FLUSH_RECORDS) {
+                writeIndex();
+            }
+            bytesWritten += rec.length;
+            if (frame.hash != 0) {
+                const int key = frame.stream * (MAX_DERIVATIVES + 1) + frame.derivative;
+                if (key >= static_cast<int>(references.size())) {
+                    references.resize(key + 1);
+                }
+                references[key] = Reference{ frame.hash, rec.length, rec.segment, rec.offset, true };
+            }
+            return true;
+        }
+
+        void flush() override {
+            if (pacer != nullptr) {
+                pacer->drain();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            writeIndex();
+        }
+
+        /**
+         * @brief Writes the buffered index records, then fdatasyncs the open segments and the
+         * index, and closes the segments that are complete.
+         */
+        bool sync() override {
+            std::vector<int> dirty;
+            std::vector<int> complete;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writeIndex();
+                for (size_t i = 0; i < segments.size();) {
+                    if (i + 1 < segments.size() && segments[i].writers == 0) {
+                        complete.push_back(segments[i].fd);
+                        segments.erase(segments.begin() + i);
+                    } else {
+                        dirty.push_back(segments[i].fd);
+                        i++;
+                    }
+                }
+            }
+            bool ok = indexFd >= 0;
+            for (int fd : dirty) {
+                ok = ::fdatasync(fd) == 0 && ok;
+            }
+            for (int fd : complete) {
+                ok = ::fdatasync(fd) == 0 && ok;
+                retire(fd);
+            }
+            return ok && ::fdatasync(indexFd) == 0;
+        }
+
+        void report(std::ostream& out) override {
+            out << "[Main] Container: " << bytesWritten / (1024 * 1024) << " MB in "
+                << segmentsOpened << " segment files, index " << dir << "/frames.idx";
+            if (referenceRecords > 0) {
+                out << ", " << referenceRecords << " duplicate frames stored as references";
+            }
+            out << "\n";
+        }
+
+    private:
+        /**
+         * @struct Segment
+         * @brief An open segment file.
+         */
+        struct Segment {
+            int fd;
+            uint32_t number;  ///< segment_<number>.bin
+            int writers;      ///< Writes reserved in it and not finished yet
+        };
+
+        /**
+         * @struct Reference
+         * @brief Where the last frame stored for a stream is, for duplicates to point at.
+         */
+        struct Reference {
+            uint64_t hash = 0;
+            uint32_t length = 0;
+            uint32_t segment = 0;
+            uint64_t offset = 0;
+            bool valid = false;
+        };
+
+        /**
+         * @brief Keeps an existing index, cut after its last whole record, and numbers the new
+         * segments after the segment files already in dir.
+         *
+         * @return false if there is no index header to continue, a new index is started then.
+         */
+        bool reopenIndex() {
+            off_t size = ::lseek(indexFd, 0, SEEK_END);
+            off_t whole = size < static_cast<off_t>(sizeof(ContainerIndexHeader)) ? 0 : sizeof(ContainerIndexHeader) +
+                          (size - sizeof(ContainerIndexHeader)) / sizeof(ContainerIndexRecord) * sizeof(ContainerIndexRecord);
+            if (whole == 0 || ::ftruncate(indexFd, whole) != 0 || ::lseek(indexFd, whole, SEEK_SET) != whole) {
+                // Nothing to continue, the caller writes a new header at the start
+                if (::ftruncate(indexFd, 0) == 0) {
+                    ::lseek(indexFd, 0, SEEK_SET);
+                }
+                return false;
+            }
+            for (;;) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/segment_%05zu.bin", segmentBase);
+                if (::access((dir + name).c_str(), F_OK) != 0) {
+                    break;
+                }
+                segmentBase++;
+            }
+            return true;
+        }
+
+        bool openSegment() {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/segment_%05zu.bin", segmentBase + segmentsOpened);
+            std::string path = dir + name;
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return false;
+            }
+            segments.push_back(Segment{ fd, static_cast<uint32_t>(segmentBase + segmentsOpened), 0 });
+            segmentsOpened++;
+            offset = 0;
+            return true;
+        }
+
+        /**
+         * @brief Takes segment i out of the open ones if it was rolled past and no write to it
+         * is left, unless sync() closes the complete segments. Called under the lock.
+         *
+         * @return Its fd for retire(), -1 if it stays open.
+         */
+        int takeIdle(size_t i) {
+            if (deferClose || i + 1 >= segments.size() || segments[i].writers > 0) {
+                return -1;
+            }
+            const int fd = segments[i].fd;
+            segments.erase(segments.begin() + static_cast<std::ptrdiff_t>(i));
+            return fd;
+        }
+
+        /**
+         * @brief Closes a complete segment; outside the lock, the pacer may wait on its writeback.
+         */
+        void retire(int fd) {
+            if (fd < 0) {
+                return;
+            }
+            if (pacer != nullptr && pacer->windowed()) {
+                // A range of length 0 runs to the end of the file; the pacer may still hold
+                // ranges of fd, so it closes it after their writeback
+                pacer->written(fd, 0, 0, true);
+            } else {
+                ::close(fd);
+            }
+        }
+
+        void writeIndex() {
+            if (!pending.empty() && indexFd >= 0) {
+                FileSink::writeAll(indexFd, pending.data(), pending.size() * sizeof(ContainerIndexRecord));
+                pending.clear();
+            }
+        }
+
+        static bool pwriteAll(int fd, const void* data, size_t len, uint64_t at) {
+            const char* p = static_cast<const char*>(data);
+            while (len > 0) {
+                ssize_t n = ::pwrite(fd, p, len, static_cast<off_t>(at));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                p += n;
+                at += static_cast<uint64_t>(n);
+                len -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        std::string dir;
+        uint64_t segmentBytes;
+        int indexFd = -1;
+        std::mutex mutex;
+        bool deferClose;
+        std::vector<Segment> segments;  ///< Open segments, the last one is being filled
+        size_t segmentBase = 0;         ///< Number of the first segment of this run
+        size_t segmentsOpened = 0;
+        uint64_t offset = 0;
+        uint64_t bytesWritten = 0;
+        std::vector<ContainerIndexRecord> pending;
+        std::vector<Reference> references;  ///< Per stream and derivative
+        int64_t referenceRecords = 0;
+};
+
+/**
+ * @brief Rebuilds the per-frame files of a container run.
+ *
+ * Reads dir/frames.idx and writes every frame to frameFilePath(), byte
+ * for byte what the files output mode would have produced.
+ *
+ * @return Number of frames extracted, -1 if the index cannot be read.
+ */
+inline int extractContainer(const std::string& dir) {
+    std::string indexPath = dir + "/frames.idx";
+    FILE* index = std::fopen(indexPath.c_str(), "rb");
+    if (index == nullptr) {
+        return -1;
+    }
+    ContainerIndexHeader header;
+    if (std::fread(&header, sizeof(header), 1, index) != 1 || std::memcmp(header.magic, "FPSIDX1", 8) != 0) {
+        std::fclose(index);
+        return -1;
+    }
+    header.ext[sizeof(header.ext) - 1] = '\0';
+
+    std::vector<int> segments;
+    std::vector<uchar> buf;
+    ContainerIndexRecord rec;
+    int count = 0;
+    while (std::fread(&rec, sizeof(rec), 1, index) == 1) {
+        while (segments.size() <= rec.segment) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/segment_%05zu.bin", segments.size());
+            segments.push_back(::open((dir + name).c_str(), O_RDONLY | O_CLOEXEC));
+        }
+        int fd = segments[rec.segment];
+        buf.resize(rec.length);
+        if (fd < 0 || ::pread(fd, buf.data(), rec.length, static_cast<off_t>(rec.offset)) != static_cast<ssize_t>(rec.length)) {
+            continue;
+        }
+        encoded_frame frame;
+        frame.id = rec.id;
+        frame.stream = static_cast<int>(rec.stream & 0xFFFF);
+        frame.derivative = static_cast<int>(rec.stream >> 16);
+        frame.bytes.swap(buf);
+        if (FileSink(dir, header.ext).write(frame)) {
+            count++;
+        }
+        buf.swap(frame.bytes);
+    }
+    for (int fd : segments) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    std::fclose(index);
+    return count;
+}
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef CORO_RUNTIME_H
+#define CORO_RUNTIME_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Minimal C++20 coroutine runtime of the --runtime coro pipeline.
+ *
+ * Stages are coroutines multiplexed on a small pool of executor threads: a coroutine that
+ * waits for a deadline, a frame or room in a channel suspends instead of blocking, and its
+ * thread resumes another one. A stage's concurrency limit is simply how many of its
+ * coroutines are spawned.
+ */
+namespace coro {
+
+/**
+ * @brief Fixed pool of threads resuming ready coroutines, plus a timer heap.
+ *
+ * Ready handles go to one FIFO deque under a mutex. Timers are served by whichever worker
+ * is idle: it sleeps until the earliest deadline, so waiting for a frame deadline costs no
+ * thread of its own, and an expired timer is resumed before any ready coroutine.
+ *
+ * @param threads Worker threads.
+ * @param onStart Called by every worker with its index before it resumes anything, e.g. to pin it.
+ */
+class Executor {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        Executor(int threads, std::function<void(int)> onStart = nullptr) {
+            for (int i = 0; i < threads; ++i) {
+                workers.emplace_back([this, i, onStart] {
+                    if (onStart) {
+                        onStart(i);
+                    }
+                    run();
+                });
+            }
+        }
+
+        ~Executor() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& t : workers) {
+                t.join();
+            }
+        }
+
+        Executor(const Executor&) = delete;
+        Executor& operator=(const Executor&) = delete;
+
+        /**
+         * @brief Queues a suspended coroutine to be resumed by a worker.
+         */
+        void schedule(std::coroutine_handle<> h) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(h);
+            }
+            wake.notify_one();
+        }
+
+        /**
+         * @brief Awaitable that resumes the coroutine on a worker once the deadline has passed.
+         *
+         * A deadline already in the past does not suspend at all.
+         */
+        struct TimerAwaiter {
+            Executor& ex;
+            Clock::time_point deadline;
+
+            bool await_ready() const noexcept {
+                return Clock::now() >= deadline;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                ex.addTimer(deadline, h);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        template <typename TimePoint>
+        TimerAwaiter resumeAt(TimePoint deadline) {
+            return TimerAwaiter{ *this, std::chrono::time_point_cast<Clock::duration>(deadline) };
+        }
+
+        /**
+         * @brief Awaitable that moves the coroutine to the back of the ready queue.
+         */
+        struct YieldAwaiter {
+            Executor& ex;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                ex.schedule(h);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        YieldAwaiter yield() {
+            return YieldAwaiter{ *this };
+        }
+
+        int threads() const {
+            return static_cast<int>(workers.size());
+        }
+
+        /**
+         * @brief Coroutines resumed so far, every start and every wake-up.
+         */
+        int64_t getResumes() const {
+            return resumes.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Timer {
+            Clock::time_point deadline;
+            std::coroutine_handle<> h;
+
+            bool operator>(const Timer& other) const {
+                return deadline > other.deadline;
+            }
+        };
+
+        void addTimer(Clock::time_point deadline, std::coroutine_handle<> h) {
+            bool earliest;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                earliest = timers.empty() || deadline < timers.top().deadline;
+                timers.push(Timer{ deadline, h });
+            }
+            // A sleeping worker may be waiting for a later deadline
+            if (earliest) {
+                wake.notify_one();
+            }
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                // A coroutine whose deadline has passed goes before the ready queue
+                std::coroutine_handle<> h;
+                if (!timers.empty() && timers.top().deadline <= Clock::now()) {
+                    h = timers.top().h;
+                    timers.pop();
+                } else if (!ready.empty()) {
+                    h = ready.front();
+                    ready.pop_front();
+                }
+                if (h) {
+                    // Hand the rest to another worker while this one is busy; idle ones already sleep until the next timer
+                    const bool more = !ready.empty();
+                    lock.unlock();
+                    if (more) {
+                        wake.notify_one();
+                    }
+                    resumes.fetch_add(1, std::memory_order_relaxed);
+                    h.resume();
+                    lock.lock();
+                    continue;
+                }
+                if (stopping) {
+                    return;
+                }
+                if (timers.empty()) {
+                    wake.wait(lock);
+                } else {
+                    wake.wait_until(lock, timers.top().deadline);
+                }
+            }
+        }
+
+        std::mutex mutex;  ///< Guards ready, timers and stopping
+        std::condition_variable wake;
+        std::deque<std::coroutine_handle<>> ready;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+        bool stopping = false;
+        std::atomic<int64_t> resumes{0};
+        std::vector<std::thread> workers;
+};
+
+/**
+ * @brief Counts the running tasks of a pipeline so a plain thread can wait for all of them.
+ */
+class TaskGroup {
+    public:
+        void add() {
+            std::lock_guard<std::mutex> lock(mutex);
+            running++;
+        }
+
+        void done() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) {
+                idle.notify_all();
+            }
+        }
+
+        /**
+         * @brief Blocks the calling thread, never an executor worker, until every task has finished.
+         */
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [this] { return running == 0; });
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable idle;
+        int running = 0;
+};
+
+/**
+ * @brief Fire-and-forget coroutine; spawn() starts it on an executor inside a group.
+ *
+ * The frame destroys itself when the body returns and then tells the group. Exceptions are
+ * not propagated: a stage that throws terminates the program, like an exception escaping a
+ * pthread start routine.
+ */
+class Task {
+    public:
+        struct promise_type {
+            TaskGroup* group = nullptr;
+
+            Task get_return_object() {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    TaskGroup* group = h.promise().group;
+                    h.destroy();
+                    if (group != nullptr) {
+                        group->done();
+                    }
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            FinalAwaiter final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        /**
+         * @brief Schedules the task's first resume; the group owns it from now on.
+         */
+        void spawn(Executor& ex, TaskGroup& group) {
+            handle.promise().group = &group;
+            group.add();
+            ex.schedule(std::exchange(handle, nullptr));
+        }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Bounded MPMC channel whose push and pop suspend the coroutine instead of a thread.
+ *
+ * A pop waiting on an empty channel gets the next pushed item directly, and a push waiting
+ * on a full one is completed by the pop that makes room, so a waiter is only rescheduled
+ * once its operation is done. tryPush()/tryPop() never suspend.
+ *
+ * @param capacity Items buffered before push() suspends.
+ */
+template <typename T>
+class AsyncChannel {
+    public:
+        AsyncChannel(Executor& ex, size_t capacity) : ex(ex), cap(capacity > 0 ? capacity : 1) {}
+
+        AsyncChannel(const AsyncChannel&) = delete;
+        AsyncChannel& operator=(const AsyncChannel&) = delete;
+
+        /**
+         * @brief Awaitable push; the item is only moved from when it is accepted.
+         *
+         * co_await yields false if the channel was closed, the caller still owns the item.
+         */
+        struct PushAwaiter {
+            AsyncChannel& ch;
+            T* value;
+            std::coroutine_handle<> h;
+            bool ok = false;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                h = handle;
+                std::lock_guard<std::mutex> lock(ch.mutex);
+                if (ch.closed) {
+                    ok = false;
+                    return false;
+                }
+                if (ch.items.size() < ch.cap) {
+                    ch.items.push_back(std::move(*value));
+                    ch.feedPopper();
+                    ok = true;
+                    return false;
+                }
+                ch.pushers.push_back(this);
+                return true;  // Not touched again here, the pop that takes it resumes it
+            }
+
+            bool await_resume() const noexcept {
+                return ok;
+            }
+        };
+
+        /**
+         * @brief Awaitable pop; co_await yields false once the channel is closed and drained.
+         */
+        struct PopAwaiter {
+            AsyncChannel& ch;
+            T* out;
+            std::coroutine_handle<> h;
+            bool ok = false;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                h = handle;
+                std::lock_guard<std::mutex> lock(ch.mutex);
+                if (!ch.items.empty()) {
+                    *out = std::move(ch.items.front());
+                    ch.items.pop_front();
+                    ch.admitPusher();
+                    ok = true;
+                    return false;
+                }
+                if (ch.closed) {
+                    ok = false;
+                    return false;
+                }
+                ch.poppers.push_back(this);
+                return true;
+            }
+
+            bool await_resume() const noexcept {
+                return ok;
+            }
+        };
+
+        PushAwaiter push(T& value) {
+            return PushAwaiter{ *this, &value, nullptr };
+        }
+
+        PopAwaiter pop(T& out) {
+            return PopAwaiter{ *this, &out, nullptr };
+        }
+
+        bool tryPop(T& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (items.empty()) {
+                return false;
+            }
+            out = std::move(items.front());
+            items.pop_front();
+            admitPusher();
+            return true;
+        }
+
+        /**
+         * @brief Refuses further pushes; waiting pops get false once the items are drained.
+         */
+        void close() {
+            std::vector<std::coroutine_handle<>> resume;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+                for (PushAwaiter* p : pushers) {
+                    p->ok = false;
+                    resume.push_back(p->h);
+                }
+                pushers.clear();
+                // Poppers only wait on an empty channel, there is nothing left for them
+                for (PopAwaiter* p : poppers) {
+                    p->ok = false;
+                    resume.push_back(p->h);
+                }
+                poppers.clear();
+            }
+            for (std::coroutine_handle<> h : resume) {
+                ex.schedule(h);
+            }
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return items.size();
+        }
+
+        size_t capacity() const {
+            return cap;
+        }
+
+    private:
+        /**
+         * @brief Hands the newest item to a waiting pop, under the lock.
+         */
+        void feedPopper() {
+            if (poppers.empty()) {
+                return;
+            }
+            PopAwaiter* p = poppers.front();
+            poppers.pop_front();
+            *p->out = std::move(items.front());
+            items.pop_front();
+            p->ok = true;
+            ex.schedule(p->h);
+        }
+
+        /**
+         * @brief Moves a waiting push into the room just made, under the lock.
+         */
+        void admitPusher() {
+            if (pushers.empty()) {
+                return;
+            }
+            PushAwaiter* p = pushers.front();
+            pushers.pop_front();
+            items.push_back(std::move(*p->value));
+            p->ok = true;
+            ex.schedule(p->h);
+        }
+
+        Executor& ex;
+        const size_t cap;
+        mutable std::mutex mutex;  ///< Guards items, the waiter lists and closed
+        std::deque<T> items;
+        std::deque<PushAwaiter*> pushers;
+        std::deque<PopAwaiter*> poppers;
+        bool closed = false;
+};
+
+/**
+ * @brief Epoch event for coroutines polling an external source, e.g. the StreamMux.
+ *
+ * A consumer reads epoch(), tries its source, and if that came up empty awaits wait(seen),
+ * which only suspends while no notification happened since seen. Notifiers bump the epoch
+ * and only take the lock when a coroutine is actually waiting, the same handshake as the
+ * mux's futex.
+ */
+class AsyncEvent {
+    public:
+        explicit AsyncEvent(Executor& ex) : ex(ex) {}
+
+        uint64_t epoch() const {
+            return counter.load(std::memory_order_seq_cst);
+        }
+
+        struct WaitAwaiter {
+            AsyncEvent& ev;
+            uint64_t seen;
+
+            bool await_ready() const noexcept {
+                return ev.epoch() != seen;
+            }
+
+            bool await_suspend(std::coroutine_handle<> h) {
+                std::lock_guard<std::mutex> lock(ev.mutex);
+                ev.waiting.fetch_add(1, std::memory_order_seq_cst);
+                if (ev.counter.load(std::memory_order_seq_cst) != seen) {
+                    ev.waiting.fetch_sub(1, std::memory_order_relaxed);
+                    return false;
+                }
+                ev.waiters.push_back(h);
+                return true;
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        WaitAwaiter wait(uint64_t seen) {
+            return WaitAwaiter{ *this, seen };
+        }
+
+        void notifyOne() {
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_seq_cst) > 0) {
+                wakeWaiters(1);
+            }
+        }
+
+        void notifyAll() {
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_seq_cst) > 0) {
+                wakeWaiters(SIZE_MAX);
+            }
+        }
+
+    private:
+        void wakeWaiters(size_t count) {
+            std::vector<std::coroutine_handle<>> resume;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (count-- > 0 && !waiters.empty()) {
+                    resume.push_back(waiters.front());
+                    waiters.pop_front();
+                    waiting.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+            for (std::coroutine_handle<> h : resume) {
+                ex.schedule(h);
+            }
+        }
+
+        Executor& ex;
+        std::atomic<uint64_t> counter{0};
+        std::atomic<int> waiting{0};
+        std::mutex mutex;  ///< Guards waiters
+        std::deque<std::coroutine_handle<>> waiters;
+};
+
+}
+
+#endif
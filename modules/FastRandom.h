@@ -0,0 +1,332 @@
+#ifndef FAST_RANDOM_H
+#define FAST_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FAST_RANDOM_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FAST_RANDOM_NEON 1
+#endif
+
+/**
+ * @brief Counter-based pixel generator used in place of cv::randu for per-frame content.
+ *
+ * Word i of a frame is a pure function of (key, i): two rounds of the lowbias32 integer
+ * hash over the word counter. Every lane is independent, so the same bytes come out of
+ * the scalar, AVX2, AVX-512 and NEON loops, of any split of the frame into tiles, and of
+ * every run with the same seed. The widest instruction set supported by the CPU is picked
+ * once at startup.
+ */
+namespace fastrandom {
+
+/**
+ * @struct Key
+ * @brief Per-frame key, derived from the run seed and the frame id.
+ */
+struct Key {
+    uint32_t k0;
+    uint32_t k1;
+};
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+inline Key frameKey(uint64_t seed, uint64_t frameId) {
+    uint64_t h = splitmix64(seed ^ splitmix64(frameId));
+    return Key{ static_cast<uint32_t>(h), static_cast<uint32_t>(h >> 32) };
+}
+
+inline uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t word(Key key, uint32_t counter) {
+    return mix32(mix32(counter ^ key.k0) + key.k1);
+}
+
+inline void fillScalar(uint8_t* dst, size_t words, Key key, uint32_t first) {
+    for (size_t i = 0; i < words; ++i) {
+        uint32_t w = word(key, first + static_cast<uint32_t>(i));
+        std::memcpy(dst + 4 * i, &w, 4);
+    }
+}
+
+#ifdef FAST_RANDOM_X86
+__attribute__((target("avx2")))
+inline __m256i mix32Avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(0x846ca68bU)));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx2")))
+inline void fillAvx2(uint8_t* dst, size_t words, Key key, uint32_t first) {
+    const __m256i k0 = _mm256_set1_epi32(static_cast<int>(key.k0));
+    const __m256i k1 = _mm256_set1_epi32(static_cast<int>(key.k1));
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i counter = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)),
+                                       _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t i = 0;
+    for (; i + 8 <= words; i += 8) {
+        __m256i x = mix32Avx2(_mm256_xor_si256(counter, k0));
+        x = mix32Avx2(_mm256_add_epi32(x, k1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i), x);
+        counter = _mm256_add_epi32(counter, step);
+    }
+    fillScalar(dst + 4 * i, words - i, key, first + static_cast<uint32_t>(i));
+}
+
+__attribute__((target("avx512f")))
+inline __m512i mix32Avx512(__m512i x) {
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32(0x7feb352d));
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 15));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32(static_cast<int>(0x846ca68bU)));
+    return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx512f")))
+inline void fillAvx512(uint8_t* dst, size_t words, Key key, uint32_t first) {
+    const __m512i k0 = _mm512_set1_epi32(static_cast<int>(key.k0));
+    const __m512i k1 = _mm512_set1_epi32(static_cast<int>(key.k1));
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i counter = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(first)),
+                                       _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    size_t i = 0;
+    for (; i + 16 <= words; i += 16) {
+        __m512i x = mix32Avx512(_mm512_xor_si512(counter, k0));
+        x = mix32Avx512(_mm512_add_epi32(x, k1));
+        _mm512_storeu_si512(reinterpret_cast<void*>(dst + 4 * i), x);
+        counter = _mm512_add_epi32(counter, step);
+    }
+    fillScalar(dst + 4 * i, words - i, key, first + static_cast<uint32_t>(i));
+}
+#endif
+
+#ifdef FAST_RANDOM_NEON
+inline uint32x4_t mix32Neon(uint32x4_t x) {
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    x = vmulq_u32(x, vdupq_n_u32(0x7feb352dU));
+    x = veorq_u32(x, vshrq_n_u32(x, 15));
+    x = vmulq_u32(x, vdupq_n_u32(0x846ca68bU));
+    return veorq_u32(x, vshrq_n_u32(x, 16));
+}
+
+inline void fillNeon(uint8_t* dst, size_t words, Key key, uint32_t first) {
+    const uint32x4_t k0 = vdupq_n_u32(key.k0);
+    const uint32x4_t k1 = vdupq_n_u32(key.k1);
+    const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t counter = vaddq_u32(vdupq_n_u32(first), vld1q_u32(lanes));
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        uint32x4_t x = mix32Neon(veorq_u32(counter, k0));
+        x = mix32Neon(vaddq_u32(x, k1));
+        vst1q_u8(dst + 4 * i, vreinterpretq_u8_u32(x));
+        counter = vaddq_u32(counter, vdupq_n_u32(4));
+    }
+    fillScalar(dst + 4 * i, words - i, key, first + static_cast<uint32_t>(i));
+}
+#endif
+
+typedef void (*FillFn)(uint8_t*, size_t, Key, uint32_t);
+
+/**
+ * @brief Widest fill loop the CPU supports, resolved on first use.
+ */
+inline FillFn& fillImpl() {
+    static FillFn fn = [] {
+#ifdef FAST_RANDOM_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return static_cast<FillFn>(fillAvx512);
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return static_cast<FillFn>(fillAvx2);
+        }
+#elif defined(FAST_RANDOM_NEON)
+        return static_cast<FillFn>(fillNeon);
+#endif
+        return static_cast<FillFn>(fillScalar);
+    }();
+    return fn;
+}
+
+/**
+ * @brief Name of the instruction set selected by fillImpl().
+ */
+inline const char* isaName() {
+    FillFn fn = fillImpl();
+#ifdef FAST_RANDOM_X86
+    if (fn == static_cast<FillFn>(fillAvx512)) {
+        return "avx512";
+    }
+    if (fn == static_cast<FillFn>(fillAvx2)) {
+        return "avx2";
+    }
+#elif defined(FAST_RANDOM_NEON)
+    if (fn == static_cast<FillFn>(fillNeon)) {
+        return "neon";
+    }
+#endif
+    return "scalar";
+}
+
+typedef void (*FixedFillFn)(uint8_t*, Key);
+
+template <size_t Words>
+inline void fillFixedScalar(uint8_t* dst, Key key) {
+    fillScalar(dst, Words, key, 0);
+}
+
+#ifdef FAST_RANDOM_X86
+/**
+ * @brief fillAvx2 over a whole frame of Words words, known at compile time.
+ *
+ * Four vectors per iteration from independent counters and no tail: the trip count and
+ * the stores' offsets are immediates and the four hash chains overlap.
+ */
+template <size_t Words>
+__attribute__((target("avx2")))
+inline void fillFixedAvx2(uint8_t* dst, Key key) {
+    static_assert(Words % 32 == 0, "fixed fills run whole unrolled iterations");
+    const __m256i k0 = _mm256_set1_epi32(static_cast<int>(key.k0));
+    const __m256i k1 = _mm256_set1_epi32(static_cast<int>(key.k1));
+    const __m256i step = _mm256_set1_epi32(32);
+    __m256i c0 = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i c1 = _mm256_add_epi32(c0, _mm256_set1_epi32(8));
+    __m256i c2 = _mm256_add_epi32(c0, _mm256_set1_epi32(16));
+    __m256i c3 = _mm256_add_epi32(c0, _mm256_set1_epi32(24));
+    __m256i* out = reinterpret_cast<__m256i*>(dst);
+    for (size_t i = 0; i < Words / 32; ++i, out += 4) {
+        __m256i x0 = mix32Avx2(_mm256_add_epi32(mix32Avx2(_mm256_xor_si256(c0, k0)), k1));
+        __m256i x1 = mix32Avx2(_mm256_add_epi32(mix32Avx2(_mm256_xor_si256(c1, k0)), k1));
+        __m256i x2 = mix32Avx2(_mm256_add_epi32(mix32Avx2(_mm256_xor_si256(c2, k0)), k1));
+        __m256i x3 = mix32Avx2(_mm256_add_epi32(mix32Avx2(_mm256_xor_si256(c3, k0)), k1));
+        _mm256_storeu_si256(out, x0);
+        _mm256_storeu_si256(out + 1, x1);
+        _mm256_storeu_si256(out + 2, x2);
+        _mm256_storeu_si256(out + 3, x3);
+        c0 = _mm256_add_epi32(c0, step);
+        c1 = _mm256_add_epi32(c1, step);
+        c2 = _mm256_add_epi32(c2, step);
+        c3 = _mm256_add_epi32(c3, step);
+    }
+}
+
+template <size_t Words>
+__attribute__((target("avx512f")))
+inline void fillFixedAvx512(uint8_t* dst, Key key) {
+    static_assert(Words % 64 == 0, "fixed fills run whole unrolled iterations");
+    const __m512i k0 = _mm512_set1_epi32(static_cast<int>(key.k0));
+    const __m512i k1 = _mm512_set1_epi32(static_cast<int>(key.k1));
+    const __m512i step = _mm512_set1_epi32(64);
+    __m512i c0 = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i c1 = _mm512_add_epi32(c0, _mm512_set1_epi32(16));
+    __m512i c2 = _mm512_add_epi32(c0, _mm512_set1_epi32(32));
+    __m512i c3 = _mm512_add_epi32(c0, _mm512_set1_epi32(48));
+    uint8_t* out = dst;
+    for (size_t i = 0; i < Words / 64; ++i, out += 256) {
+        __m512i x0 = mix32Avx512(_mm512_add_epi32(mix32Avx512(_mm512_xor_si512(c0, k0)), k1));
+        __m512i x1 = mix32Avx512(_mm512_add_epi32(mix32Avx512(_mm512_xor_si512(c1, k0)), k1));
+        __m512i x2 = mix32Avx512(_mm512_add_epi32(mix32Avx512(_mm512_xor_si512(c2, k0)), k1));
+        __m512i x3 = mix32Avx512(_mm512_add_epi32(mix32Avx512(_mm512_xor_si512(c3, k0)), k1));
+        _mm512_storeu_si512(reinterpret_cast<void*>(out), x0);
+        _mm512_storeu_si512(reinterpret_cast<void*>(out + 64), x1);
+        _mm512_storeu_si512(reinterpret_cast<void*>(out + 128), x2);
+        _mm512_storeu_si512(reinterpret_cast<void*>(out + 192), x3);
+        c0 = _mm512_add_epi32(c0, step);
+        c1 = _mm512_add_epi32(c1, step);
+        c2 = _mm512_add_epi32(c2, step);
+        c3 = _mm512_add_epi32(c3, step);
+    }
+}
+#endif
+
+#ifdef FAST_RANDOM_NEON
+template <size_t Words>
+inline void fillFixedNeon(uint8_t* dst, Key key) {
+    static_assert(Words % 16 == 0, "fixed fills run whole unrolled iterations");
+    const uint32x4_t k0 = vdupq_n_u32(key.k0);
+    const uint32x4_t k1 = vdupq_n_u32(key.k1);
+    const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t c0 = vld1q_u32(lanes);
+    uint32x4_t c1 = vaddq_u32(c0, vdupq_n_u32(4));
+    uint32x4_t c2 = vaddq_u32(c0, vdupq_n_u32(8));
+    uint32x4_t c3 = vaddq_u32(c0, vdupq_n_u32(12));
+    const uint32x4_t step = vdupq_n_u32(16);
+    for (size_t i = 0; i < Words / 16; ++i, dst += 64) {
+        vst1q_u8(dst, vreinterpretq_u8_u32(mix32Neon(vaddq_u32(mix32Neon(veorq_u32(c0, k0)), k1))));
+        vst1q_u8(dst + 16, vreinterpretq_u8_u32(mix32Neon(vaddq_u32(mix32Neon(veorq_u32(c1, k0)), k1))));
+        vst1q_u8(dst + 32, vreinterpretq_u8_u32(mix32Neon(vaddq_u32(mix32Neon(veorq_u32(c2, k0)), k1))));
+        vst1q_u8(dst + 48, vreinterpretq_u8_u32(mix32Neon(vaddq_u32(mix32Neon(veorq_u32(c3, k0)), k1))));
+        c0 = vaddq_u32(c0, step);
+        c1 = vaddq_u32(c1, step);
+        c2 = vaddq_u32(c2, step);
+        c3 = vaddq_u32(c3, step);
+    }
+}
+#endif
+
+/**
+ * @brief Fixed-size fill of the instruction set fillImpl() selected, so both produce the same frames.
+ */
+template <size_t Words>
+inline FixedFillFn fixedFillImpl() {
+    FillFn fn = fillImpl();
+#ifdef FAST_RANDOM_X86
+    if (fn == static_cast<FillFn>(fillAvx512)) {
+        return fillFixedAvx512<Words>;
+    }
+    if (fn == static_cast<FillFn>(fillAvx2)) {
+        return fillFixedAvx2<Words>;
+    }
+#elif defined(FAST_RANDOM_NEON)
+    if (fn == static_cast<FillFn>(fillNeon)) {
+        return fillFixedNeon<Words>;
+    }
+#endif
+    (void)fn;
+    return fillFixedScalar<Words>;
+}
+
+/**
+ * @brief Fills bytes [offset, offset + len) of a frame's pixel stream.
+ *
+ * The offset must be a multiple of 4 so that split fills line up with whole words;
+ * a trailing partial word is cut from the full word.
+ *
+ * @param dst Destination of the first byte (byte `offset` of the frame).
+ * @param len Number of bytes to write.
+ * @param key Frame key from frameKey().
+ * @param offset Byte offset of dst inside the frame.
+ */
+inline void fill(uint8_t* dst, size_t len, Key key, size_t offset = 0) {
+    size_t words = len / 4;
+    uint32_t first = static_cast<uint32_t>(offset / 4);
+    fillImpl()(dst, words, key, first);
+    size_t tail = len - words * 4;
+    if (tail > 0) {
+        uint32_t w = word(key, first + static_cast<uint32_t>(words));
+        std::memcpy(dst + words * 4, &w, tail);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+
+class FramePool;
+
+static const int MAX_DERIVATIVES = 8;  ///< --derive outputs per generated frame
+
+/**
+ * @struct FrameTimes
+ * @brief Monotonic timestamps (monotonicNs()) of a frame at each pipeline stage, 0 if not reached.
+ */
+struct FrameTimes {
+    int64_t capture = 0;
+    int64_t generated = 0;
+    int64_t enqueued = 0;
+    int64_t dequeued = 0;
+    int64_t encoded = 0;
+};
+
+/**
+ * @struct img_data
+ * @brief Container for image data and its identifier.
+ *
+ * When the pixels come from a FramePool, pool/slot identify the buffer that has to be
+ * handed back with releaseFrame() once the frame is saved or dropped.
+ */
+struct img_data {
+    int id;
+    cv::Mat img;
+    FramePool* pool = nullptr;
+    int slot = -1;
+    int64_t timestamp = 0; ///< Capture time, ns since the Unix epoch
+    int stream = 0;        ///< Index of the camera stream that produced the frame
+    int derivative = 0;    ///< 0 for the generated frame, k for its k-th --derive output
+    FrameTimes times{};
+};
+
+/**
+ * @struct encoded_frame
+ * @brief Compressed bytes of a frame, handed from the encoder stage to the writer stage.
+ */
+struct encoded_frame {
+    int id = -1;
+    int64_t timestamp = 0; ///< Capture time of the source frame, ns since the Unix epoch
+    int stream = 0;
+    int derivative = 0;      ///< 0 for the generated frame, k for its k-th --derive output
+    FrameTimes times{};
+    std::vector<uchar> bytes;
+    uint64_t hash = 0;       ///< Pixel hash of the source frame, 0 without --dedup
+    bool duplicate = false;  ///< Same pixels as an earlier frame of the stream, bytes reused (--dedup)
+};
+
+/**
+ * @brief Stream and derivative of a frame packed in the 32-bit stream field of the index
+ * and journal records: the low 16 bits are the stream, the high 16 bits the derivative.
+ */
+inline uint32_t packStream(int stream, int derivative) {
+    return static_cast<uint32_t>(stream) | static_cast<uint32_t>(derivative) << 16;
+}
+
+#endif
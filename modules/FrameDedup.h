@@ -0,0 +1,252 @@
+#ifndef FRAME_DEDUP_H
+#define FRAME_DEDUP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "LatencyHistogram.h"
+
+namespace framehash {
+
+static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t P3 = 0x165667B19E3779F9ULL;
+static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uchar* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const uchar* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * P2, 31) * P1;
+}
+
+inline uint64_t merge(uint64_t acc, uint64_t lane) {
+    return (acc ^ round(0, lane)) * P1 + P4;
+}
+
+inline uint64_t converge(uint64_t v1, uint64_t v2, uint64_t v3, uint64_t v4) {
+    uint64_t h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(h, v1);
+    h = merge(h, v2);
+    h = merge(h, v3);
+    return merge(h, v4);
+}
+
+/**
+ * @brief Tail of the input after the 32-byte stripes, then the final avalanche.
+ */
+inline uint64_t finish(uint64_t h, const uchar* p, const uchar* end) {
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (static_cast<uint64_t>(read32(p)) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h = rotl(h ^ (*p * P5), 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief XXH64 of a buffer.
+ *
+ * The four accumulators are independent, so the main loop retires a 32-byte stripe every
+ * few cycles and hashing runs close to memory bandwidth, a small fraction of an encode.
+ */
+inline uint64_t xxh64(const void* data, size_t len, uint64_t seed) {
+    const uchar* p = static_cast<const uchar*>(data);
+    const uchar* end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        const uchar* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = converge(v1, v2, v3, v4);
+    } else {
+        h = seed + P5;
+    }
+    return finish(h + static_cast<uint64_t>(len), p, end);
+}
+
+/**
+ * @brief xxh64() of a buffer whose length is known at compile time, same result.
+ *
+ * Two stripes per iteration and a constant trip count, the tail is resolved statically.
+ */
+template <size_t Len>
+inline uint64_t xxh64Fixed(const void* data, uint64_t seed) {
+    static_assert(Len >= 64, "fixed hashes cover whole frames");
+    const uchar* p = static_cast<const uchar*>(data);
+    uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    for (size_t i = 0; i < Len / 64; ++i, p += 64) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        v1 = round(v1, read64(p + 32));
+        v2 = round(v2, read64(p + 40));
+        v3 = round(v3, read64(p + 48));
+        v4 = round(v4, read64(p + 56));
+    }
+    if constexpr (Len % 64 >= 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+    }
+    const uchar* end = static_cast<const uchar*>(data) + Len;
+    return finish(converge(v1, v2, v3, v4) + static_cast<uint64_t>(Len), p, end);
+}
+
+/**
+ * @brief Hash of a frame's pixels and shape; rows are chained for non-continuous matrices.
+ */
+inline uint64_t shapeSeed(int rows, int cols, int type) {
+    return static_cast<uint64_t>(rows) << 32 ^ static_cast<uint64_t>(cols) << 8 ^ static_cast<uint64_t>(type);
+}
+
+inline uint64_t hashFrame(const cv::Mat& img) {
+    uint64_t h = shapeSeed(img.rows, img.cols, img.type());
+    const size_t rowBytes = img.cols * img.elemSize();
+    if (img.isContinuous()) {
+        return xxh64(img.data, rowBytes * img.rows, h);
+    }
+    for (int r = 0; r < img.rows; ++r) {
+        h = xxh64(img.ptr(r), rowBytes, h);
+    }
+    return h;
+}
+
+typedef uint64_t (*HashFn)(const cv::Mat&);
+
+}
+
+/**
+ * @brief Duplicate-frame detection of one stream (--dedup).
+ *
+ * Encoders hash every frame before encoding it. When the hash matches the last encoded
+ * frame of the stream at the same quality level, the cached encoded bytes are copied
+ * instead of running the codec. Bytes are only cached once a hash has been seen twice in
+ * a row, so streams that never repeat (random content) pay the hash and nothing else.
+ *
+ * @param hashFn Frame hash, hashFrame() or a fixed-profile kernel with the same result.
+ */
+class FrameDedup {
+    public:
+        explicit FrameDedup(framehash::HashFn hashFn = framehash::hashFrame) : hashFn(hashFn) {}
+
+        /**
+         * @brief Hashes a frame and accounts the time it took.
+         */
+        uint64_t hash(const cv::Mat& img) {
+            int64_t start = monotonicNs();
+            uint64_t h = hashFn(img);
+            hashNs.fetch_add(monotonicNs() - start, std::memory_order_relaxed);
+            return h;
+        }
+
+        /**
+         * @brief Copies the cached encoding of a frame with this hash and level into out.
+         *
+         * @return false on a miss, out is left untouched.
+         */
+        bool lookup(uint64_t hash, int level, std::vector<uchar>& out) {
+            std::shared_ptr<const std::vector<uchar>> bytes;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cached != nullptr && cachedHash == hash && cachedLevel == level) {
+                    bytes = cached;
+                }
+            }
+            if (bytes == nullptr) {
+                misses.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            out.assign(bytes->begin(), bytes->end());
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /**
+         * @brief Reports the encoding of a missed frame, caching it if the hash repeats.
+         *
+         * @param encodeNs Time the codec took, the cost a later hit saves.
+         */
+        void store(uint64_t hash, int level, const std::vector<uchar>& bytes, int64_t encodeNs) {
+            missEncodeNs.fetch_add(encodeNs, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (hash == lastHash && (cached == nullptr || cachedHash != hash || cachedLevel != level)) {
+                cached = std::make_shared<const std::vector<uchar>>(bytes);
+                cachedHash = hash;
+                cachedLevel = level;
+            }
+            lastHash = hash;
+        }
+
+        int64_t getHits() const {
+            return hits.load(std::memory_order_relaxed);
+        }
+
+        int64_t getMisses() const {
+            return misses.load(std::memory_order_relaxed);
+        }
+
+        int64_t getHashNs() const {
+            return hashNs.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Encoding time the hits saved, estimated from the mean encode of the misses.
+         */
+        int64_t getSavedNs() const {
+            int64_t m = getMisses();
+            return m > 0 ? getHits() * (missEncodeNs.load(std::memory_order_relaxed) / m) : 0;
+        }
+
+    private:
+        framehash::HashFn hashFn;
+        std::mutex mutex;  ///< Guards the cache, the bytes themselves are immutable once shared
+        uint64_t lastHash = 0;
+        uint64_t cachedHash = 0;
+        int cachedLevel = -1;
+        std::shared_ptr<const std::vector<uchar>> cached;
+        std::atomic<int64_t> hits{0};
+        std::atomic<int64_t> misses{0};
+        std::atomic<int64_t> hashNs{0};
+        std::atomic<int64_t> missEncodeNs{0};
+};
+
+#endif
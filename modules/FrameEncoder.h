@@ -0,0 +1,494 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "Logger.h"
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifdef HAVE_NVJPEG
+#include <cuda_runtime.h>
+#include <nvjpeg.h>
+#endif
+
+/**
+ * @struct EncodeSettings
+ * @brief Codec settings of one frame; the adaptive policy lowers them per frame.
+ */
+struct EncodeSettings {
+    int quality = 95;       ///< JPEG quality, 1-100
+    int subsampling = 420;  ///< JPEG chroma subsampling: 444, 422 or 420
+    int pngLevel = 1;       ///< PNG compression level, 0-9
+};
+
+/**
+ * @brief Compresses frames in memory; one instance is shared by every encoder thread.
+ *
+ * Backends that need per-thread state (codec handles, device buffers) create it on the
+ * calling thread's first frame, so encode() never takes a lock in steady state.
+ */
+class FrameEncoder {
+    public:
+        virtual ~FrameEncoder() {}
+
+        /**
+         * @brief Encodes a BGR frame, replacing the contents of out.
+         *
+         * @return false if the codec failed.
+         */
+        virtual bool encode(const cv::Mat& img, std::vector<uchar>& out, const EncodeSettings& settings) = 0;
+
+        /**
+         * @brief Encodes n frames, results in ok; backends that can overlap frames keep them all in flight.
+         */
+        virtual void encodeBatch(const cv::Mat* const* imgs, std::vector<uchar>* const* outs,
+                                 const EncodeSettings* settings, bool* ok, int n) {
+            for (int i = 0; i < n; ++i) {
+                ok[i] = encode(*imgs[i], *outs[i], settings[i]);
+            }
+        }
+
+        /**
+         * @brief Frames an encoder thread should hand to one encodeBatch() call.
+         */
+        virtual int maxInFlight() const {
+            return 1;
+        }
+
+        /**
+         * @brief Page-locks a long-lived buffer frames are encoded from (frame pool buffers), so
+         * their uploads are asynchronous DMA.
+         *
+         * @return false if the backend does not upload frames or the buffer could not be locked.
+         */
+        virtual bool registerHostBuffer(void* data, size_t bytes) {
+            return false;
+        }
+
+        virtual void unregisterHostBuffer(void* data) {}
+
+        virtual const char* name() const = 0;
+};
+
+/**
+ * @brief cv::imencode with the codec picked from the -i extension.
+ *
+ * @param ext Image format extension, with the dot.
+ */
+class OpenCvEncoder : public FrameEncoder {
+    public:
+        explicit OpenCvEncoder(const std::string& ext)
+            : ext(ext), format(ext == ".jpg" || ext == ".jpeg" ? Format::Jpeg : ext == ".png" ? Format::Png : Format::Other) {}
+
+        bool encode(const cv::Mat& img, std::vector<uchar>& out, const EncodeSettings& settings) override {
+            return cv::imencode(ext, img, out, localParams(settings));
+        }
+
+        const char* name() const override {
+            return "opencv";
+        }
+
+    private:
+        enum class Format { Jpeg, Png, Other };
+
+        /**
+         * @brief imencode parameters of the calling thread, rebuilt only when the format or the
+         * settings level differ from its last frame; the vector keeps its capacity, so a rebuild
+         * does not allocate either.
+         */
+        const std::vector<int>& localParams(const EncodeSettings& settings) const {
+            struct Cache {
+                Format format = Format::Other;
+                EncodeSettings settings{ -1, -1, -1 };
+                std::vector<int> params;
+            };
+            thread_local Cache cache;
+            if (cache.format == format && cache.settings.quality == settings.quality &&
+                cache.settings.subsampling == settings.subsampling && cache.settings.pngLevel == settings.pngLevel) {
+                return cache.params;
+            }
+            cache.format = format;
+            cache.settings = settings;
+            cache.params.clear();
+            if (format == Format::Jpeg) {
+                cache.params.push_back(cv::IMWRITE_JPEG_QUALITY);
+                cache.params.push_back(settings.quality);
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+                if (settings.subsampling != 420) {
+                    cache.params.push_back(cv::IMWRITE_JPEG_SAMPLING_FACTOR);
+                    cache.params.push_back(settings.subsampling == 444 ? cv::IMWRITE_JPEG_SAMPLING_FACTOR_444
+                                                                       : cv::IMWRITE_JPEG_SAMPLING_FACTOR_422);
+                }
+#endif
+            } else if (format == Format::Png) {
+                cache.params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+                cache.params.push_back(settings.pngLevel);
+            }
+            return cache.params;
+        }
+
+        std::string ext;
+        Format format;
+};
+
+/**
+ * @brief Uncompressed passthrough: the frame's BGR rows, tightly packed, no header.
+ */
+class RawEncoder : public FrameEncoder {
+    public:
+        bool encode(const cv::Mat& img, std::vector<uchar>& out, const EncodeSettings& settings) override {
+            const size_t rowBytes = img.cols * img.elemSize();
+            if (img.isContinuous()) {
+                out.assign(img.data, img.data + rowBytes * img.rows);
+                return true;
+            }
+            out.resize(rowBytes * img.rows);
+            for (int r = 0; r < img.rows; ++r) {
+                std::memcpy(out.data() + r * rowBytes, img.ptr(r), rowBytes);
+            }
+            return true;
+        }
+
+        const char* name() const override {
+            return "raw";
+        }
+};
+
+#ifdef HAVE_TURBOJPEG
+/**
+ * @brief JPEG through libjpeg-turbo's TurboJPEG API, one compressor handle per encoder thread.
+ *
+ * Every thread also keeps an output buffer of the worst-case size (tjBufSize), so the
+ * codec never reallocates; only the compressed bytes are copied out. Frames are compressed
+ * with TJFLAG_FASTDCT, the fast integer DCT: slightly less accurate than the default one at
+ * high --quality, but faster, which is what a real-time capture needs.
+ */
+class TurboJpegEncoder : public FrameEncoder {
+    public:
+        TurboJpegEncoder() {
+            tjhandle probe = tjInitCompress();
+            ready = probe != nullptr;
+            if (probe != nullptr) {
+                tjDestroy(probe);
+            }
+        }
+
+        ~TurboJpegEncoder() {
+            for (auto& ctx : contexts) {
+                if (ctx->handle != nullptr) {
+                    tjDestroy(ctx->handle);
+                }
+                tjFree(ctx->buffer);
+            }
+        }
+
+        /**
+         * @brief Whether a TurboJPEG compressor could be created.
+         */
+        bool available() const {
+            return ready;
+        }
+
+        bool encode(const cv::Mat& img, std::vector<uchar>& out, const EncodeSettings& settings) override {
+            Context* ctx = localContext();
+            if (ctx->handle == nullptr || img.type() != CV_8UC3) {
+                return false;
+            }
+            int sub = settings.subsampling == 444 ? TJSAMP_444 : settings.subsampling == 422 ? TJSAMP_422 : TJSAMP_420;
+            unsigned long need = tjBufSize(img.cols, img.rows, sub);
+            if (need > ctx->capacity) {
+                tjFree(ctx->buffer);
+                ctx->buffer = tjAlloc(static_cast<int>(need));
+                ctx->capacity = ctx->buffer != nullptr ? need : 0;
+                if (ctx->buffer == nullptr) {
+                    return false;
+                }
+            }
+            unsigned char* dst = ctx->buffer;
+            unsigned long size = ctx->capacity;
+            if (tjCompress2(ctx->handle, img.data, img.cols, static_cast<int>(img.step), img.rows, TJPF_BGR,
+                            &dst, &size, sub, settings.quality, TJFLAG_NOREALLOC | TJFLAG_FASTDCT) != 0) {
+                return false;
+            }
+            out.assign(dst, dst + size);
+            return true;
+        }
+
+        const char* name() const override {
+            return "turbojpeg";
+        }
+
+    private:
+        struct Context {
+            tjhandle handle = nullptr;  ///< nullptr if tjInitCompress() failed on that thread
+            unsigned char* buffer = nullptr;
+            unsigned long capacity = 0;
+            std::thread::id thread;  ///< Encoder thread that uses it
+        };
+
+        Context* localContext() {
+            // Keyed by id, not address: a later encoder may reuse a destroyed one's memory
+            thread_local uint64_t owner = 0;
+            thread_local Context* ctx = nullptr;
+            if (owner == id) {
+                return ctx;
+            }
+            {
+                // Back from another encoder: this thread's context is still here
+                std::lock_guard<std::mutex> lock(contextsMutex);
+                for (auto& mine : contexts) {
+                    if (mine->thread == std::this_thread::get_id()) {
+                        ctx = mine.get();
+                        owner = id;
+                        return ctx;
+                    }
+                }
+            }
+            std::unique_ptr<Context> fresh(new Context());
+            fresh->thread = std::this_thread::get_id();
+            fresh->handle = tjInitCompress();
+            if (fresh->handle == nullptr) {
+                // Kept anyway, so the thread fails its later frames without retrying or logging again
+                LOG_ERROR("[TurboJpegEncoder] tjInitCompress failed on an encoder thread: {}", tjGetErrorStr());
+            }
+            std::lock_guard<std::mutex> lock(contextsMutex);
+            contexts.push_back(std::move(fresh));
+            ctx = contexts.back().get();
+            owner = id;
+            return ctx;
+        }
+
+        static std::atomic<uint64_t>& nextId() {
+            static std::atomic<uint64_t> counter{0};
+            return counter;
+        }
+
+        const uint64_t id = nextId().fetch_add(1, std::memory_order_relaxed) + 1;
+        bool ready = false;
+        std::mutex contextsMutex;
+        std::vector<std::unique_ptr<Context>> contexts;
+};
+#endif
+
+#ifdef HAVE_NVJPEG
+/**
+ * @brief JPEG on the GPU with nvJPEG.
+ *
+ * Each encoder thread owns inFlight slots of a CUDA stream, an nvJPEG encoder state and a
+ * device frame buffer. encodeBatch() queues the upload and the encode of every frame on its
+ * own slot before collecting any bitstream, so the copy of one frame overlaps the encode
+ * of the others, and several threads keep several batches on the GPU. Uploads come from
+ * page-locked pool buffers (registerHostBuffer()) when the pipeline registered them, and
+ * only the compressed bitstream comes back.
+ *
+ * @param inFlight Slots per encoder thread (--gpu-inflight).
+ */
+class NvJpegEncoder : public FrameEncoder {
+    public:
+        explicit NvJpegEncoder(int inFlight = 1) : inFlight(inFlight > 0 ? inFlight : 1) {
+            if (nvjpegCreateSimple(&handle) != NVJPEG_STATUS_SUCCESS) {
+                handle = nullptr;
+            }
+        }
+
+        ~NvJpegEncoder() {
+            for (auto& ctx : contexts) {
+                for (Slot& slot : ctx->slots) {
+                    nvjpegEncoderParamsDestroy(slot.params);
+                    nvjpegEncoderStateDestroy(slot.state);
+                    cudaFree(slot.device);
+                    cudaStreamDestroy(slot.stream);
+                }
+            }
+            if (handle != nullptr) {
+                nvjpegDestroy(handle);
+            }
+        }
+
+        /**
+         * @brief Whether a CUDA device and the nvJPEG library could be initialized.
+         */
+        bool available() const {
+            return handle != nullptr;
+        }
+
+        bool encode(const cv::Mat& img, std::vector<uchar>& out, const EncodeSettings& settings) override {
+            const cv::Mat* imgs[1] = { &img };
+            std::vector<uchar>* outs[1] = { &out };
+            bool ok = false;
+            encodeBatch(imgs, outs, &settings, &ok, 1);
+            return ok;
+        }
+
+        void encodeBatch(const cv::Mat* const* imgs, std::vector<uchar>* const* outs,
+                         const EncodeSettings* settings, bool* ok, int n) override {
+            Context* ctx = localContext();
+            for (int begin = 0; begin < n; begin += inFlight) {
+                const int end = std::min(n, begin + inFlight);
+                // Queue every upload and encode of the batch, then collect the bitstreams in order
+                for (int i = begin; i < end; ++i) {
+                    ok[i] = ctx != nullptr && submit(ctx->slots[i - begin], *imgs[i], settings[i]);
+                }
+                for (int i = begin; i < end; ++i) {
+                    if (ok[i]) {
+                        ok[i] = retrieve(ctx->slots[i - begin], *outs[i]);
+                    }
+                }
+            }
+        }
+
+        int maxInFlight() const override {
+            return inFlight;
+        }
+
+        bool registerHostBuffer(void* data, size_t bytes) override {
+            return handle != nullptr && cudaHostRegister(data, bytes, cudaHostRegisterPortable) == cudaSuccess;
+        }
+
+        void unregisterHostBuffer(void* data) override {
+            cudaHostUnregister(data);
+        }
+
+        const char* name() const override {
+            return "nvjpeg";
+        }
+
+    private:
+        struct Slot {
+            cudaStream_t stream = nullptr;
+            nvjpegEncoderState_t state = nullptr;
+            nvjpegEncoderParams_t params = nullptr;
+            unsigned char* device = nullptr;
+            size_t capacity = 0;
+        };
+
+        struct Context {
+            std::vector<Slot> slots;
+            std::thread::id thread;  ///< Encoder thread that uses it
+        };
+
+        /**
+         * @brief Queues the upload and the encode of a frame on its slot's stream.
+         */
+        bool submit(Slot& slot, const cv::Mat& img, const EncodeSettings& settings) {
+            if (img.type() != CV_8UC3) {
+                return false;
+            }
+            const size_t pitch = img.cols * img.elemSize();
+            const size_t bytes = pitch * img.rows;
+            if (bytes > slot.capacity) {
+                cudaFree(slot.device);
+                slot.capacity = 0;
+                if (cudaMalloc(reinterpret_cast<void**>(&slot.device), bytes) != cudaSuccess) {
+                    slot.device = nullptr;
+                    return false;
+                }
+                slot.capacity = bytes;
+            }
+            nvjpegChromaSubsampling_t css = settings.subsampling == 444 ? NVJPEG_CSS_444
+                                          : settings.subsampling == 422 ? NVJPEG_CSS_422 : NVJPEG_CSS_420;
+            nvjpegEncoderParamsSetQuality(slot.params, settings.quality, slot.stream);
+            nvjpegEncoderParamsSetSamplingFactors(slot.params, css, slot.stream);
+            if (cudaMemcpy2DAsync(slot.device, pitch, img.data, img.step, pitch, img.rows,
+                                  cudaMemcpyHostToDevice, slot.stream) != cudaSuccess) {
+                return false;
+            }
+            nvjpegImage_t source;
+            std::memset(&source, 0, sizeof(source));
+            source.channel[0] = slot.device;
+            source.pitch[0] = pitch;
+            return nvjpegEncodeImage(handle, slot.state, slot.params, &source, NVJPEG_INPUT_BGRI,
+                                     img.cols, img.rows, slot.stream) == NVJPEG_STATUS_SUCCESS;
+        }
+
+        /**
+         * @brief Waits for a slot's encode and copies its bitstream out.
+         */
+        bool retrieve(Slot& slot, std::vector<uchar>& out) {
+            size_t length = 0;
+            if (cudaStreamSynchronize(slot.stream) != cudaSuccess ||
+                nvjpegEncodeRetrieveBitstream(handle, slot.state, nullptr, &length, slot.stream) != NVJPEG_STATUS_SUCCESS) {
+                return false;
+            }
+            out.resize(length);
+            if (nvjpegEncodeRetrieveBitstream(handle, slot.state, out.data(), &length, slot.stream) != NVJPEG_STATUS_SUCCESS) {
+                return false;
+            }
+            out.resize(length);
+            return cudaStreamSynchronize(slot.stream) == cudaSuccess;
+        }
+
+        Context* localContext() {
+            // Keyed by id, not address: a later encoder may reuse a destroyed one's memory
+            thread_local uint64_t owner = 0;
+            thread_local Context* ctx = nullptr;
+            if (owner == id) {
+                return ctx;
+            }
+            {
+                // Back from another encoder: this thread's context is still here
+                std::lock_guard<std::mutex> lock(contextsMutex);
+                for (auto& mine : contexts) {
+                    if (mine->thread == std::this_thread::get_id()) {
+                        ctx = mine.get();
+                        owner = id;
+                        return ctx;
+                    }
+                }
+            }
+            if (handle == nullptr) {
+                return nullptr;
+            }
+            std::unique_ptr<Context> fresh(new Context());
+            fresh->thread = std::this_thread::get_id();
+            fresh->slots.resize(inFlight);
+            for (Slot& slot : fresh->slots) {
+                bool created = cudaStreamCreateWithFlags(&slot.stream, cudaStreamNonBlocking) == cudaSuccess &&
+                               nvjpegEncoderStateCreate(handle, &slot.state, slot.stream) == NVJPEG_STATUS_SUCCESS &&
+                               nvjpegEncoderParamsCreate(handle, &slot.params, slot.stream) == NVJPEG_STATUS_SUCCESS;
+                if (!created) {
+                    for (Slot& s : fresh->slots) {
+                        if (s.params != nullptr) {
+                            nvjpegEncoderParamsDestroy(s.params);
+                        }
+                        if (s.state != nullptr) {
+                            nvjpegEncoderStateDestroy(s.state);
+                        }
+                        if (s.stream != nullptr) {
+                            cudaStreamDestroy(s.stream);
+                        }
+                    }
+                    return nullptr;
+                }
+            }
+            std::lock_guard<std::mutex> lock(contextsMutex);
+            contexts.push_back(std::move(fresh));
+            ctx = contexts.back().get();
+            owner = id;
+            return ctx;
+        }
+
+        static std::atomic<uint64_t>& nextId() {
+            static std::atomic<uint64_t> counter{0};
+            return counter;
+        }
+
+        const int inFlight;
+        nvjpegHandle_t handle = nullptr;
+        const uint64_t id = nextId().fetch_add(1, std::memory_order_relaxed) + 1;
+        std::mutex contextsMutex;
+        std::vector<std::unique_ptr<Context>> contexts;
+};
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef FRAME_JOURNAL_H
+#define FRAME_JOURNAL_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FrameData.h"
+#include "FrameSink.h"
+
+/**
+ * @struct FrameJournalHeader
+ * @brief First bytes of frames.journal: magic, format and seed of the run.
+ */
+struct FrameJournalHeader {
+    char magic[8];   ///< "FPSWAL1"
+    char ext[8];     ///< Image format extension, without the dot
+    uint64_t seed;   ///< Seed of the fast generator
+    uint64_t reserved;
+};
+
+/**
+ * @struct FrameJournalRecord
+ * @brief One persisted frame, 24 bytes; the checksum tells a torn tail from a record.
+ */
+struct FrameJournalRecord {
+    int32_t id;         ///< Frame id
+    uint32_t stream;    ///< Camera stream, and the derivative in the high 16 bits (packStream())
+    int64_t timestamp;  ///< Capture time, ns since the Unix epoch
+    uint32_t length;    ///< Encoded length
+    uint32_t checksum;  ///< FNV-1a of the fields above
+};
+
+/**
+ * @struct JournalState
+ * @brief What a previous run made durable, read back by FrameJournal::recover().
+ */
+struct JournalState {
+    std::string ext;
+    uint64_t seed = 0;
+    std::vector<int> nextId;   ///< Per stream, one past the highest durable frame id
+    std::vector<int> frames;   ///< Per stream, durable frames
+    int64_t validBytes = 0;    ///< Length of the journal up to the last intact record
+    int64_t discardedBytes = 0; ///< Torn or corrupt tail after it, dropped on resume
+};
+
+/**
+ * @brief Append-only write-ahead index of every persisted frame.
+ *
+ * Writers append a record per saved frame into a buffer under a short lock. A background
+ * thread takes the buffer every interval, makes the frames it lists durable through the
+ * sink (FrameSink::sync()), then appends the records and fdatasyncs the journal. A record
+ * therefore only reaches the disk after its frame, so after a crash every record names a
+ * frame that is intact, and at most one interval of frames is unaccounted for.
+ *
+ * @param path Journal file, normally <out>/frames.journal.
+ * @param sink Sink whose frames are journaled.
+ * @param interval Time between two syncs.
+ */
+class FrameJournal {
+    public:
+        FrameJournal(const std::string& path, FrameSink* sink, std::chrono::milliseconds interval)
+            : path(path), sink(sink), interval(interval) {
+            pending.reserve(4096);
+            writing.reserve(4096);
+        }
+
+        ~FrameJournal() {
+            stop();
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        FrameJournal(const FrameJournal&) = delete;
+        FrameJournal& operator=(const FrameJournal&) = delete;
+
+        /**
+         * @brief Reads a journal back, stopping at the first torn or corrupt record.
+         *
+         * @return false if the file is missing or is not a frame journal.
+         */
+        static bool recover(const std::string& path, JournalState& state) {
+            FILE* in = std::fopen(path.c_str(), "rb");
+            if (in == nullptr) {
+                return false;
+            }
+            FrameJournalHeader header;
+            if (std::fread(&header, sizeof(header), 1, in) != 1 || std::memcmp(header.magic, "FPSWAL1", 8) != 0) {
+                std::fclose(in);
+                return false;
+            }
+            header.ext[sizeof(header.ext) - 1] = '\0';
+            state.ext = header.ext;
+            state.seed = header.seed;
+            state.nextId.clear();
+            state.frames.clear();
+
+            int64_t valid = sizeof(header);
+            std::vector<FrameJournalRecord> block(4096);
+            size_t n;
+            bool intact = true;
+            while (intact && (n = std::fread(block.data(), sizeof(FrameJournalRecord), block.size(), in)) > 0) {
+                for (size_t i = 0; i < n; ++i) {
+                    const FrameJournalRecord& rec = block[i];
+                    if (rec.checksum != checksum(rec) || rec.id < 0) {
+                        intact = false;
+                        break;
+                    }
+                    valid += sizeof(FrameJournalRecord);
+                    if (rec.stream >> 16 != 0) {
+                        continue; // --derive outputs follow their frame's numbering
+                    }
+                    if (rec.stream >= state.nextId.size()) {
+                        state.nextId.resize(rec.stream + 1, 0);
+                        state.frames.resize(rec.stream + 1, 0);
+                    }
+                    state.nextId[rec.stream] = std::max(state.nextId[rec.stream], rec.id + 1);
+                    state.frames[rec.stream]++;
+                }
+            }
+            std::fseek(in, 0, SEEK_END);
+            state.validBytes = valid;
+            state.discardedBytes = std::ftell(in) - valid;
+            std::fclose(in);
+            return true;
+        }
+
+        /**
+         * @brief Creates the journal, or with a recovered state reopens it after its last intact record.
+         *
+         * @return false if the file cannot be opened or written.
+         */
+        bool open(const std::string& ext, uint64_t seed, const JournalState* resume) {
+            if (resume != nullptr) {
+                fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+                if (fd < 0 || ::ftruncate(fd, resume->validBytes) != 0 ||
+                    ::lseek(fd, resume->validBytes, SEEK_SET) != resume->validBytes) {
+                    return false;
+                }
+                end = resume->validBytes;
+                return ::fdatasync(fd) == 0;
+            }
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return false;
+            }
+            FrameJournalHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "FPSWAL1", 8);
+            std::strncpy(header.ext, ext.c_str(), sizeof(header.ext) - 1);
+            header.seed = seed;
+            end = sizeof(header);
+            return FileSink::writeAll(fd, &header, sizeof(header)) && ::fdatasync(fd) == 0;
+        }
+
+        void start() {
+            syncer = std::thread([this] { run(); });
+        }
+
+        /**
+         * @brief Stops the sync thread and makes everything appended so far durable.
+         */
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (syncer.joinable()) {
+                syncer.join();
+            }
+            if (fd >= 0) {
+                syncOnce();
+            }
+        }
+
+        /**
+         * @brief Records the frames of a write batch that reached the sink.
+         */
+        void append(const encoded_frame* frames, int n, const bool* ok) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < n; ++i) {
+                if (ok[i]) {
+                    pending.push_back(makeRecord(frames[i].id, packStream(frames[i].stream, frames[i].derivative),
+                                                 frames[i].timestamp, frames[i].bytes.size()));
+                }
+            }
+        }
+
+        /**
+         * @brief Records one frame persisted outside the write stage (--output raw).
+         */
+        void append(int id, int stream, int64_t timestamp, size_t length) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(makeRecord(id, packStream(stream, 0), timestamp, length));
+        }
+
+        int64_t getDurableFrames() const {
+            return durable;
+        }
+
+        int getSyncs() const {
+            return syncs;
+        }
+
+        double getMaxSyncMs() const {
+            return maxSyncNs / 1e6;
+        }
+
+        int getFailedSyncs() const {
+            return failedSyncs;
+        }
+
+    private:
+        static FrameJournalRecord makeRecord(int id, uint32_t stream, int64_t timestamp, size_t length) {
+            FrameJournalRecord rec;
+            rec.id = id;
+            rec.stream = stream;
+            rec.timestamp = timestamp;
+            rec.length = static_cast<uint32_t>(length);
+            rec.checksum = checksum(rec);
+            return rec;
+        }
+
+        static uint32_t checksum(const FrameJournalRecord& rec) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(&rec);
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < offsetof(FrameJournalRecord, checksum); ++i) {
+                h = (h ^ p[i]) * 16777619u;
+            }
+            return h;
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+                lock.unlock();
+                syncOnce();
+                lock.lock();
+            }
+        }
+
+        /**
+         * @brief Frames first, then their records: sink sync, append, fdatasync.
+         *
+         * A failed step leaves the records for the next sync, ahead of the newer ones, and a
+         * partial append is cut off before the next one, so recover() never stops at a torn
+         * record with durable ones behind it. Only the sync thread (or stop(), after joining
+         * it) calls this.
+         */
+        void syncOnce() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writing.swap(pending);
+            }
+            if (writing.empty()) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            const size_t bytes = writing.size() * sizeof(FrameJournalRecord);
+            bool ok = sink->sync();
+            if (ok && ::lseek(fd, 0, SEEK_CUR) != end) {
+                // The last append failed part way, drop what it left behind
+                ok = ::ftruncate(fd, end) == 0 && ::lseek(fd, end, SEEK_SET) == end;
+            }
+            ok = ok && FileSink::writeAll(fd, writing.data(), bytes) && ::fdatasync(fd) == 0;
+            int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            syncs++;
+            maxSyncNs = std::max(maxSyncNs, ns);
+            if (ok) {
+                durable += static_cast<int64_t>(writing.size());
+                end += static_cast<off_t>(bytes);
+            } else {
+                failedSyncs++;
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.insert(pending.begin(), writing.begin(), writing.end());
+            }
+            writing.clear();
+        }
+
+        std::string path;
+        FrameSink* sink;
+        std::chrono::milliseconds interval;
+        int fd = -1;
+        off_t end = 0;                ///< Journal size up to its last durable record
+        std::thread syncer;
+        std::mutex mutex;             ///< Guards pending and stopping
+        std::condition_variable wake;
+        bool stopping = false;
+        std::vector<FrameJournalRecord> pending;  ///< Appended by the writers since the last sync
+        std::vector<FrameJournalRecord> writing;  ///< Taken by the sync in progress
+        int64_t durable = 0;
+        int syncs = 0;
+        int failedSyncs = 0;
+        int64_t maxSyncNs = 0;
+};
+
+#endif
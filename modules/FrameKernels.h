@@ -0,0 +1,227 @@
+#ifndef FRAME_KERNELS_H
+#define FRAME_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "FastRandom.h"
+#include "FrameDedup.h"
+
+/**
+ * @brief Per-pixel loops of the pipeline, generic or specialized for a fixed frame shape.
+ *
+ * Width, height and type are runtime values, so the generic loops work on any frame. The
+ * fleet's camera profiles are instantiated at compile time instead (Bgr8Profile): the frame
+ * size, row stride and trip counts are constants, the SIMD loops are unrolled with no tail,
+ * and their pool buffers are 2 MB aligned for huge pages. selectFrameKernels() picks one
+ * per stream at startup; every specialized kernel produces the same bytes as the generic
+ * one (halve() within one level of cv::resize's rounding) and falls back to it for a frame
+ * of another shape, e.g. a --derive output.
+ */
+namespace framekernels {
+
+/**
+ * @brief Generic fast fill of a frame, row by row when the matrix is not continuous.
+ */
+inline void fillFrame(cv::Mat& dst, fastrandom::Key key) {
+    const size_t rowBytes = dst.cols * dst.elemSize();
+    if (dst.isContinuous()) {
+        fastrandom::fill(dst.data, rowBytes * dst.rows, key);
+        return;
+    }
+    const size_t rowStride = (rowBytes + 3) & ~static_cast<size_t>(3);
+    for (int r = 0; r < dst.rows; ++r) {
+        fastrandom::fill(dst.ptr(r), rowBytes, key, r * rowStride);
+    }
+}
+
+/**
+ * @brief Generic half-size area downscale.
+ */
+inline void halveFrame(const cv::Mat& src, cv::Mat& dst) {
+    cv::resize(src, dst, cv::Size(src.cols / 2, src.rows / 2), 0, 0, cv::INTER_AREA);
+}
+
+/**
+ * @brief 2x2 box average of BGR pixel pairs: count output pixels from rows a and b.
+ */
+inline void halvePixels(const uchar* a, const uchar* b, uchar* out, int count) {
+    for (int x = 0; x < count; ++x, a += 6, b += 6, out += 3) {
+        for (int c = 0; c < 3; ++c) {
+            out[c] = static_cast<uchar>((a[c] + a[c + 3] + b[c] + b[c + 3] + 2) >> 2);
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Rounded mean of the 16 bytes at a, a + 3, b and b + 3.
+ *
+ * Byte j holds the 2x2 average of the pixel pair starting at byte j, it is an output
+ * byte wherever j is the first half of a pair.
+ */
+__attribute__((target("ssse3")))
+inline __m128i averageQuad(const uchar* a, const uchar* b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    const __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 3));
+    const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    const __m128i y3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 3));
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(x3, zero)),
+                               _mm_add_epi16(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi8(y3, zero)));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(x3, zero)),
+                               _mm_add_epi16(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi8(y3, zero)));
+    const __m128i two = _mm_set1_epi16(2);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+    return _mm_packus_epi16(lo, hi);
+}
+
+/**
+ * @brief Halves BGR rows of RowBytes bytes, 16 source pixels (48 bytes) into 8 per block.
+ *
+ * The output bytes of the three averaged vectors are gathered with pshufb. The 3-byte
+ * overlapping loads of the last block read into the next row, so the very last block of
+ * the frame is done by halvePixels() instead.
+ */
+template <size_t RowBytes, int Rows>
+__attribute__((target("ssse3")))
+inline void halveBgrSsse3(const uchar* src, uchar* dst) {
+    static_assert(RowBytes % 48 == 0 && Rows % 2 == 0, "whole blocks of 16 pixels per row pair");
+    const __m128i m0 = _mm_setr_epi8(0, 1, 2, 6, 7, 8, 12, 13, 14, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i m1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 4, 8, 9, 10, 14);
+    const __m128i m2 = _mm_setr_epi8(15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i m3 = _mm_setr_epi8(-1, 0, 4, 5, 6, 10, 11, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+    constexpr size_t blocks = RowBytes / 48;
+    for (int r = 0; r < Rows / 2; ++r) {
+        const uchar* a = src + 2 * r * RowBytes;
+        const uchar* b = a + RowBytes;
+        uchar* out = dst + r * (RowBytes / 2);
+        const size_t simdBlocks = r + 1 < Rows / 2 ? blocks : blocks - 1;
+        for (size_t i = 0; i < simdBlocks; ++i, a += 48, b += 48, out += 24) {
+            const __m128i h0 = averageQuad(a, b);
+            const __m128i h1 = averageQuad(a + 16, b + 16);
+            const __m128i h2 = averageQuad(a + 32, b + 32);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                             _mm_or_si128(_mm_shuffle_epi8(h0, m0), _mm_shuffle_epi8(h1, m1)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16),
+                             _mm_or_si128(_mm_shuffle_epi8(h1, m2), _mm_shuffle_epi8(h2, m3)));
+        }
+        if (simdBlocks < blocks) {
+            halvePixels(a, b, out, 8);
+        }
+    }
+}
+#endif
+
+template <size_t RowBytes, int Rows>
+inline void halveBgrScalar(const uchar* src, uchar* dst) {
+    for (int r = 0; r < Rows / 2; ++r) {
+        const uchar* a = src + 2 * r * RowBytes;
+        halvePixels(a, a + RowBytes, dst + r * (RowBytes / 2), static_cast<int>(RowBytes / 6));
+    }
+}
+
+/**
+ * @brief Kernels of one frame shape, selected once per stream.
+ */
+struct FrameKernels {
+    const char* name;                            ///< "generic" or the profile, e.g. "1920x1280 bgr"
+    size_t bufferAlign;                          ///< Alignment of the stream's pool buffers, 0 for a page
+    void (*generate)(cv::Mat& dst, fastrandom::Key key);
+    framehash::HashFn hash;
+    void (*halve)(const cv::Mat& src, cv::Mat& dst);
+};
+
+/**
+ * @brief Kernels specialized for W x H CV_8UC3 frames.
+ */
+template <int W, int H>
+struct Bgr8Profile {
+    static constexpr size_t rowBytes = static_cast<size_t>(W) * 3;
+    static constexpr size_t frameBytes = rowBytes * H;
+    static constexpr size_t bufferAlign = 2 << 20;
+    static_assert(frameBytes % 256 == 0, "whole unrolled fill iterations for every instruction set");
+
+    static bool matches(const cv::Mat& img) {
+        return img.cols == W && img.rows == H && img.type() == CV_8UC3 && img.isContinuous();
+    }
+
+    static void generate(cv::Mat& dst, fastrandom::Key key) {
+        static const fastrandom::FixedFillFn fill = fastrandom::fixedFillImpl<frameBytes / 4>();
+        if (!matches(dst)) {
+            fillFrame(dst, key);
+            return;
+        }
+        fill(dst.data, key);
+    }
+
+    static uint64_t hash(const cv::Mat& img) {
+        if (!matches(img)) {
+            return framehash::hashFrame(img);
+        }
+        return framehash::xxh64Fixed<frameBytes>(img.data, framehash::shapeSeed(H, W, CV_8UC3));
+    }
+
+    static void halve(const cv::Mat& src, cv::Mat& dst) {
+        if (!matches(src)) {
+            halveFrame(src, dst);
+            return;
+        }
+        dst.create(H / 2, W / 2, CV_8UC3);
+        if (!dst.isContinuous()) {
+            halveFrame(src, dst);
+            return;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        static const bool ssse3 = __builtin_cpu_supports("ssse3");
+        if (ssse3) {
+            halveBgrSsse3<rowBytes, H>(src.data, dst.data);
+            return;
+        }
+#endif
+        halveBgrScalar<rowBytes, H>(src.data, dst.data);
+    }
+
+    static const FrameKernels& kernels() {
+        static const FrameKernels k = { name(), bufferAlign, generate, hash, halve };
+        return k;
+    }
+
+    static const char* name() {
+        static char text[32];
+        static const int n = std::snprintf(text, sizeof(text), "%dx%d bgr", W, H);
+        (void)n;
+        return text;
+    }
+};
+
+inline const FrameKernels& genericKernels() {
+    static const FrameKernels k = {
+        "generic", 0, fillFrame, framehash::hashFrame, halveFrame
+    };
+    return k;
+}
+
+/**
+ * @brief Kernels of a stream: its fixed profile when there is one, else the generic loops.
+ *
+ * @param specialize false forces the generic loops (--kernels generic).
+ */
+inline const FrameKernels& selectFrameKernels(int width, int height, int type, bool specialize) {
+    if (specialize && type == CV_8UC3) {
+        if (width == 1920 && height == 1280) {
+            return Bgr8Profile<1920, 1280>::kernels();
+        }
+        if (width == 3840 && height == 2160) {
+            return Bgr8Profile<3840, 2160>::kernels();
+        }
+    }
+    return genericKernels();
+}
+
+}
+
+#endif
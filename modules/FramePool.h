@@ -0,0 +1,162 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+#include <opencv2/core.hpp>
+#include "FrameData.h"
+#include "RingBuffer.h"
+
+/**
+ * @brief Fixed set of pre-allocated, page-aligned frame buffers recycled between producer and consumers.
+ *
+ * Every buffer is allocated and touched once at construction, so checking a frame out on the
+ * hot path costs no malloc and no page faults, and the pool size is a hard cap on frame memory.
+ * The free list is a lock-free RingBuffer of slot indices. A buffer can be shared by several
+ * frames (--derive crops are views of it), it goes back to the free list with its last release.
+ * When built with libnuma the buffers can be bound to a NUMA node before that first touch.
+ *
+ * @param count Number of buffers in the pool.
+ * @param width Frame width in pixels.
+ * @param height Frame height in pixels.
+ * @param type OpenCV pixel type of every frame (e.g. CV_8UC3).
+ * @param node NUMA node of the buffers, -1 leaves placement to the kernel.
+ * @param align Alignment of every buffer, 0 for a page; above a page the buffers are also
+ *        advised for transparent huge pages (fixed profiles use 2 MB, see FrameKernels.h).
+ */
+class FramePool {
+    public:
+        FramePool(int count, int width, int height, int type, int node = -1, size_t align = 0)
+            : freeSlots(count), refs(new std::atomic<int>[count]), width(width), height(height), type(type) {
+            const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t frameBytes = static_cast<size_t>(width) * height * CV_ELEM_SIZE(type);
+            bufferBytes = (frameBytes + page - 1) / page * page;
+            for (int i = 0; i < count; ++i) {
+                void* buf = nullptr;
+                if (posix_memalign(&buf, std::max(page, align), bufferBytes) != 0) {
+                    throw std::bad_alloc();
+                }
+#ifdef MADV_HUGEPAGE
+                if (align > page) {
+                    madvise(buf, bufferBytes, MADV_HUGEPAGE);
+                }
+#endif
+#ifdef HAVE_LIBNUMA
+                if (node >= 0) {
+                    numa_tonode_memory(buf, bufferBytes, node);
+                }
+#endif
+                std::memset(buf, 0, bufferBytes); // Fault every page in now, not during the run
+                buffers.push_back(static_cast<uchar*>(buf));
+                refs[i].store(0, std::memory_order_relaxed);
+                freeSlots.tryPush(i);
+            }
+        }
+
+        ~FramePool() {
+            for (uchar* buf : buffers) {
+                free(buf);
+            }
+        }
+
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        /**
+         * @brief Checks a free buffer out of the pool.
+         *
+         * @param out Receives a cv::Mat header over the buffer plus its pool slot.
+         * @return false if every buffer is in flight.
+         */
+        bool acquire(img_data& out) {
+            int slot;
+            if (!freeSlots.tryPop(slot)) {
+                exhausted.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            refs[slot].store(1, std::memory_order_relaxed);
+            out.img = cv::Mat(height, width, type, buffers[slot]);
+            out.pool = this;
+            out.slot = slot;
+            return true;
+        }
+
+        /**
+         * @brief Adds a frame that shares the buffer of a slot; it needs its own releaseFrame().
+         */
+        void retain(int slot) {
+            refs[slot].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Drops one reference to a buffer, the last one returns it to the pool.
+         */
+        void release(int slot) {
+            if (refs[slot].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                freeSlots.tryPush(slot);
+            }
+        }
+
+        size_t capacity() const {
+            return buffers.size();
+        }
+
+        size_t available() const {
+            return freeSlots.size();
+        }
+
+        size_t bytes() const {
+            return buffers.size() * bufferBytes;
+        }
+
+        /**
+         * @brief Memory of a slot, e.g. to page-lock it for DMA (FrameEncoder::registerHostBuffer()).
+         */
+        uchar* buffer(int slot) const {
+            return buffers[slot];
+        }
+
+        size_t slotBytes() const {
+            return bufferBytes;
+        }
+
+        int getExhaustedCount() const {
+            return exhausted.load(std::memory_order_relaxed);
+        }
+
+    private:
+        RingBuffer<int> freeSlots;
+        std::unique_ptr<std::atomic<int>[]> refs;  ///< Frames using each slot
+        std::vector<uchar*> buffers;
+        size_t bufferBytes;
+        int width;
+        int height;
+        int type;
+        std::atomic<int> exhausted{0};
+};
+
+/**
+ * @brief Hands a frame's buffer back to its pool, if it has one.
+ *
+ * Call exactly once per pooled frame, after it has been saved or dropped.
+ */
+inline void releaseFrame(img_data& data) {
+    if (data.pool != nullptr) {
+        data.img.release();
+        data.pool->release(data.slot);
+        data.pool = nullptr;
+        data.slot = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <chrono>
+#include <cstddef>
+#include "FrameData.h"
+#include "Backpressure.h"
+
+/**
+ * @brief Common interface of the queues that carry frames from the producer to the consumers.
+ *
+ * push() applies the overflow policy when the queue is full, waitPop() blocks a consumer until
+ * a frame is available or the queue has been closed and fully drained.
+ */
+class FrameQueue {
+    public:
+        virtual ~FrameQueue() {}
+
+        /**
+         * @brief Enqueues a frame, applying the overflow policy if the queue is full.
+         *
+         * @return true if the frame was queued, false if it was discarded (its pool buffer is released).
+         */
+        virtual bool push(const img_data& data) = 0;
+
+        /**
+         * @brief Enqueues a frame only if there is room, without applying the overflow policy.
+         *
+         * @return false if the queue is full; the frame is left to the caller.
+         */
+        virtual bool tryPush(const img_data& data) = 0;
+
+        /**
+         * @brief Waits for the next frame.
+         *
+         * @param out Receives the dequeued frame.
+         * @return false once the queue is closed and empty, true otherwise.
+         */
+        virtual bool waitPop(img_data& out) = 0;
+
+        /**
+         * @brief Dequeues a frame only if one is ready, used to serve several queues from one consumer pool.
+         *
+         * @return false if the queue is empty.
+         */
+        virtual bool tryPop(img_data& out) = 0;
+
+        /**
+         * @brief Marks the end of the stream and wakes every waiting consumer.
+         */
+        virtual void close() = 0;
+
+        virtual size_t size() = 0;
+        virtual size_t capacity() = 0;
+
+        int getDropCount() {
+            return stats.total();
+        }
+
+        OverflowPolicy policy = OverflowPolicy::DropOldest;
+        std::chrono::milliseconds blockTimeout{100};
+        OverflowStats stats;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+/**
+ * @brief What the scheduler does when the producer wakes up after one or more deadlines passed.
+ */
+enum class LatePolicy {
+    CatchUp, ///< Emit every missed frame back to back until the schedule is met again.
+    Skip     ///< Jump to the current deadline, the missed frames are never emitted.
+};
+
+/**
+ * @brief Drift-free frame clock: frame n is due at start + n * period on steady_clock.
+ *
+ * Deadlines are computed from the start time, never from the previous wake-up, so the time
+ * spent pushing and logging is paid back on the next frame instead of accumulating as drift.
+ * The last spin interval before each deadline is busy-waited to avoid oversleeping.
+ * Several producers can share one stream's schedule: producer j of P only waits for the
+ * frames j, j + P, j + 2P, ...
+ *
+ * @param fps Target frames per second.
+ * @param spin Busy-wait window before each deadline (zero disables spinning).
+ * @param late Policy applied to frames whose deadline already passed.
+ * @param first First frame of this producer on the schedule.
+ * @param stride Number of producers sharing the schedule.
+ */
+class FrameScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        FrameScheduler(double fps, std::chrono::nanoseconds spin, LatePolicy late, int64_t first = 0, int64_t stride = 1)
+            : fps(fps), spin(spin), late(late), first(first), stride(stride > 0 ? stride : 1) {}
+
+        /**
+         * @brief Starts the schedule at t0; frames due at end or later are not part of it.
+         */
+        void start(Clock::time_point t0, Clock::time_point end = Clock::time_point::max()) {
+            startTime = t0;
+            endTime = end;
+            next = first;
+        }
+
+        Clock::time_point deadline(int64_t n) const {
+            return startTime + std::chrono::nanoseconds(std::llround(static_cast<double>(n) * 1e9 / fps));
+        }
+
+        /**
+         * @brief Deadline of the frame that waitNext() will return next.
+         */
+        Clock::time_point nextDeadline() const {
+            return deadline(next);
+        }
+
+        /**
+         * @brief Waits until the next frame is due and records its wake-up jitter.
+         *
+         * @return Index of the due frame on the schedule.
+         */
+        int64_t waitNext() {
+            Clock::time_point due = deadline(next);
+            Clock::time_point now = Clock::now();
+
+            if (late == LatePolicy::Skip && now >= deadline(next + stride)) {
+                int64_t current = static_cast<int64_t>(
+                    std::chrono::duration<double>(now - startTime).count() * fps);
+                // Last frame of this producer that is already due, and still before the end:
+                // past it the producer emits that last frame and stops, nothing beyond
+                int64_t jump = (current - next) / stride;
+                if (endTime != Clock::time_point::max()) {
+                    int64_t last = static_cast<int64_t>(
+                        std::ceil(std::chrono::duration<double>(endTime - startTime).count() * fps)) - 1;
+                    jump = std::max<int64_t>(std::min(jump, (last - next) / stride), 0);
+                }
+                skipped += jump;
+                next += jump * stride;
+                due = deadline(next);
+            }
+
+            if (now < due) {
+                if (due - now > spin) {
+                    std::this_thread::sleep_until(due - spin);
+                }
+                while ((now = Clock::now()) < due) {
+                    // Spin for the last few microseconds
+                }
+            } else if (now - due > std::chrono::nanoseconds(std::llround(1e9 / fps))) {
+                lateFrames++;
+            }
+
+            int64_t jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count();
+            jitterSum += jitter;
+            if (jitter > jitterMax) {
+                jitterMax = jitter;
+            }
+            lastJitter = jitter;
+            waits++;
+            int64_t dueFrame = next;
+            next += stride;
+            return dueFrame;
+        }
+
+        /** @brief Wake-up delay of the last frame, in nanoseconds. */
+        int64_t getLastJitter() const { return lastJitter; }
+        double getMeanJitterUs() const { return waits ? jitterSum / 1000.0 / waits : 0.0; }
+        double getMaxJitterUs() const { return jitterMax / 1000.0; }
+        /** @brief Frames that woke up more than one period after their deadline. */
+        int64_t getLateFrames() const { return lateFrames; }
+        /** @brief Deadlines dropped by the Skip policy. */
+        int64_t getSkippedFrames() const { return skipped; }
+
+    private:
+        double fps;
+        std::chrono::nanoseconds spin;
+        LatePolicy late;
+        int64_t first;
+        int64_t stride;
+        Clock::time_point startTime;
+        Clock::time_point endTime = Clock::time_point::max();
+        int64_t next = 0;
+        int64_t waits = 0;
+        int64_t lastJitter = 0;
+        double jitterSum = 0;
+        int64_t jitterMax = 0;
+        int64_t lateFrames = 0;
+        int64_t skipped = 0;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FrameData.h"
+#include "WritePacer.h"
+
+/**
+ * @brief Destination of encoded frames, used by the writer stage.
+ *
+ * write() may be called concurrently from every writer thread.
+ */
+class FrameSink {
+    public:
+        virtual ~FrameSink() {}
+
+        /**
+         * @brief Persists one encoded frame.
+         *
+         * @return true if every byte reached the sink.
+         */
+        virtual bool write(const encoded_frame& frame) = 0;
+
+        /**
+         * @brief Persists a batch of frames; backends that can submit I/O in bulk override it.
+         *
+         * @param frames Frames to write.
+         * @param n Number of frames.
+         * @param ok Receives the result of every frame.
+         */
+        virtual void writeBatch(const encoded_frame* frames, int n, bool* ok) {
+            for (int i = 0; i < n; ++i) {
+                ok[i] = write(frames[i]);
+            }
+        }
+
+        /**
+         * @brief Called once after the last frame, before the sink is destroyed.
+         */
+        virtual void flush() {}
+
+        /**
+         * @brief Makes every frame written so far durable; called by the frame journal.
+         *
+         * @return false if the data could not be synced.
+         */
+        virtual bool sync() {
+            return true;
+        }
+
+        /**
+         * @brief Prints backend specific statistics for the final report.
+         */
+        virtual void report(std::ostream& out) {}
+
+        /**
+         * @brief Hands every range written from now on to pacer (--flush-mb); backends that
+         * do not call it leave the writeback to the kernel.
+         */
+        void setPacer(WritePacer* p) {
+            pacer = p;
+        }
+
+    protected:
+        WritePacer* pacer = nullptr;
+};
+
+static const size_t FRAME_PATH_MAX = 512;
+
+/**
+ * @brief Path of a frame, "<dir>/random_image_<id + 1>.<ext>", with a "stream<n>_" prefix
+ * for every stream but the first one and a "_d<k>" suffix for the k-th --derive output.
+ *
+ * Formatted into the caller's buffer, so naming a frame allocates nothing.
+ *
+ * @return false if the path does not fit in size bytes.
+ */
+inline bool frameFilePath(char* buf, size_t size, const std::string& dir, const encoded_frame& frame, const std::string& ext) {
+    char prefix[24] = "";
+    char suffix[16] = "";
+    if (frame.stream > 0) {
+        std::snprintf(prefix, sizeof(prefix), "stream%d_", frame.stream);
+    }
+    if (frame.derivative > 0) {
+        std::snprintf(suffix, sizeof(suffix), "_d%d", frame.derivative);
+    }
+    int n = std::snprintf(buf, size, "%s/%srandom_image_%d%s.%s", dir.c_str(), prefix, frame.id + 1, suffix, ext.c_str());
+    return n > 0 && static_cast<size_t>(n) < size;
+}
+
+/**
+ * @brief syncfs(2) of the filesystem holding dir: one call flushes every frame file in
+ * it, instead of an fsync per file.
+ */
+inline bool syncDirectory(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+/**
+ * @brief Writes every frame to its own file, at frameFilePath().
+ *
+ * @param dir Output directory.
+ * @param ext Image format extension, without the dot.
+ */
+class FileSink : public FrameSink {
+    public:
+        FileSink(const std::string& dir, const std::string& ext) : dir(dir), ext(ext) {}
+
+        bool write(const encoded_frame& frame) override {
+            char path[FRAME_PATH_MAX];
+            if (!frameFilePath(path, sizeof(path), dir, frame, ext)) {
+                return false;
+            }
+            int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return false;
+            }
+            bool ok = writeAll(fd, frame.bytes.data(), frame.bytes.size());
+            if (ok && pacer != nullptr && pacer->windowed()) {
+                // Closed by the pacer once its writeback is done
+                pacer->written(fd, 0, frame.bytes.size(), true);
+                return true;
+            }
+            return ::close(fd) == 0 && ok;
+        }
+
+        void flush() override {
+            if (pacer != nullptr) {
+                pacer->drain();
+            }
+        }
+
+        bool sync() override {
+            return syncDirectory(dir);
+        }
+
+        /**
+         * @brief write(2) until every byte is out, retrying short writes and EINTR.
+         */
+        static bool writeAll(int fd, const void* data, size_t len) {
+            const char* p = static_cast<const char*>(data);
+            while (len > 0) {
+                ssize_t n = ::write(fd, p, len);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                p += n;
+                len -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+    private:
+        std::string dir;
+        std::string ext;
+};
+
+#endif
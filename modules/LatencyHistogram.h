@@ -0,0 +1,219 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Monotonic timestamp in nanoseconds, the clock of every pipeline stage time.
+ */
+inline int64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Pipeline stages timed for every frame.
+ */
+enum class Stage {
+    Generate,   ///< Capture to generated
+    Derive,     ///< Generated to all --derive outputs built
+    Push,       ///< Time spent inside FrameQueue::push (includes blocking)
+    QueueWait,  ///< Enqueued to dequeued by an encoder
+    Encode,     ///< Dequeued to encoded
+    WriteWait,  ///< Encoded to picked up by a writer
+    Write,      ///< Picked up to persisted (its whole write batch)
+    EndToEnd,   ///< Capture to persisted
+    Count
+};
+
+inline const char* stageName(Stage stage) {
+    static const char* names[] = { "generate", "derive", "push", "queue wait", "encode", "write wait", "write", "end to end" };
+    return names[static_cast<int>(stage)];
+}
+
+/**
+ * @brief Log-linear (HDR-style) histogram of nanosecond values, about 3% resolution.
+ *
+ * Values below 32 get their own bucket, above that every power of two is split into 32
+ * sub-buckets. Only the owning thread records, with relaxed load/store pairs instead of
+ * read-modify-write, so recording costs a few instructions and any thread can read the
+ * counters while the run goes on.
+ */
+class LatencyHistogram {
+    public:
+        static const int SUB_BITS = 5;
+        static const int SUB_COUNT = 1 << SUB_BITS;
+        static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+        void record(int64_t ns) {
+            uint64_t v = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+            std::atomic<uint64_t>& bucket = counts[indexOf(v)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            sum.store(sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+            if (v > max.load(std::memory_order_relaxed)) {
+                max.store(v, std::memory_order_relaxed);
+            }
+        }
+
+        static int indexOf(uint64_t v) {
+            if (v < static_cast<uint64_t>(SUB_COUNT)) {
+                return static_cast<int>(v);
+            }
+            int exp = 63 - __builtin_clzll(v);
+            int sub = static_cast<int>((v >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+            return (exp - SUB_BITS + 1) * SUB_COUNT + sub;
+        }
+
+        /**
+         * @brief Midpoint of the values that fall in a bucket.
+         */
+        static uint64_t valueOf(int index) {
+            if (index < SUB_COUNT) {
+                return static_cast<uint64_t>(index);
+            }
+            int exp = index / SUB_COUNT + SUB_BITS - 1;
+            uint64_t sub = static_cast<uint64_t>(index % SUB_COUNT);
+            uint64_t low = (static_cast<uint64_t>(SUB_COUNT) + sub) << (exp - SUB_BITS);
+            return low + (1ULL << (exp - SUB_BITS)) / 2;
+        }
+
+        std::atomic<uint64_t> counts[BUCKETS] = {};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+};
+
+/**
+ * @brief Plain copy of one or more histograms, used to merge and query them.
+ */
+struct LatencySnapshot {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(LatencyHistogram::BUCKETS, 0);
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void add(const LatencyHistogram& h) {
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            counts[i] += h.counts[i].load(std::memory_order_relaxed);
+        }
+        total += h.total.load(std::memory_order_relaxed);
+        sum += h.sum.load(std::memory_order_relaxed);
+        max = std::max(max, h.max.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Value below which a fraction q of the samples lie, in nanoseconds.
+     */
+    uint64_t percentile(double q) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(LatencyHistogram::valueOf(i), max);
+            }
+        }
+        return max;
+    }
+
+    double meanNs() const {
+        return total ? static_cast<double>(sum) / total : 0.0;
+    }
+
+    /**
+     * @brief Samples recorded since an earlier snapshot of the same histograms.
+     *
+     * The max of the interval is the top of its highest non-empty bucket.
+     */
+    LatencySnapshot since(const LatencySnapshot& earlier) const {
+        LatencySnapshot out;
+        out.total = total - earlier.total;
+        out.sum = sum - earlier.sum;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            out.counts[i] = counts[i] - earlier.counts[i];
+            if (out.counts[i] > 0) {
+                out.max = std::min(LatencyHistogram::valueOf(i), max);
+            }
+        }
+        return out;
+    }
+};
+
+/**
+ * @brief Registry of the per-thread stage histograms.
+ *
+ * Each thread records into its own set, created on its first sample; snapshot() merges
+ * the sets of every thread, including threads that already exited. Every pipeline owns a
+ * recorder; a thread is expected to record into one of them for its whole life.
+ */
+class LatencyRecorder {
+    public:
+        LatencyRecorder() : id(nextId().fetch_add(1, std::memory_order_relaxed) + 1) {}
+
+        LatencyRecorder(const LatencyRecorder&) = delete;
+        LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+        /**
+         * @brief Recorder of code that runs outside a pipeline, e.g. the benchmarks.
+         */
+        static LatencyRecorder& instance() {
+            static LatencyRecorder recorder;
+            return recorder;
+        }
+
+        /**
+         * @brief Records one sample of a stage in the calling thread's histogram.
+         */
+        void record(Stage stage, int64_t ns) {
+            local()[static_cast<int>(stage)].record(ns);
+        }
+
+        LatencySnapshot snapshot(Stage stage) {
+            LatencySnapshot out;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& set : sets) {
+                out.add(set->stages[static_cast<int>(stage)]);
+            }
+            return out;
+        }
+
+    private:
+        struct StageSet {
+            LatencyHistogram stages[static_cast<int>(Stage::Count)];
+        };
+
+        static std::atomic<uint64_t>& nextId() {
+            static std::atomic<uint64_t> counter{0};
+            return counter;
+        }
+
+        LatencyHistogram* local() {
+            // Keyed by id, not address: a later recorder may reuse a destroyed one's memory
+            thread_local uint64_t owner = 0;
+            thread_local LatencyHistogram* mine = nullptr;
+            if (owner != id) {
+                std::unique_ptr<StageSet> fresh(new StageSet());
+                std::lock_guard<std::mutex> lock(mutex);
+                sets.push_back(std::move(fresh));
+                mine = sets.back()->stages;
+                owner = id;
+            }
+            return mine;
+        }
+
+        const uint64_t id;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<StageSet>> sets;
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "RingBuffer.h"
+
+/**
+ * @brief Log verbosity, each level includes the ones before it.
+ */
+enum class LogLevel {
+    Quiet = 0,
+    Error,
+    Warn,
+    Info,
+    Debug
+};
+
+/**
+ * @brief Parses a --log-level value.
+ *
+ * @return false if the name is unknown.
+ */
+inline bool parseLogLevel(const std::string& name, LogLevel& out) {
+    if (name == "quiet") {
+        out = LogLevel::Quiet;
+    } else if (name == "error") {
+        out = LogLevel::Error;
+    } else if (name == "warn") {
+        out = LogLevel::Warn;
+    } else if (name == "info") {
+        out = LogLevel::Info;
+    } else if (name == "debug") {
+        out = LogLevel::Debug;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Asynchronous logger: hot threads enqueue raw records, a background thread formats them.
+ *
+ * Every thread logs into its own lock-free ring, so logging from the producer or a consumer is
+ * a level check plus a copy of the format pointer and arguments; the "{}" placeholders are
+ * only expanded by the drain thread, which writes whole batches with a single fwrite. When a
+ * level is disabled the LOG_* macros skip the call entirely, so quiet runs do no work at all.
+ *
+ * Arguments may be integers, floating point numbers or C strings; strings are stored by
+ * pointer and must stay alive until the logger is stopped (literals, configuration strings).
+ */
+class Logger {
+    public:
+        static const int MAX_ARGS = 6;
+        static const size_t RING_SIZE = 4096;
+
+        static Logger& instance() {
+            static Logger logger;
+            return logger;
+        }
+
+        void setLevel(LogLevel lvl) {
+            level.store(static_cast<int>(lvl), std::memory_order_relaxed);
+        }
+
+        bool enabled(LogLevel lvl) const {
+            return static_cast<int>(lvl) <= level.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Starts the background drain thread; the logger is shared by every pipeline
+         * of the process, only the first start() does.
+         */
+        void start() {
+            std::lock_guard<std::mutex> lock(lifecycle);
+            if (users++ > 0) {
+                return;
+            }
+            running.store(true, std::memory_order_release);
+            drainThread = std::thread([this] {
+                while (running.load(std::memory_order_acquire)) {
+                    if (drain() == 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                }
+                drain();
+            });
+        }
+
+        /**
+         * @brief Flushes every pending record and stops the drain thread, at the last stop().
+         */
+        void stop() {
+            std::lock_guard<std::mutex> lock(lifecycle);
+            if (users > 0 && --users > 0) {
+                return;
+            }
+            if (drainThread.joinable()) {
+                running.store(false, std::memory_order_release);
+                drainThread.join();
+            } else {
+                drain();
+            }
+            if (dropped.load() > 0) {
+                std::fprintf(stderr, "[Logger] %d log records dropped (ring full)\n", dropped.load());
+            }
+        }
+
+        template <typename... Args>
+        void log(LogLevel lvl, const char* fmt, Args... args) {
+            static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+            Record rec;
+            rec.level = lvl;
+            rec.fmt = fmt;
+            rec.nargs = 0;
+            (rec.add(args), ...);
+            if (!localRing()->tryPush(rec)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        struct Arg {
+            enum Kind { Int, Double, Str } kind;
+            union {
+                long long i;
+                double d;
+                const char* s;
+            };
+        };
+
+        struct Record {
+            LogLevel level = LogLevel::Info;
+            const char* fmt = nullptr;
+            int nargs = 0;
+            Arg args[MAX_ARGS];
+
+            template <typename T>
+            void add(T value) {
+                Arg& a = args[nargs++];
+                if constexpr (std::is_floating_point<T>::value) {
+                    a.kind = Arg::Double;
+                    a.d = value;
+                } else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+                    a.kind = Arg::Int;
+                    a.i = static_cast<long long>(value);
+                } else {
+                    a.kind = Arg::Str;
+                    a.s = value;
+                }
+            }
+        };
+
+        using Ring = RingBuffer<Record>;
+
+        Logger() = default;
+
+        ~Logger() {
+            stop();
+        }
+
+        /**
+         * @brief Ring of the calling thread, created and registered on its first log call.
+         */
+        Ring* localRing() {
+            thread_local Ring* ring = nullptr;
+            if (ring == nullptr) {
+                std::lock_guard<std::mutex> lock(ringsMutex);
+                rings.emplace_back(new Ring(RING_SIZE));
+                ring = rings.back().get();
+            }
+            return ring;
+        }
+
+        static void format(std::string& out, const Record& rec) {
+            int next = 0;
+            char buf[64];
+            for (const char* p = rec.fmt; *p; ++p) {
+                if (p[0] == '{' && p[1] == '}' && next < rec.nargs) {
+                    const Arg& a = rec.args[next++];
+                    if (a.kind == Arg::Int) {
+                        std::snprintf(buf, sizeof(buf), "%lld", a.i);
+                        out += buf;
+                    } else if (a.kind == Arg::Double) {
+                        std::snprintf(buf, sizeof(buf), "%g", a.d);
+                        out += buf;
+                    } else {
+                        out += a.s ? a.s : "(null)";
+                    }
+                    ++p;
+                } else {
+                    out += *p;
+                }
+            }
+            out += '\n';
+        }
+
+        /**
+         * @brief Formats and writes every queued record, errors go to stderr.
+         *
+         * @return Number of records written.
+         */
+        size_t drain() {
+            std::vector<Ring*> snapshot;
+            {
+                std::lock_guard<std::mutex> lock(ringsMutex);
+                for (auto& r : rings) {
+                    snapshot.push_back(r.get());
+                }
+            }
+            size_t count = 0;
+            Record rec;
+            for (Ring* r : snapshot) {
+                while (r->tryPop(rec)) {
+                    format(rec.level <= LogLevel::Warn ? errBatch : outBatch, rec);
+                    count++;
+                }
+            }
+            if (!outBatch.empty()) {
+                std::fwrite(outBatch.data(), 1, outBatch.size(), stdout);
+                std::fflush(stdout);
+                outBatch.clear();
+            }
+            if (!errBatch.empty()) {
+                std::fwrite(errBatch.data(), 1, errBatch.size(), stderr);
+                errBatch.clear();
+            }
+            return count;
+        }
+
+        std::atomic<int> level{static_cast<int>(LogLevel::Info)};
+        std::atomic<bool> running{false};
+        std::atomic<int> dropped{0};
+        std::thread drainThread;
+        std::mutex lifecycle;   ///< Guards users and the drain thread's start and stop
+        int users = 0;          ///< Pipelines between start() and stop()
+        std::mutex ringsMutex;
+        std::vector<std::unique_ptr<Ring>> rings;
+        std::string outBatch;
+        std::string errBatch;
+};
+
+#define LOG_AT(lvl, ...) \
+    do { \
+        if (Logger::instance().enabled(lvl)) { \
+            Logger::instance().log(lvl, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef RAW_SINK_H
+#define RAW_SINK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <opencv2/core.hpp>
+#include "FrameData.h"
+#include "FrameSink.h"
+
+/**
+ * @struct RawFileHeader
+ * @brief First page of a raw frame file; frame n starts at dataOffset + n * frameStride.
+ */
+struct RawFileHeader {
+    char magic[8];         ///< "FPSRAW1"
+    uint32_t width;
+    uint32_t height;
+    int32_t type;          ///< OpenCV type of the pixels, CV_8UC3 (BGR)
+    uint32_t stream;       ///< Camera stream of the file
+    uint64_t frameBytes;   ///< Tightly packed rows of one frame
+    uint64_t frameStride;  ///< frameBytes rounded up to a page
+    uint64_t dataOffset;   ///< Offset of frame 0, one page
+    uint64_t frames;       ///< One past the highest frame id written, updated at every sync
+    double fps;
+};
+
+/**
+ * @brief Raw frames of one stream in a preallocated, memory-mapped file.
+ *
+ * Every frame id has a fixed, page-aligned slot, so producers generate straight into the
+ * mapping and frames may complete in any order. The file is preallocated (posix_fallocate)
+ * and mapped one chunk of frames at a time; a chunk is unmapped once all its frames are in,
+ * by the next sync when one is scheduled (the frame journal), so msync always runs over
+ * mapped memory.
+ *
+ * @param path File to create, or with append to continue (--resume).
+ * @param maxFrames Number of frame slots the run may use.
+ * @param chunkBytes Size of each mapping.
+ * @param deferUnmap Leave complete chunks to sync() instead of unmapping them at once.
+ */
+class RawFrameFile {
+    public:
+        RawFrameFile(const std::string& path, int width, int height, int type, int stream, double fps,
+                     int64_t maxFrames, uint64_t chunkBytes, bool deferUnmap, bool append)
+            : deferUnmap(deferUnmap) {
+            const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            header = RawFileHeader();
+            std::memcpy(header.magic, "FPSRAW1", sizeof(header.magic));
+            header.width = static_cast<uint32_t>(width);
+            header.height = static_cast<uint32_t>(height);
+            header.type = type;
+            header.stream = static_cast<uint32_t>(stream);
+            header.frameBytes = static_cast<uint64_t>(width) * height * CV_ELEM_SIZE(type);
+            header.frameStride = (header.frameBytes + page - 1) / page * page;
+            header.dataOffset = std::max<uint64_t>(page, sizeof(RawFileHeader));
+            header.fps = fps;
+            framesPerChunk = std::max<int64_t>(1, static_cast<int64_t>(chunkBytes / header.frameStride));
+            int64_t chunkCount = (std::max<int64_t>(maxFrames, 1) + framesPerChunk - 1) / framesPerChunk;
+            chunks = std::vector<std::atomic<uchar*>>(static_cast<size_t>(chunkCount));
+            completed = std::vector<std::atomic<int64_t>>(static_cast<size_t>(chunkCount));
+
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC) | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return;
+            }
+            RawFileHeader existing;
+            if (append && ::pread(fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing))) {
+                if (std::memcmp(existing.magic, "FPSRAW1", 8) != 0 || existing.width != header.width ||
+                    existing.height != header.height || existing.type != header.type) {
+                    ::close(fd);
+                    fd = -1;
+                    return;
+                }
+                header.frames = existing.frames;
+                highWater = static_cast<int64_t>(existing.frames);
+            }
+            if (!writeHeader() || mapChunk(0) == nullptr) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        ~RawFrameFile() {
+            for (size_t c = 0; c < chunks.size(); ++c) {
+                unmapChunk(static_cast<int64_t>(c));
+            }
+            if (fd >= 0) {
+                writeHeader();
+                ::close(fd);
+            }
+        }
+
+        RawFrameFile(const RawFrameFile&) = delete;
+        RawFrameFile& operator=(const RawFrameFile&) = delete;
+
+        bool ok() const {
+            return fd >= 0;
+        }
+
+        /**
+         * @brief Slot of a frame in the mapping, mapping its chunk on first use.
+         *
+         * @return nullptr if the id is past maxFrames or the chunk cannot be mapped.
+         */
+        uchar* frameAt(int id) {
+            int64_t c = id / framesPerChunk;
+            if (id < 0 || c >= static_cast<int64_t>(chunks.size())) {
+                return nullptr;
+            }
+            uchar* base = chunks[c].load(std::memory_order_acquire);
+            if (base == nullptr) {
+                base = mapChunk(c);
+                if (base == nullptr) {
+                    return nullptr;
+                }
+            }
+            return base + (id % framesPerChunk) * header.frameStride;
+        }
+
+        /**
+         * @brief Marks a frame as written; the last frame of a chunk retires the chunk.
+         */
+        void commit(int id) {
+            int64_t c = id / framesPerChunk;
+            int64_t top = highWater.load(std::memory_order_relaxed);
+            while (id + 1 > top && !highWater.compare_exchange_weak(top, id + 1, std::memory_order_relaxed)) {
+            }
+            if (completed[c].fetch_add(1, std::memory_order_acq_rel) + 1 == framesPerChunk) {
+                if (deferUnmap) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    retired.push_back(c);
+                } else {
+                    unmapChunk(c);
+                }
+            }
+        }
+
+        /**
+         * @brief One msync(MS_SYNC) per mapped chunk, then the header and an fdatasync.
+         */
+        bool sync() {
+            if (fd < 0) {
+                return false;
+            }
+            std::vector<int64_t> active;
+            std::vector<int64_t> done;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.swap(retired);
+                for (int64_t c : mapped) {
+                    if (std::find(done.begin(), done.end(), c) == done.end()) {
+                        active.push_back(c);
+                    }
+                }
+            }
+            bool ok = true;
+            const size_t length = static_cast<size_t>(framesPerChunk * header.frameStride);
+            for (int64_t c : active) {
+                ok = ::msync(chunks[c].load(std::memory_order_acquire), length, MS_SYNC) == 0 && ok;
+            }
+            for (int64_t c : done) {
+                ok = ::msync(chunks[c].load(std::memory_order_acquire), length, MS_SYNC) == 0 && ok;
+                unmapChunk(c);
+            }
+            return writeHeader() && ::fdatasync(fd) == 0 && ok;
+        }
+
+        const RawFileHeader& getHeader() const {
+            return header;
+        }
+
+        int64_t getHighWater() const {
+            return highWater.load(std::memory_order_relaxed);
+        }
+
+    private:
+        bool writeHeader() {
+            header.frames = static_cast<uint64_t>(highWater.load(std::memory_order_relaxed));
+            RawFileHeader copy = header; // pwrite a snapshot, callers may race on frames
+            return ::pwrite(fd, &copy, sizeof(copy), 0) == static_cast<ssize_t>(sizeof(copy));
+        }
+
+        uchar* mapChunk(int64_t c) {
+            std::lock_guard<std::mutex> lock(mutex);
+            uchar* base = chunks[c].load(std::memory_order_acquire);
+            if (base != nullptr || fd < 0) {
+                return base;
+            }
+            const off_t offset = static_cast<off_t>(header.dataOffset + c * framesPerChunk * header.frameStride);
+            const size_t length = static_cast<size_t>(framesPerChunk * header.frameStride);
+            // Reserve the blocks now, so a full disk fails here and not as SIGBUS on a store
+            if (::posix_fallocate(fd, offset, static_cast<off_t>(length)) != 0) {
+                return nullptr;
+            }
+            void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+            if (p == MAP_FAILED) {
+                return nullptr;
+            }
+            base = static_cast<uchar*>(p);
+            mapped.push_back(c);
+            chunks[c].store(base, std::memory_order_release);
+            return base;
+        }
+
+        void unmapChunk(int64_t c) {
+            std::lock_guard<std::mutex> lock(mutex);
+            uchar* base = chunks[c].exchange(nullptr, std::memory_order_acq_rel);
+            if (base != nullptr) {
+                ::munmap(base, static_cast<size_t>(framesPerChunk * header.frameStride));
+                mapped.erase(std::find(mapped.begin(), mapped.end(), c));
+            }
+        }
+
+        int fd = -1;
+        RawFileHeader header;
+        const bool deferUnmap;
+        int64_t framesPerChunk = 1;
+        std::vector<std::atomic<uchar*>> chunks;        ///< Mapping of every chunk, null when unmapped
+        std::vector<std::atomic<int64_t>> completed;    ///< Committed frames per chunk
+        std::atomic<int64_t> highWater{0};
+        std::mutex mutex;                               ///< Guards mapping, unmapping, mapped and retired
+        std::vector<int64_t> mapped;
+        std::vector<int64_t> retired;                   ///< Complete chunks waiting for sync() to unmap them
+};
+
+/**
+ * @brief --output raw: one RawFrameFile per stream, no encoding at all.
+ *
+ * The producers generate every frame directly into its slot (frameAt() / commit()), so
+ * nothing goes through the queues, the encoders or the writers. write() copies an already
+ * raw frame (the raw encoder's bytes) into its slot, for callers that have one.
+ *
+ * @param dir Output directory, receives frames.raw and stream<n>_frames.raw.
+ */
+class RawSink : public FrameSink {
+    public:
+        explicit RawSink(const std::string& dir) : dir(dir) {}
+
+        /**
+         * @brief Creates the file of a stream.
+         *
+         * @return false if it cannot be created, or resumed with different dimensions.
+         */
+        bool addStream(int stream, int width, int height, double fps, int64_t maxFrames, uint64_t chunkBytes,
+                       bool deferUnmap, bool append) {
+            char name[64];
+            if (stream > 0) {
+                std::snprintf(name, sizeof(name), "/stream%d_frames.raw", stream);
+            } else {
+                std::snprintf(name, sizeof(name), "/frames.raw");
+            }
+            if (static_cast<int>(files.size()) <= stream) {
+                files.resize(stream + 1);
+            }
+            files[stream].reset(new RawFrameFile(dir + name, width, height, CV_8UC3, stream, fps, maxFrames,
+                                                 chunkBytes, deferUnmap, append));
+            return files[stream]->ok();
+        }
+
+        RawFrameFile* file(int stream) {
+            return files[stream].get();
+        }
+
+        bool write(const encoded_frame& frame) override {
+            RawFrameFile* f = frame.stream < static_cast<int>(files.size()) ? files[frame.stream].get() : nullptr;
+            if (f == nullptr || frame.bytes.size() != f->getHeader().frameBytes) {
+                return false;
+            }
+            uchar* slot = f->frameAt(frame.id);
+            if (slot == nullptr) {
+                return false;
+            }
+            std::memcpy(slot, frame.bytes.data(), frame.bytes.size());
+            f->commit(frame.id);
+            return true;
+        }
+
+        bool sync() override {
+            bool ok = true;
+            for (auto& f : files) {
+                ok = (f == nullptr || f->sync()) && ok;
+            }
+            return ok;
+        }
+
+        void report(std::ostream& out) override {
+            for (auto& f : files) {
+                if (f != nullptr) {
+                    const RawFileHeader& h = f->getHeader();
+                    out << "[Main] Raw output: stream " << h.stream << ", " << f->getHighWater() << " frame slots of "
+                        << h.width << "x" << h.height << ", " << f->getHighWater() * h.frameStride / (1024 * 1024)
+                        << " MB\n";
+                }
+            }
+        }
+
+    private:
+        std::string dir;
+        std::vector<std::unique_ptr<RawFrameFile>> files;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/**
+ * @brief Bounded lock-free multi-producer / multi-consumer ring buffer.
+ *
+ * Each cell carries a sequence number telling whether it is ready to be written or read
+ * (Vyukov's bounded queue), so producers and consumers only contend on their own index.
+ * Indices and cells are padded to a cache line to avoid false sharing.
+ *
+ * @param capacity Number of cells, rounded up to the next power of two.
+ */
+template <typename T>
+class RingBuffer {
+    public:
+        explicit RingBuffer(size_t capacity) {
+            size_t n = 1;
+            while (n < capacity) {
+                n <<= 1;
+            }
+            mask = n - 1;
+            cells.reset(new Cell[n]);
+            for (size_t i = 0; i < n; ++i) {
+                cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+        }
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        /**
+         * @brief Enqueues an item without blocking.
+         * @return false if the buffer is full.
+         */
+        template <typename U>
+        bool tryPush(U&& value) {
+            size_t pos = head.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[pos & mask];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = std::forward<U>(value);
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * @brief Dequeues an item without blocking.
+         * @return false if the buffer is empty.
+         */
+        bool tryPop(T& out) {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[pos & mask];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        out = std::move(cell.value);
+                        cell.value = T();
+                        cell.seq.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * @brief Approximate number of queued items (exact when no operation is in flight).
+         */
+        size_t size() const {
+            size_t h = head.load(std::memory_order_acquire);
+            size_t t = tail.load(std::memory_order_acquire);
+            return h > t ? h - t : 0;
+        }
+
+        size_t capacity() const {
+            return mask + 1;
+        }
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) Cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "FrameData.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
+#include "RingBuffer.h"
+
+/**
+ * @brief FrameQueue backed by a RingBuffer, with a futex-based (std::atomic wait) sleep path.
+ *
+ * The producer never takes a lock: it publishes the frame, bumps an epoch counter and only
+ * issues a wake-up syscall when a consumer is actually sleeping. Under the block policy the
+ * producer sleeps on a second futex that consumers bump after each pop.
+ */
+class RingQueue : public FrameQueue {
+    public:
+        explicit RingQueue(size_t capacity) : ring(capacity) {}
+
+        bool push(const img_data& data) override {
+            if (ring.tryPush(data)) {
+                wake(false);
+                return true;
+            }
+            switch (policy) {
+                case OverflowPolicy::DropNewest: {
+                    stats.droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                    img_data rejected = data;
+                    releaseFrame(rejected);
+                    return false;
+                }
+                case OverflowPolicy::Block:
+                    if (!blockPush(data)) {
+                        img_data rejected = data;
+                        releaseFrame(rejected);
+                        return false;
+                    }
+                    break;
+                default:
+                    while (!ring.tryPush(data)) {
+                        img_data oldest;
+                        if (ring.tryPop(oldest)) { // Drop the oldest frame to make room
+                            releaseFrame(oldest);
+                            stats.droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                    break;
+            }
+            wake(false);
+            return true;
+        }
+
+        bool tryPush(const img_data& data) override {
+            if (!ring.tryPush(data)) {
+                return false;
+            }
+            wake(false);
+            return true;
+        }
+
+        bool waitPop(img_data& out) override {
+            for (;;) {
+                if (ring.tryPop(out)) {
+                    freed();
+                    return true;
+                }
+                sleepers.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seen = epoch.load(std::memory_order_seq_cst);
+                if (ring.tryPop(out)) {
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    freed();
+                    return true;
+                }
+                if (closed.load(std::memory_order_acquire)) {
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    return ring.tryPop(out);
+                }
+                epoch.wait(seen, std::memory_order_seq_cst);
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        bool tryPop(img_data& out) override {
+            if (ring.tryPop(out)) {
+                freed();
+                return true;
+            }
+            return false;
+        }
+
+        void close() override {
+            closed.store(true, std::memory_order_release);
+            wake(true);
+            freed();
+        }
+
+        size_t size() override {
+            return ring.size();
+        }
+
+        size_t capacity() override {
+            return ring.capacity();
+        }
+
+    private:
+        /**
+         * @brief Block policy: waits on a futex for a consumer to free a slot, up to blockTimeout.
+         */
+        bool blockPush(const img_data& data) {
+            stats.blockedPushes.fetch_add(1, std::memory_order_relaxed);
+            auto blockStart = std::chrono::steady_clock::now();
+            auto deadline = blockStart + blockTimeout;
+            bool queued = false;
+            while (!(queued = ring.tryPush(data)) && !closed.load(std::memory_order_acquire)) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline) {
+                    break;
+                }
+                spaceWaiters.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seen = spaceEpoch.load(std::memory_order_seq_cst);
+                if ((queued = ring.tryPush(data))) {
+                    spaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+                timespec timeout{ static_cast<time_t>(left / 1000000000LL), static_cast<long>(left % 1000000000LL) };
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&spaceEpoch), FUTEX_WAIT_PRIVATE, seen, &timeout, nullptr, 0);
+                spaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+            stats.blockedNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - blockStart).count(), std::memory_order_relaxed);
+            if (!queued) {
+                stats.blockTimeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+            return queued;
+        }
+
+        /**
+         * @brief Called by consumers after a pop, wakes the producers blocked on a full ring.
+         *
+         * All of them, not one: a woken producer may find the slot already taken or its
+         * deadline passed, and a single wake would leave the others asleep until timeout.
+         */
+        void freed() {
+            spaceEpoch.fetch_add(1, std::memory_order_seq_cst);
+            if (spaceWaiters.load(std::memory_order_seq_cst) > 0) {
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&spaceEpoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+            }
+        }
+
+        void wake(bool all) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0) {
+                if (all) {
+                    epoch.notify_all();
+                } else {
+                    epoch.notify_one();
+                }
+            }
+        }
+
+        RingBuffer<img_data> ring;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<int> sleepers{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> spaceEpoch{0};
+        std::atomic<int> spaceWaiters{0}; ///< Producers parked in blockPush
+        std::atomic<bool> closed{false};
+};
+
+#endif
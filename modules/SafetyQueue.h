@@ -1,49 +1,157 @@
+#ifndef SAFETY_QUEUE_H
+#define SAFETY_QUEUE_H
+
+#include <atomic>
 #include <iostream>
 #include <pthread.h>
 #include <queue>
+#include <chrono>
+#include <ctime>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include "FrameData.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
+#include "Logger.h"
 
 using namespace std;
 
-/**
- * @struct img_data
- * @brief Container for image data and its identifier.
- */
-struct img_data {
-    int id;
-    cv::Mat img;
-};
-
 /**
  * @brief SafetyQueue class that wraps a standard queue with thread-safe operations and limited size.
  *
+ * The mutex and condition variable are shared with the caller (not copied), so every
+ * push, pop and wait is serialized on the same lock. size() reads an atomic copy of the
+ * depth instead, so monitoring never takes the lock.
+ *
  * @param maxSize Maximum number of items allowed in the queue.
  * @param queueMutex Mutex for locking access to the queue to others threads.
+ * @param queueCond Condition variable signaled when a frame is queued or the queue is closed.
+ * @param policy Overflow policy applied by push() on a full queue.
  */
-class SafetyQueue {
+class SafetyQueue : public FrameQueue {
     public:
         queue<img_data> q;
         int maxSize;
-        pthread_mutex_t queueMutex;
-        int dropCount = 0;
-
-        void push(const img_data& data) {
-            pthread_mutex_lock(&queueMutex);
-            if (q.size() >= maxSize) { // Example size limit
-                std::cerr << "[SafetyQueue] Queue is full, dropping frame " << data.id << "\n";
-                dropCount++;
-                q.pop(); // Drop the oldest frame
-                pthread_mutex_unlock(&queueMutex);
-                return;
+        pthread_mutex_t* queueMutex;
+        pthread_cond_t* queueCond;
+        bool closed = false;
+        pthread_cond_t spaceCond; ///< Signaled when a consumer frees a slot, for the block policy
+        std::atomic<size_t> depth{0}; ///< q.size(), updated under the lock
+
+        SafetyQueue() {
+            pthread_condattr_t attr;
+            pthread_condattr_init(&attr);
+            pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+            pthread_cond_init(&spaceCond, &attr);
+            pthread_condattr_destroy(&attr);
+        }
+
+        ~SafetyQueue() {
+            pthread_cond_destroy(&spaceCond);
+        }
+
+        bool push(const img_data& data) override {
+            pthread_mutex_lock(queueMutex);
+            if (q.size() >= static_cast<size_t>(maxSize) && policy == OverflowPolicy::Block) {
+                stats.blockedPushes++;
+                auto blockStart = std::chrono::steady_clock::now();
+                timespec deadline;
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                long long ns = deadline.tv_nsec + std::chrono::nanoseconds(blockTimeout).count();
+                deadline.tv_sec += ns / 1000000000LL;
+                deadline.tv_nsec = ns % 1000000000LL;
+                int rc = 0;
+                while (q.size() >= static_cast<size_t>(maxSize) && !closed && rc == 0) {
+                    rc = pthread_cond_timedwait(&spaceCond, queueMutex, &deadline);
+                }
+                stats.blockedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - blockStart).count();
+                if (q.size() >= static_cast<size_t>(maxSize)) {
+                    stats.blockTimeouts++;
+                    LOG_WARN("[SafetyQueue] Queue still full after blocking, dropping frame {}", data.id);
+                    pthread_mutex_unlock(queueMutex);
+                    img_data rejected = data;
+                    releaseFrame(rejected);
+                    return false;
+                }
+            } else if (q.size() >= static_cast<size_t>(maxSize)) {
+                if (policy == OverflowPolicy::DropNewest) {
+                    LOG_WARN("[SafetyQueue] Queue is full, dropping new frame {}", data.id);
+                    stats.droppedNewest++;
+                    pthread_mutex_unlock(queueMutex);
+                    img_data rejected = data;
+                    releaseFrame(rejected);
+                    return false;
+                }
+                // Drop the oldest frame and still enqueue the new one
+                LOG_WARN("[SafetyQueue] Queue is full, dropping frame {}", q.front().id);
+                stats.droppedOldest++;
+                releaseFrame(q.front());
+                q.pop();
+            }
+            q.push(data);
+            depth.store(q.size(), std::memory_order_relaxed);
+            pthread_cond_signal(queueCond);
+            pthread_mutex_unlock(queueMutex);
+            return true;
+        }
+
+        bool tryPush(const img_data& data) override {
+            pthread_mutex_lock(queueMutex);
+            if (q.size() >= static_cast<size_t>(maxSize)) {
+                pthread_mutex_unlock(queueMutex);
+                return false;
             }
             q.push(data);
-            pthread_mutex_unlock(&queueMutex);
+            depth.store(q.size(), std::memory_order_relaxed);
+            pthread_cond_signal(queueCond);
+            pthread_mutex_unlock(queueMutex);
+            return true;
+        }
+
+        bool waitPop(img_data& out) override {
+            pthread_mutex_lock(queueMutex);
+            while (q.empty() && !closed) {
+                pthread_cond_wait(queueCond, queueMutex);
+            }
+            if (q.empty()) {
+                pthread_mutex_unlock(queueMutex);
+                return false;
+            }
+            out = q.front();
+            q.pop();
+            depth.store(q.size(), std::memory_order_relaxed);
+            pthread_cond_signal(&spaceCond);
+            pthread_mutex_unlock(queueMutex);
+            return true;
+        }
+
+        bool tryPop(img_data& out) override {
+            pthread_mutex_lock(queueMutex);
+            if (q.empty()) {
+                pthread_mutex_unlock(queueMutex);
+                return false;
+            }
+            out = q.front();
+            q.pop();
+            depth.store(q.size(), std::memory_order_relaxed);
+            pthread_cond_signal(&spaceCond);
+            pthread_mutex_unlock(queueMutex);
+            return true;
+        }
+
+        void close() override {
+            pthread_mutex_lock(queueMutex);
+            closed = true;
+            pthread_cond_broadcast(queueCond);
+            pthread_cond_broadcast(&spaceCond);
+            pthread_mutex_unlock(queueMutex);
         }
 
         void pop() {
             if (!q.empty()) {
                 q.pop();
+                depth.store(q.size(), std::memory_order_relaxed);
             }
         }
 
@@ -58,15 +166,17 @@ class SafetyQueue {
             return frontData;
         }
 
-        size_t size() {
-            return q.size();
+        size_t size() override {
+            return depth.load(std::memory_order_relaxed);
         }
 
-        bool empty() {
-            return q.empty();
+        size_t capacity() override {
+            return maxSize;
         }
 
-        int getDropCount() {
-            return dropCount;
+        bool empty() {
+            return q.empty();
         }
 };
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef STATS_REPORTER_H
+#define STATS_REPORTER_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "LatencyHistogram.h"
+
+/**
+ * @brief Pipeline counters read by the stats thread, summed over every stream.
+ */
+struct StatsSample {
+    int64_t generated = 0;
+    int64_t saved = 0;
+    int64_t dropped = 0;
+    int64_t queued = 0;       ///< Frames waiting for an encoder
+    int64_t writeQueued = 0;  ///< Encoded frames waiting for a writer
+    int64_t duplicates = 0;   ///< Frames whose encoding was reused (--dedup)
+    int64_t dedupSavedNs = 0; ///< Estimated encoder time the duplicates saved
+};
+
+/**
+ * @brief Background thread that publishes a stats snapshot once per second during a run.
+ *
+ * Every second it takes a StatsSample from the sampler and the stage histograms from the
+ * LatencyRecorder, and derives fps and the latency percentiles of that second. Everything
+ * it reads is a relaxed atomic load (the recorder's mutex is only taken by a thread's first
+ * sample), so the producers and consumers never wait on it. The snapshot goes to stdout as
+ * one JSON line and/or to a Prometheus text endpoint served on its own thread.
+ *
+ * @param sampler Function returning the current pipeline counters.
+ * @param latency Stage histograms of the same pipeline.
+ * @param jsonLines Print every snapshot to stdout as a JSON line.
+ * @param port TCP port of the Prometheus endpoint, 0 disables it.
+ * @param host IPv4 address the endpoint binds, loopback unless asked for another interface.
+ */
+class StatsReporter {
+    public:
+        typedef std::function<StatsSample()> Sampler;
+
+        StatsReporter(Sampler sampler, LatencyRecorder& latency, bool jsonLines, int port,
+                      const std::string& host = "127.0.0.1")
+            : sampler(std::move(sampler)), latency(latency), jsonLines(jsonLines), port(port), host(host) {}
+
+        ~StatsReporter() {
+            stop();
+        }
+
+        StatsReporter(const StatsReporter&) = delete;
+        StatsReporter& operator=(const StatsReporter&) = delete;
+
+        /**
+         * @brief Starts the stats thread and, with a port, the endpoint.
+         *
+         * @return false if the endpoint could not listen on the port (errno is kept), the
+         *         JSON lines still run in that case.
+         */
+        bool start() {
+            bool listening = true;
+            if (port > 0) {
+                listening = openListener();
+                if (listening) {
+                    server = std::thread([this] { serve(); });
+                }
+            }
+            startNs = monotonicNs();
+            last = sampler();
+            lastNs = startNs;
+            for (int i = 0; i < REPORTED; ++i) {
+                lastStages[i] = latency.snapshot(REPORTED_STAGES[i]);
+            }
+            ticker = std::thread([this] { run(); });
+            return listening;
+        }
+
+        /**
+         * @brief Stops and joins both threads, safe to call more than once.
+         */
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (ticker.joinable()) {
+                ticker.join();
+            }
+            if (server.joinable()) {
+                server.join();
+            }
+            if (listenFd >= 0) {
+                ::close(listenFd);
+                listenFd = -1;
+            }
+        }
+
+    private:
+        static const int REPORTED = 3;
+        static constexpr Stage REPORTED_STAGES[REPORTED] = { Stage::Encode, Stage::Write, Stage::EndToEnd };
+        static constexpr const char* REPORTED_NAMES[REPORTED] = { "encode", "write", "end_to_end" };
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, std::chrono::seconds(1), [this] { return stopping; })) {
+                lock.unlock();
+                publish();
+                lock.lock();
+            }
+        }
+
+        /**
+         * @brief Takes one snapshot, prints it and refreshes the endpoint's text.
+         */
+        void publish() {
+            StatsSample now = sampler();
+            int64_t nowNs = monotonicNs();
+            double seconds = (nowNs - lastNs) / 1e9;
+            double generatedFps = seconds > 0 ? (now.generated - last.generated) / seconds : 0.0;
+            double savedFps = seconds > 0 ? (now.saved - last.saved) / seconds : 0.0;
+            double rss = residentBytes();
+
+            LatencySnapshot total[REPORTED];
+            LatencySnapshot window[REPORTED];
+            for (int i = 0; i < REPORTED; ++i) {
+                total[i] = latency.snapshot(REPORTED_STAGES[i]);
+                window[i] = total[i].since(lastStages[i]);
+            }
+
+            if (jsonLines) {
+                char line[1024];
+                int n = std::snprintf(line, sizeof(line),
+                    "{\"t\":%.1f,\"generated_fps\":%.1f,\"saved_fps\":%.1f,\"generated\":%lld,\"saved\":%lld,"
+                    "\"dropped\":%lld,\"duplicates\":%lld,\"dedup_saved_ms\":%.1f,\"queue\":%lld,\"write_queue\":%lld,"
+                    "\"rss_mb\":%.1f",
+                    (nowNs - startNs) / 1e9, generatedFps, savedFps, static_cast<long long>(now.generated),
+                    static_cast<long long>(now.saved), static_cast<long long>(now.dropped),
+                    static_cast<long long>(now.duplicates), now.dedupSavedNs / 1e6, static_cast<long long>(now.queued), static_cast<long long>(now.writeQueued), rss / (1024 * 1024));
+                for (int i = 0; i < REPORTED && n < static_cast<int>(sizeof(line)); ++i) {
+                    n += std::snprintf(line + n, sizeof(line) - n, ",\"%s_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                                       REPORTED_NAMES[i], window[i].percentile(0.50) / 1e6,
+                                       window[i].percentile(0.99) / 1e6, window[i].max / 1e6);
+                }
+                if (n < static_cast<int>(sizeof(line)) - 2) {
+                    line[n++] = '}';
+                    line[n++] = '\n';
+                    // One write per line, so it never interleaves with the logger's output
+                    std::fwrite(line, 1, n, stdout);
+                    std::fflush(stdout);
+                }
+            }
+
+            if (port > 0) {
+                std::string text = prometheusText(now, generatedFps, savedFps, rss, total, window);
+                std::lock_guard<std::mutex> lock(mutex);
+                metrics.swap(text);
+            }
+
+            last = now;
+            lastNs = nowNs;
+            for (int i = 0; i < REPORTED; ++i) {
+                lastStages[i] = total[i];
+            }
+        }
+
+        std::string prometheusText(const StatsSample& now, double generatedFps, double savedFps, double rss,
+                                   const LatencySnapshot* total, const LatencySnapshot* window) const {
+            std::string out;
+            char buf[256];
+            auto metric = [&](const char* name, const char* type, double value) {
+                std::snprintf(buf, sizeof(buf), "# TYPE fpsgen_%s %s\nfpsgen_%s %.17g\n", name, type, name, value);
+                out += buf;
+            };
+            metric("generated_frames_total", "counter", static_cast<double>(now.generated));
+            metric("saved_frames_total", "counter", static_cast<double>(now.saved));
+            metric("dropped_frames_total", "counter", static_cast<double>(now.dropped));
+            metric("duplicate_frames_total", "counter", static_cast<double>(now.duplicates));
+            metric("dedup_saved_seconds_total", "counter", now.dedupSavedNs / 1e9);
+            metric("generated_fps", "gauge", generatedFps);
+            metric("saved_fps", "gauge", savedFps);
+            metric("queue_depth", "gauge", static_cast<double>(now.queued));
+            metric("write_queue_depth", "gauge", static_cast<double>(now.writeQueued));
+            metric("resident_memory_bytes", "gauge", rss);
+
+            // Quantiles cover the last second, sum and count the whole run
+            out += "# TYPE fpsgen_stage_latency_seconds summary\n";
+            static const double quantiles[] = { 0.5, 0.99, 0.999 };
+            for (int i = 0; i < REPORTED; ++i) {
+                for (double q : quantiles) {
+                    std::snprintf(buf, sizeof(buf), "fpsgen_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                                  REPORTED_NAMES[i], q, window[i].percentile(q) / 1e9);
+                    out += buf;
+                }
+                std::snprintf(buf, sizeof(buf),
+                              "fpsgen_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n"
+                              "fpsgen_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                              REPORTED_NAMES[i], total[i].sum / 1e9, REPORTED_NAMES[i],
+                              static_cast<unsigned long long>(total[i].total));
+                out += buf;
+            }
+            return out;
+        }
+
+        /**
+         * @brief Resident set size from /proc/self/statm, 0 if unavailable.
+         */
+        static double residentBytes() {
+            int fd = ::open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return 0.0;
+            }
+            char buf[128];
+            ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+            ::close(fd);
+            if (n <= 0) {
+                return 0.0;
+            }
+            buf[n] = '\0';
+            unsigned long long size = 0, resident = 0;
+            if (std::sscanf(buf, "%llu %llu", &size, &resident) != 2) {
+                return 0.0;
+            }
+            return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+        }
+
+        bool openListener() {
+            sockaddr_in addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(port));
+            if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+                errno = EINVAL;
+                return false;
+            }
+            listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listenFd < 0) {
+                return false;
+            }
+            int on = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listenFd, 8) < 0) {
+                int err = errno;
+                ::close(listenFd);
+                listenFd = -1;
+                errno = err;
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Answers every request with the latest snapshot, polling so stop() is seen quickly.
+         */
+        void serve() {
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stopping) {
+                        return;
+                    }
+                }
+                pollfd pfd{ listenFd, POLLIN, 0 };
+                if (::poll(&pfd, 1, 200) <= 0) {
+                    continue;
+                }
+                int client = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client < 0) {
+                    continue;
+                }
+                // The request itself does not matter, every path returns the metrics
+                pollfd cfd{ client, POLLIN, 0 };
+                if (::poll(&cfd, 1, 500) > 0) {
+                    char request[1024];
+                    ssize_t ignored = ::recv(client, request, sizeof(request), 0);
+                    (void)ignored;
+                }
+                std::string body;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    body = metrics;
+                }
+                std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                       std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+                size_t sent = 0;
+                while (sent < response.size()) {
+                    ssize_t n = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0) {
+                        break;
+                    }
+                    sent += static_cast<size_t>(n);
+                }
+                ::close(client);
+            }
+        }
+
+        Sampler sampler;
+        LatencyRecorder& latency;
+        const bool jsonLines;
+        const int port;
+        const std::string host;
+        int listenFd = -1;
+        std::thread ticker;
+        std::thread server;
+        std::mutex mutex;             ///< Guards stopping and metrics, never taken by the pipeline threads
+        std::condition_variable wake;
+        bool stopping = false;
+        std::string metrics;
+        StatsSample last;
+        int64_t startNs = 0;
+        int64_t lastNs = 0;
+        LatencySnapshot lastStages[REPORTED];
+};
+
+#endif
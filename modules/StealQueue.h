@@ -0,0 +1,278 @@
+#ifndef STEAL_QUEUE_H
+#define STEAL_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "FrameData.h"
+#include "FrameQueue.h"
+#include "FramePool.h"
+#include "RingBuffer.h"
+
+/**
+ * @brief Work-stealing FrameQueue: one local deque per consumer instead of one shared head.
+ *
+ * push() hands frames out round-robin to the consumers' deques; a consumer pops its own
+ * deque first and only touches the others (steals) when it is empty, so in steady state
+ * every consumer works on its own cache lines. Each consumer also sleeps on its own futex:
+ * a push wakes the owner of the deque if it sleeps, or a single other sleeper that will
+ * steal the frame, never the whole pool.
+ *
+ * The deques are FIFO rings, not LIFO Chase-Lev deques, because frames should leave in
+ * capture order. Consumers bind themselves to a deque with bindWorker(); unbound threads
+ * behave as worker 0.
+ *
+ * @param capacity Total number of queued frames, split evenly across the deques.
+ * @param workers Number of consumers (deques).
+ */
+class StealQueue : public FrameQueue {
+    public:
+        StealQueue(size_t capacity, int workers) : workerCount(workers > 0 ? workers : 1) {
+            size_t each = (capacity + workerCount - 1) / workerCount;
+            for (int i = 0; i < workerCount; ++i) {
+                lanes.emplace_back(new Lane(each));
+                total += lanes.back()->ring.capacity();
+            }
+        }
+
+        /**
+         * @brief Binds the calling consumer thread to a deque.
+         */
+        static void bindWorker(int worker) {
+            localWorker() = worker;
+        }
+
+        bool push(const img_data& data) override {
+            int target = static_cast<int>(next.fetch_add(1, std::memory_order_relaxed) % workerCount);
+            if (tryPlace(data, target)) {
+                return true;
+            }
+            switch (policy) {
+                case OverflowPolicy::DropNewest: {
+                    stats.droppedNewest.fetch_add(1, std::memory_order_relaxed);
+                    img_data rejected = data;
+                    releaseFrame(rejected);
+                    return false;
+                }
+                case OverflowPolicy::Block:
+                    if (!blockPush(data, target)) {
+                        img_data rejected = data;
+                        releaseFrame(rejected);
+                        return false;
+                    }
+                    return true;
+                default:
+                    while (!tryPlace(data, target)) {
+                        img_data oldest;
+                        if (lanes[target]->ring.tryPop(oldest)) { // Drop the oldest frame of that deque
+                            releaseFrame(oldest);
+                            stats.droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                    return true;
+            }
+        }
+
+        bool tryPush(const img_data& data) override {
+            return tryPlace(data, static_cast<int>(next.fetch_add(1, std::memory_order_relaxed) % workerCount));
+        }
+
+        bool waitPop(img_data& out) override {
+            const int self = localWorker() % workerCount;
+            Lane& own = *lanes[self];
+            for (;;) {
+                if (tryPop(out)) {
+                    return true;
+                }
+                own.sleeping.store(1, std::memory_order_seq_cst);
+                // Pairs with the fence in wake(): either this tryPop sees the frame or the
+                // producer sees sleeping
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                uint32_t seen = own.epoch.load(std::memory_order_seq_cst);
+                if (tryPop(out)) {
+                    own.sleeping.store(0, std::memory_order_relaxed);
+                    return true;
+                }
+                if (closed.load(std::memory_order_acquire)) {
+                    own.sleeping.store(0, std::memory_order_relaxed);
+                    return tryPop(out);
+                }
+                own.epoch.wait(seen, std::memory_order_seq_cst);
+                own.sleeping.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief Pops the caller's own deque, or steals from the next non-empty one.
+         */
+        bool tryPop(img_data& out) override {
+            const int self = localWorker() % workerCount;
+            if (lanes[self]->ring.tryPop(out)) {
+                lanes[self]->localPops.fetch_add(1, std::memory_order_relaxed);
+                freed();
+                return true;
+            }
+            for (int k = 1; k < workerCount; ++k) {
+                Lane& victim = *lanes[(self + k) % workerCount];
+                if (victim.ring.tryPop(out)) {
+                    lanes[self]->steals.fetch_add(1, std::memory_order_relaxed);
+                    freed();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void close() override {
+            closed.store(true, std::memory_order_release);
+            for (auto& lane : lanes) {
+                lane->epoch.fetch_add(1, std::memory_order_seq_cst);
+                lane->epoch.notify_all();
+            }
+            freed();
+        }
+
+        size_t size() override {
+            size_t n = 0;
+            for (auto& lane : lanes) {
+                n += lane->ring.size();
+            }
+            return n;
+        }
+
+        size_t capacity() override {
+            return total;
+        }
+
+        int workers() const {
+            return workerCount;
+        }
+
+        /**
+         * @brief Frames a consumer took from its own deque.
+         */
+        int64_t getLocalPops(int worker) const {
+            return lanes[worker]->localPops.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Frames a consumer stole from other deques.
+         */
+        int64_t getSteals(int worker) const {
+            return lanes[worker]->steals.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Lane {
+            explicit Lane(size_t capacity) : ring(capacity) {}
+
+            RingBuffer<img_data> ring;
+            alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+            std::atomic<int> sleeping{0};
+            std::atomic<int64_t> localPops{0};
+            std::atomic<int64_t> steals{0};
+        };
+
+        static int& localWorker() {
+            thread_local int worker = 0;
+            return worker;
+        }
+
+        /**
+         * @brief Puts the frame in the target deque, or the next one with room, and wakes a consumer.
+         */
+        bool tryPlace(const img_data& data, int target) {
+            for (int k = 0; k < workerCount; ++k) {
+                int i = (target + k) % workerCount;
+                if (lanes[i]->ring.tryPush(data)) {
+                    wake(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Wakes the owner of the deque if it sleeps, otherwise one sleeper that will steal.
+         *
+         * A busy owner may still get to the frame first; waking an idle thread costs one
+         * syscall and keeps the frame from waiting behind the owner's current encode.
+         *
+         * The ring publishes the frame with a release store, which a later load may pass;
+         * the fence keeps the sleeping scan after it, or a consumer that just set sleeping
+         * and found the slot empty would be missed and sleep with a frame queued.
+         */
+        void wake(int owner) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (int k = 0; k < workerCount; ++k) {
+                Lane& lane = *lanes[(owner + k) % workerCount];
+                int sleeping = 1;
+                if (lane.sleeping.load(std::memory_order_seq_cst) == 1 &&
+                    lane.sleeping.compare_exchange_strong(sleeping, 0, std::memory_order_seq_cst)) {
+                    lane.epoch.fetch_add(1, std::memory_order_seq_cst);
+                    lane.epoch.notify_one();
+                    return;
+                }
+            }
+        }
+
+        /**
+         * @brief Block policy: waits on a futex for a consumer to free a slot, up to blockTimeout.
+         */
+        bool blockPush(const img_data& data, int target) {
+            stats.blockedPushes.fetch_add(1, std::memory_order_relaxed);
+            auto blockStart = std::chrono::steady_clock::now();
+            auto deadline = blockStart + blockTimeout;
+            bool queued = false;
+            while (!(queued = tryPlace(data, target)) && !closed.load(std::memory_order_acquire)) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline) {
+                    break;
+                }
+                spaceWaiters.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seen = spaceEpoch.load(std::memory_order_seq_cst);
+                if ((queued = tryPlace(data, target))) {
+                    spaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+                timespec timeout{ static_cast<time_t>(left / 1000000000LL), static_cast<long>(left % 1000000000LL) };
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&spaceEpoch), FUTEX_WAIT_PRIVATE, seen, &timeout, nullptr, 0);
+                spaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+            stats.blockedNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - blockStart).count(), std::memory_order_relaxed);
+            if (!queued) {
+                stats.blockTimeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+            return queued;
+        }
+
+        /**
+         * @brief Called by consumers after a pop, wakes every producer blocked on full deques.
+         */
+        void freed() {
+            spaceEpoch.fetch_add(1, std::memory_order_seq_cst);
+            if (spaceWaiters.load(std::memory_order_seq_cst) > 0) {
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&spaceEpoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+            }
+        }
+
+        const int workerCount;
+        std::vector<std::unique_ptr<Lane>> lanes;
+        size_t total = 0;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> next{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> spaceEpoch{0};
+        std::atomic<int> spaceWaiters{0}; ///< Producers parked in blockPush
+        std::atomic<bool> closed{false};
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef STREAM_MUX_H
+#define STREAM_MUX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "FrameData.h"
+#include "FrameQueue.h"
+#include "RingBuffer.h"
+
+/**
+ * @brief Serves the frame queues of several camera streams from one consumer pool.
+ *
+ * Every stream keeps its own FrameQueue (and overflow policy); consumers call waitPop() on
+ * the mux instead. The next frame comes from the backlogged stream that has received the
+ * least encoder work so far, measured in pixels, so a 4K stream gets the same share of the
+ * pool as each 1080p stream when the pool is saturated and cannot starve them. A stream that
+ * goes idle is not allowed to bank credit: its counter is lifted to the least served busy
+ * stream, so it does not burst when frames arrive again.
+ *
+ * Consumers sleep on one shared epoch (futex) and producers only wake them if someone sleeps.
+ * With a single stream waitPop() goes straight to that queue.
+ */
+class StreamMux {
+    public:
+        static const int MAX_STREAMS = 64;
+
+        /**
+         * @brief Registers the queue of the next stream, its index is the order of the calls.
+         *
+         * @param q Frame queue of the stream.
+         * @param cost Work per frame, the frame's pixel count.
+         */
+        void add(FrameQueue* q, int64_t cost) {
+            std::unique_ptr<Lane> lane(new Lane());
+            lane->q = q;
+            lane->cost = cost > 0 ? cost : 1;
+            lanes.push_back(std::move(lane));
+            open.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Called by a producer after each push.
+         */
+        void notify() {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0) {
+                epoch.notify_one();
+            }
+        }
+
+        /**
+         * @brief Closes the queue of one stream, waking every consumer when it was the last one.
+         */
+        void close(int stream) {
+            lanes[stream]->q->close();
+            if (open.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                epoch.fetch_add(1, std::memory_order_seq_cst);
+                epoch.notify_all();
+            }
+        }
+
+        /**
+         * @brief Waits for the next frame of any stream.
+         *
+         * @return false once every stream is closed and drained.
+         */
+        bool waitPop(img_data& out) {
+            if (lanes.size() == 1) {
+                return lanes[0]->q->waitPop(out);
+            }
+            for (;;) {
+                if (tryPop(out)) {
+                    return true;
+                }
+                sleepers.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t seen = epoch.load(std::memory_order_seq_cst);
+                if (tryPop(out)) {
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+                if (open.load(std::memory_order_acquire) == 0) {
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    return tryPop(out);
+                }
+                epoch.wait(seen, std::memory_order_seq_cst);
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief Takes a frame from the least served backlogged stream, if any has one.
+         */
+        bool tryPop(img_data& out) {
+            const int n = static_cast<int>(lanes.size());
+            // Rotate the scan start so ties do not always go to the first stream
+            int start = static_cast<int>(rotate.fetch_add(1, std::memory_order_relaxed) % n);
+            int best = -1;
+            int64_t bestServed = 0;
+            uint64_t idle = 0;
+            for (int k = 0; k < n; ++k) {
+                int i = (start + k) % n;
+                if (lanes[i]->q->size() == 0) {
+                    idle |= 1ULL << i;
+                    continue;
+                }
+                int64_t served = lanes[i]->served.load(std::memory_order_relaxed);
+                if (best < 0 || served < bestServed) {
+                    best = i;
+                    bestServed = served;
+                }
+            }
+            if (best < 0) {
+                return false;
+            }
+            for (int i = 0; i < n; ++i) {
+                if (idle & (1ULL << i)) {
+                    int64_t served = lanes[i]->served.load(std::memory_order_relaxed);
+                    if (served < bestServed) {
+                        lanes[i]->served.compare_exchange_strong(served, bestServed, std::memory_order_relaxed);
+                    }
+                }
+            }
+            if (take(best, out)) {
+                return true;
+            }
+            // Another consumer emptied it first, take whatever is left
+            for (int k = 0; k < n; ++k) {
+                if (take((start + k) % n, out)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int streams() const {
+            return static_cast<int>(lanes.size());
+        }
+
+        /**
+         * @brief Whether every stream is closed; their queues may still hold frames.
+         */
+        bool closed() const {
+            return open.load(std::memory_order_acquire) == 0;
+        }
+
+        /**
+         * @brief Frames handed to consumers from one stream.
+         */
+        int64_t getServedFrames(int stream) const {
+            return lanes[stream]->frames.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Lane {
+            FrameQueue* q = nullptr;
+            int64_t cost = 1;
+            alignas(CACHE_LINE_SIZE) std::atomic<int64_t> served{0};
+            std::atomic<int64_t> frames{0};
+        };
+
+        bool take(int stream, img_data& out) {
+            Lane& lane = *lanes[stream];
+            if (!lane.q->tryPop(out)) {
+                return false;
+            }
+            lane.served.fetch_add(lane.cost, std::memory_order_relaxed);
+            lane.frames.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        std::vector<std::unique_ptr<Lane>> lanes;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+        alignas(CACHE_LINE_SIZE) std::atomic<int> sleepers{0};
+        std::atomic<uint32_t> rotate{0};
+        std::atomic<int> open{0};
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef TILE_POOL_H
+#define TILE_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent worker pool that runs one job split into tiles at a time.
+ *
+ * The caller publishes a job and sleeps until its last tile is done; workers claim tiles
+ * with a CAS on a packed job/counter word, so tiles go to whichever worker is free.
+ * Everybody sleeps on std::atomic::wait between jobs, no thread is created per frame.
+ *
+ * @param workers Number of worker threads.
+ */
+class TilePool {
+    public:
+        typedef void (*TileFn)(void* ctx, int tile);
+
+        explicit TilePool(int workers) {
+            for (int i = 0; i < workers; ++i) {
+                threads.emplace_back([this] { work(); });
+            }
+        }
+
+        ~TilePool() {
+            stopping.store(true, std::memory_order_release);
+            epoch.fetch_add(1, std::memory_order_release);
+            epoch.notify_all();
+            for (auto& t : threads) {
+                t.join();
+            }
+        }
+
+        TilePool(const TilePool&) = delete;
+        TilePool& operator=(const TilePool&) = delete;
+
+        /**
+         * @brief Runs fn(ctx, t) for every t in [0, tiles) on the workers and waits for completion.
+         *
+         * Several producers may share the pool, their jobs run one after the other.
+         */
+        void run(int tiles, TileFn fn, void* ctx) {
+            if (tiles <= 0) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(runMutex);
+            remaining.store(tiles, std::memory_order_relaxed);
+            jobFn = fn;
+            jobCtx = ctx;
+            jobSeq = (jobSeq + 1) & 0xFFFF;
+            state.store(jobSeq << 48 | static_cast<uint64_t>(tiles) << 24, std::memory_order_release);
+            epoch.fetch_add(1, std::memory_order_release);
+            epoch.notify_all();
+            for (;;) {
+                int left = remaining.load(std::memory_order_acquire);
+                if (left == 0) {
+                    break;
+                }
+                remaining.wait(left, std::memory_order_acquire);
+            }
+        }
+
+        int size() const {
+            return static_cast<int>(threads.size());
+        }
+
+    private:
+        void work() {
+            uint32_t seen = 0;
+            for (;;) {
+                epoch.wait(seen, std::memory_order_acquire);
+                seen = epoch.load(std::memory_order_acquire);
+                if (stopping.load(std::memory_order_acquire)) {
+                    return;
+                }
+                // The job's tile count travels in the same word as the claim counter, so a
+                // late worker can never claim a tile of a job it has not seen
+                uint64_t s = state.load(std::memory_order_acquire);
+                for (;;) {
+                    uint64_t tile = s & FIELD_MASK;
+                    uint64_t tiles = (s >> 24) & FIELD_MASK;
+                    if (tile >= tiles) {
+                        break;
+                    }
+                    if (!state.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel)) {
+                        continue;
+                    }
+                    jobFn(jobCtx, static_cast<int>(tile));
+                    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        remaining.notify_one();
+                    }
+                    s = state.load(std::memory_order_acquire);
+                }
+            }
+        }
+
+        static const uint64_t FIELD_MASK = (1ULL << 24) - 1;
+
+        std::vector<std::thread> threads;
+        std::mutex runMutex;
+        TileFn jobFn = nullptr;
+        void* jobCtx = nullptr;
+        uint64_t jobSeq = 0;
+        alignas(64) std::atomic<uint64_t> state{0}; ///< Job sequence (16 bits) | tile count (24) | next tile (24)
+        alignas(64) std::atomic<int> remaining{0};
+        alignas(64) std::atomic<uint32_t> epoch{0};
+        std::atomic<bool> stopping{false};
+};
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef URING_SINK_H
+#define URING_SINK_H
+
+#ifdef HAVE_LIBURING
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <liburing.h>
+#include "FrameData.h"
+#include "FrameSink.h"
+
+/**
+ * @brief io_uring writer backend: one file per frame, a whole batch per submission.
+ *
+ * Each writer thread owns a ring, a sparse table of direct descriptors and a slab of
+ * page-aligned buffers registered with the kernel. A frame becomes three linked requests,
+ * openat (direct) -> write_fixed -> close (direct), so a batch of N frames costs one
+ * io_uring_enter instead of 3N syscalls and no file descriptor ever enters the process table.
+ *
+ * Encoded bytes are copied once into the registered slot (the encoder owns its output
+ * vector); that copy is what makes the fixed-buffer and O_DIRECT paths possible. With
+ * O_DIRECT the write is padded to the block size and the file is truncated back to the
+ * exact encoded length once the write completes, so the file content is unchanged.
+ *
+ * Needs liburing >= 2.2 and Linux >= 5.15. If the buffers cannot be registered (memlock
+ * limit) plain IORING_OP_WRITE is used from the same buffers.
+ *
+ * @param dir Output directory.
+ * @param ext Image format extension, without the dot.
+ * @param depth Frames in flight per writer thread (the write batch size).
+ * @param slotBytes Size of every registered buffer, the largest encoded frame expected.
+ * @param direct Open the output files with O_DIRECT.
+ */
+class UringSink : public FrameSink {
+    public:
+        static const size_t ALIGN = 4096;
+
+        UringSink(const std::string& dir, const std::string& ext, int depth, size_t slotBytes, bool direct)
+            : dir(dir), ext(ext), depth(depth), direct(direct) {
+            this->slotBytes = (slotBytes + ALIGN - 1) / ALIGN * ALIGN;
+        }
+
+        ~UringSink() {
+            for (auto& ctx : contexts) {
+                closeRing(ctx.get());
+                for (uchar* buf : ctx->buffers) {
+                    free(buf);
+                }
+            }
+        }
+
+        bool write(const encoded_frame& frame) override {
+            bool ok = false;
+            writeBatch(&frame, 1, &ok);
+            return ok;
+        }
+
+        void writeBatch(const encoded_frame* frames, int n, bool* ok) override {
+            Context* ctx = localContext();
+            if (ctx == nullptr) {
+                FrameSink::writeBatch(frames, n, ok);
+                return;
+            }
+            int done = 0;
+            while (done < n) {
+                int count = std::min(n - done, depth);
+                submitBatch(ctx, frames + done, count, ok + done);
+                done += count;
+            }
+        }
+
+        // O_DIRECT bypasses the page cache but not the device cache, so frames are synced either way
+        bool sync() override {
+            return syncDirectory(dir);
+        }
+
+        void report(std::ostream& out) override {
+            int64_t n = completed.load();
+            out << "[Main] io_uring writer: " << n << " frames in " << batches.load() << " batches"
+                << (registeredBuffers.load() ? ", registered buffers" : ", unregistered buffers")
+                << (direct ? ", O_DIRECT" : "")
+                << ", completion latency avg " << (n ? latencyNs.load() / 1000.0 / n : 0.0)
+                << " us, max " << maxLatencyNs.load() / 1000.0 << " us\n";
+        }
+
+    private:
+        struct Context {
+            io_uring ring;
+            std::vector<uchar*> buffers;
+            std::vector<char> paths;      ///< depth paths of FRAME_PATH_MAX bytes
+            std::vector<int> pending;
+            std::vector<char> failed;
+            std::vector<char> queued;
+            std::vector<size_t> length;
+            bool registered = false;
+            bool ready = false;           ///< The ring is set up
+            bool broken = false;          ///< A ring-level error, the ring is set up again before the next batch
+            std::thread::id thread;  ///< Writer thread that uses it
+        };
+
+        /**
+         * @brief Ring of the calling writer thread, set up on its first batch and set up again
+         * after a ring-level error.
+         *
+         * @return nullptr if io_uring is not usable, the caller then falls back to write(2).
+         */
+        Context* localContext() {
+            // Keyed by id, not address: a later sink may reuse a destroyed one's memory
+            thread_local uint64_t owner = 0;
+            thread_local Context* ctx = nullptr;
+            if (owner != id) {
+                ctx = threadContext();
+                owner = id;
+            }
+            if (ctx->broken) {
+                // Requests of the failed batch may still be in the ring, start over with a new one
+                closeRing(ctx);
+                ctx->broken = false;
+                openRing(ctx);
+            }
+            return ctx->ready ? ctx : nullptr;
+        }
+
+        /**
+         * @brief The calling thread's context, created with its ring on the first call. A
+         * context whose ring cannot be set up is kept too, so the thread does not retry on
+         * every batch.
+         */
+        Context* threadContext() {
+            {
+                // Back from another sink: this thread's context is still here
+                std::lock_guard<std::mutex> lock(contextsMutex);
+                for (auto& mine : contexts) {
+                    if (mine->thread == std::this_thread::get_id()) {
+                        return mine.get();
+                    }
+                }
+            }
+            std::unique_ptr<Context> fresh(new Context());
+            fresh->thread = std::this_thread::get_id();
+            for (int i = 0; i < depth; ++i) {
+                void* buf = nullptr;
+                if (posix_memalign(&buf, ALIGN, slotBytes) != 0) {
+                    throw std::bad_alloc();
+                }
+                std::memset(buf, 0, slotBytes);
+                fresh->buffers.push_back(static_cast<uchar*>(buf));
+            }
+            fresh->paths.resize(static_cast<size_t>(depth) * FRAME_PATH_MAX);
+            fresh->pending.resize(depth);
+            fresh->failed.resize(depth);
+            fresh->queued.resize(depth);
+            fresh->length.resize(depth);
+            openRing(fresh.get());
+
+            std::lock_guard<std::mutex> lock(contextsMutex);
+            contexts.push_back(std::move(fresh));
+            return contexts.back().get();
+        }
+
+        /**
+         * @brief Sets up the ring of a context: the sparse file table and, if the memlock
+         * limit allows, the registered buffers.
+         */
+        bool openRing(Context* ctx) {
+            if (io_uring_queue_init(depth * 3, &ctx->ring, 0) < 0) {
+                return false;
+            }
+            if (io_uring_register_files_sparse(&ctx->ring, depth) < 0) {
+                io_uring_queue_exit(&ctx->ring);
+                return false;
+            }
+            std::vector<iovec> iov(depth);
+            for (int i = 0; i < depth; ++i) {
+                iov[i].iov_base = ctx->buffers[i];
+                iov[i].iov_len = slotBytes;
+            }
+            ctx->registered = io_uring_register_buffers(&ctx->ring, iov.data(), depth) == 0;
+            if (ctx->registered) {
+                registeredBuffers.store(true);
+            }
+            ctx->ready = true;
+            return true;
+        }
+
+        void closeRing(Context* ctx) {
+            if (ctx->ready) {
+                io_uring_queue_exit(&ctx->ring);
+                ctx->ready = false;
+            }
+        }
+
+        void submitBatch(Context* ctx, const encoded_frame* frames, int n, bool* ok) {
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (direct ? O_DIRECT : 0);
+            int inFlight = 0;
+            for (int i = 0; i < n; ++i) {
+                const encoded_frame& frame = frames[i];
+                char* path = &ctx->paths[i * FRAME_PATH_MAX];
+                if (!frameFilePath(path, FRAME_PATH_MAX, dir, frame, ext)) {
+                    ctx->queued[i] = 0;
+                    ok[i] = false;
+                    continue;
+                }
+                size_t len = frame.bytes.size();
+                size_t padded = direct ? (len + ALIGN - 1) / ALIGN * ALIGN : len;
+                if (padded > slotBytes) {
+                    // Larger than a registered slot, write it synchronously
+                    ctx->queued[i] = 0;
+                    ok[i] = FileSink(dir, ext).write(frame);
+                    continue;
+                }
+                std::memcpy(ctx->buffers[i], frame.bytes.data(), len);
+                if (padded > len) {
+                    std::memset(ctx->buffers[i] + len, 0, padded - len);
+                }
+                ctx->length[i] = len;
+                ctx->failed[i] = 0;
+                ctx->queued[i] = 1;
+                ctx->pending[i] = 3;
+                inFlight++;
+
+                io_uring_sqe* sqe = io_uring_get_sqe(&ctx->ring);
+                io_uring_prep_openat_direct(sqe, AT_FDCWD, path, flags, 0644, i);
+                sqe->flags |= IOSQE_IO_LINK;
+                io_uring_sqe_set_data64(sqe, static_cast<uint64_t>(i) << 2 | 0);
+
+                sqe = io_uring_get_sqe(&ctx->ring);
+                if (ctx->registered) {
+                    io_uring_prep_write_fixed(sqe, i, ctx->buffers[i], padded, 0, i);
+                } else {
+                    io_uring_prep_write(sqe, i, ctx->buffers[i], padded, 0);
+                }
+                sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+                io_uring_sqe_set_data64(sqe, static_cast<uint64_t>(i) << 2 | 1);
+
+                sqe = io_uring_get_sqe(&ctx->ring);
+                io_uring_prep_close_direct(sqe, i);
+                io_uring_sqe_set_data64(sqe, static_cast<uint64_t>(i) << 2 | 2);
+            }
+            if (inFlight == 0) {
+                return;
+            }
+
+            auto submitted = std::chrono::steady_clock::now();
+            int remaining = inFlight;
+            if (io_uring_submit(&ctx->ring) != inFlight * 3) {
+                // Whatever was not submitted would never complete
+                ctx->broken = true;
+                remaining = 0;
+            }
+            batches.fetch_add(1, std::memory_order_relaxed);
+
+            while (remaining > 0) {
+                io_uring_cqe* cqe = nullptr;
+                int rc = io_uring_wait_cqe(&ctx->ring, &cqe);
+                if (rc == -EINTR) {
+                    continue;
+                }
+                if (rc < 0) {
+                    ctx->broken = true;
+                    break;
+                }
+                uint64_t data = io_uring_cqe_get_data64(cqe);
+                int slot = static_cast<int>(data >> 2);
+                int op = static_cast<int>(data & 3);
+                if (cqe->res < 0 || (op == 1 && static_cast<size_t>(cqe->res) < ctx->length[slot])) {
+                    ctx->failed[slot] = 1;
+                }
+                if (op == 2 && cqe->res < 0) {
+                    // The close was cancelled with its failed write (or never got a file):
+                    // empty the slot so the next batch does not open over a leaked file
+                    int none = -1;
+                    io_uring_register_files_update(&ctx->ring, static_cast<unsigned>(slot), &none, 1);
+                }
+                io_uring_cqe_seen(&ctx->ring, cqe);
+                if (--ctx->pending[slot] == 0) {
+                    remaining--;
+                    int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - submitted).count();
+                    recordLatency(latency);
+                }
+            }
+
+            for (int i = 0; i < n; ++i) {
+                if (ctx->queued[i]) {
+                    ok[i] = ctx->pending[i] == 0 && !ctx->failed[i];
+                    // Drop the O_DIRECT padding so the file holds exactly the encoded bytes
+                    if (ok[i] && direct) {
+                        ok[i] = truncate(&ctx->paths[i * FRAME_PATH_MAX], static_cast<off_t>(ctx->length[i])) == 0;
+                    }
+                }
+            }
+        }
+
+        void recordLatency(int64_t ns) {
+            completed.fetch_add(1, std::memory_order_relaxed);
+            latencyNs.fetch_add(ns, std::memory_order_relaxed);
+            int64_t prev = maxLatencyNs.load(std::memory_order_relaxed);
+            while (ns > prev && !maxLatencyNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+            }
+        }
+
+        static std::atomic<uint64_t>& nextId() {
+            static std::atomic<uint64_t> counter{0};
+            return counter;
+        }
+
+        std::string dir;
+        std::string ext;
+        int depth;
+        size_t slotBytes;
+        bool direct;
+        const uint64_t id = nextId().fetch_add(1, std::memory_order_relaxed) + 1;
+        std::mutex contextsMutex;
+        std::vector<std::unique_ptr<Context>> contexts;
+        std::atomic<bool> registeredBuffers{false};
+        std::atomic<int64_t> batches{0};
+        std::atomic<int64_t> completed{0};
+        std::atomic<int64_t> latencyNs{0};
+        std::atomic<int64_t> maxLatencyNs{0};
+};
+
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef WRITE_PACER_H
+#define WRITE_PACER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Writer-side admission control: steady writeback instead of page cache flush storms.
+ *
+ * Every range a sink writes gets its writeback started right away (sync_file_range
+ * SYNC_FILE_RANGE_WRITE), so dirty pages never pile up until the kernel flushes them all at
+ * once and every write stalls together. The ranges are grouped in windows of flushBytes;
+ * once a window is full (or holds MAX_RANGES ranges) the writer waits for the previous one
+ * to reach the disk. That bounds the dirty data to two windows and, when the wait is not
+ * instant, measures the sustained bandwidth of the device.
+ *
+ * An optional token bucket (GCRA, bursts of a tenth of a second) caps the rate the writers
+ * admit bytes at, either a fixed rate or 90% of the measured bandwidth; every window that
+ * does not wait raises the estimate by 2%, so the bucket cannot hold it at a low first
+ * sample. The share of writer time spent throttled by either is pressure(): the encoders
+ * feed it to the adaptive overflow policy, so quality goes down while the disk falls
+ * behind, before the queues fill.
+ *
+ * @param flushBytes Size of a writeback window, 0 leaves the writeback to the kernel.
+ * @param bytesPerSecond Token bucket rate, 0 for none, AUTO_RATE to follow the measured bandwidth.
+ * @param writers Threads that write, to turn throttled time into a share.
+ */
+class WritePacer {
+    public:
+        static constexpr double AUTO_RATE = -1.0;
+
+        WritePacer(size_t flushBytes, double bytesPerSecond, int writers)
+            : flushBytes(flushBytes), fixedRate(bytesPerSecond), writers(std::max(writers, 1)),
+              windowStart(nowNs()) {}
+
+        ~WritePacer() {
+            drain();
+        }
+
+        WritePacer(const WritePacer&) = delete;
+        WritePacer& operator=(const WritePacer&) = delete;
+
+        /**
+         * @brief Waits until the token bucket admits bytes more; returns at once without a rate.
+         */
+        void admit(size_t bytes) {
+            const double rate = currentRate();
+            if (rate <= 0) {
+                return;
+            }
+            const int64_t now = nowNs();
+            const int64_t cost = static_cast<int64_t>(bytes / rate * 1e9);
+            int64_t waitUntil;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tat = std::max(tat, now);
+                waitUntil = tat - BURST_NS;
+                tat += cost;
+            }
+            if (waitUntil > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(waitUntil - now));
+                const int64_t waited = nowNs() - now;
+                throttledNs.fetch_add(waited, std::memory_order_relaxed);
+                bucketNs.fetch_add(waited, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief Called by a sink after writing length bytes of fd at offset.
+         *
+         * @param closeAfter The pacer owns fd and closes it once its writeback is done.
+         */
+        void written(int fd, off_t offset, size_t length, bool closeAfter) {
+            if (flushBytes == 0) {
+                if (closeAfter) {
+                    ::close(fd);
+                }
+                return;
+            }
+            ::sync_file_range(fd, offset, static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+            std::vector<Range> done;
+            int64_t started = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current.push_back(Range{ fd, offset, length, closeAfter });
+                currentBytes += length;
+                if (currentBytes < flushBytes && current.size() < MAX_RANGES) {
+                    return;
+                }
+                done.swap(previous);
+                previous.swap(current);
+                current.clear();
+                currentBytes = 0;
+                started = previousStart;
+                previousStart = nowNs();
+            }
+            await(done, started);
+        }
+
+        /**
+         * @brief Waits for every pending range and closes the files the pacer owns.
+         */
+        void drain() {
+            std::vector<Range> done;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.swap(previous);
+                done.insert(done.end(), current.begin(), current.end());
+                current.clear();
+                currentBytes = 0;
+            }
+            for (const Range& r : done) {
+                ::sync_file_range(r.fd, r.offset, static_cast<off_t>(r.length),
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                if (r.closeAfter) {
+                    ::close(r.fd);
+                }
+            }
+        }
+
+        /**
+         * @brief Share of the writers' time throttled during the last full second, 0 to 1.
+         *
+         * Cheap enough for every frame: one clock read, the sample is refreshed once a second.
+         */
+        double pressure() {
+            const int64_t now = nowNs();
+            int64_t start = windowStart.load(std::memory_order_relaxed);
+            if (now - start >= 1000000000LL && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+                const int64_t throttled = throttledNs.load(std::memory_order_relaxed);
+                const int64_t last = windowThrottled.exchange(throttled, std::memory_order_relaxed);
+                const double share = static_cast<double>(throttled - last) / (static_cast<double>(now - start) * writers);
+                lastPressure.store(static_cast<int>(std::min(share, 1.0) * 1000), std::memory_order_relaxed);
+            }
+            return lastPressure.load(std::memory_order_relaxed) / 1000.0;
+        }
+
+        /**
+         * @brief Sustained bandwidth estimated on the writeback waits in bytes/s, 0 until the
+         * device has been the bottleneck once.
+         */
+        double getBandwidth() const {
+            return bandwidth.load(std::memory_order_relaxed);
+        }
+
+        bool windowed() const {
+            return flushBytes > 0;
+        }
+
+        double getRate() const {
+            return currentRate();
+        }
+
+        int64_t getThrottledNs() const {
+            return throttledNs.load(std::memory_order_relaxed);
+        }
+
+        int64_t getBucketNs() const {
+            return bucketNs.load(std::memory_order_relaxed);
+        }
+
+        int64_t getWindows() const {
+            return windows.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr int64_t BURST_NS = 100000000;  ///< The bucket holds a tenth of a second
+        static constexpr size_t MAX_RANGES = 256;       ///< Also ends a window, bounds the files kept open
+
+        struct Range {
+            int fd;
+            off_t offset;
+            size_t length;
+            bool closeAfter;
+        };
+
+        static int64_t nowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        double currentRate() const {
+            if (fixedRate != AUTO_RATE) {
+                return fixedRate;
+            }
+            return 0.9 * bandwidth.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Waits for the writeback of a window that was full at started. A wait that
+         * blocks means the device was busy since the later of that and the previous wait, so
+         * the window's bytes over that span are a bandwidth sample.
+         */
+        void await(std::vector<Range>& done, int64_t started) {
+            if (done.empty()) {
+                return;
+            }
+            const int64_t waitStart = nowNs();
+            size_t bytes = 0;
+            for (const Range& r : done) {
+                ::sync_file_range(r.fd, r.offset, static_cast<off_t>(r.length),
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                if (r.closeAfter) {
+                    ::close(r.fd);
+                }
+                bytes += r.length;
+            }
+            const int64_t end = nowNs();
+            const int64_t lastEnd = lastAwaitEnd.exchange(end, std::memory_order_relaxed);
+            windows.fetch_add(1, std::memory_order_relaxed);
+            throttledNs.fetch_add(end - waitStart, std::memory_order_relaxed);
+            const double last = bandwidth.load(std::memory_order_relaxed);
+            if (end - waitStart >= 1000000 && started > 0) {
+                const double sample = bytes / ((end - std::max(started, lastEnd)) / 1e9);
+                bandwidth.store(last == 0 ? sample : 0.8 * last + 0.2 * sample, std::memory_order_relaxed);
+            } else if (last > 0) {
+                // The device kept up, maybe only because the bucket holds the writers back
+                bandwidth.store(last * 1.02, std::memory_order_relaxed);
+            }
+        }
+
+        const size_t flushBytes;
+        const double fixedRate;
+        const int writers;
+        std::mutex mutex;
+        std::vector<Range> current;   ///< Window being filled
+        std::vector<Range> previous;  ///< Full window whose writeback is under way
+        size_t currentBytes = 0;
+        int64_t previousStart = 0;    ///< When the previous window was full
+        int64_t tat = 0;              ///< Theoretical arrival time of the token bucket
+        std::atomic<double> bandwidth{0};
+        std::atomic<int64_t> throttledNs{0};
+        std::atomic<int64_t> bucketNs{0};
+        std::atomic<int64_t> windows{0};
+        std::atomic<int64_t> lastAwaitEnd{0};
+        std::atomic<int64_t> windowStart;
+        std::atomic<int64_t> windowThrottled{0};
+        std::atomic<int> lastPressure{0};
+};
+
+#endif